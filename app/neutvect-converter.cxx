@@ -2,16 +2,81 @@
 #include "TFile.h"
 #include "TH1D.h"
 
+#include "TClass.h"
+#include "TROOT.h"
+
+#include "nvasciiemitter.h"
+#include "nvasciitools.h"
+#include "nvcheckpoint.h"
+#include "nvcolumnar.h"
 #include "nvconv.h"
+#include "nvdaemon.h"
 #include "nvfatxtools.h"
+#include "nvheadertools.h"
+#include "nvindex.h"
+#include "nvinputtools.h"
+#include "nvmanifest.h"
+#include "nvmetacache.h"
+#include "nvmetrics.h"
+#include "nvoutput.h"
+#include "nvpipeline.h"
+#include "nvselect.h"
+#include "nvsource.h"
 
 #include "NuHepMC/AttributeUtils.hxx"
-#include "NuHepMC/make_writer.hxx"
 
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <map>
+#include <regex>
+#include <thread>
+#include <tuple>
 
 std::vector<std::string> files_to_read;
 std::string file_to_write;
+// Guessed from the extension of file_to_write unless given with --format
+std::string output_format_name = "";
+nvconv::OutputFormat output_format = nvconv::OutputFormat::Other;
+bool compress_output = false;
+// Write the events on each target to their own output, see TargetOutputName
+bool split_targets = false;
+// Start a new output file, see ChunkOutputName, once the current one holds
+// this many events or bytes of events before compression. 0 for no limit.
+Long64_t events_per_file = 0;
+uint64_t bytes_per_file = 0;
+
+// Written alongside the main output if --flat is given
+std::string flat_file = "";
+std::unique_ptr<nvconv::FlatTreeWriter> flat_output;
+
+// Stage timings, throughput and the slowest events, only collected and reported
+// if --metrics is given.
+nvconv::ConversionMetrics metrics;
+std::string metrics_base = "";
+size_t nslowest = 10;
+
+nvconv::InputTuning input_tuning;
+// What the pre-pass reads from each input, which is only kept between runs if
+// --metadata-cache is given
+std::unique_ptr<nvconv::MetadataCache> metadata_cache;
+// If set, only the inputs that are not in this manifest are converted, into
+// the next part of the output, see UpdateManifest
+std::string manifest_file = "";
+// If set, how far the conversion has got is written to this file every
+// checkpoint_every input entries, see Checkpoint, and with resume, a
+// conversion that was interrupted carries on from it.
+std::string checkpoint_file = "";
+Long64_t checkpoint_every = 100000;
+bool resume = false;
+nvconv::Checkpoint checkpoint;
+
+// With --serve or --spool, jobs are run in children forked from this process,
+// see Serve. The other options given to the daemon are the defaults of every
+// job.
+nvconv::DaemonOptions daemon_options;
 
 std::string flux_file = "";
 std::string flux_histname = "";
@@ -19,19 +84,164 @@ std::string flux_histname = "";
 bool flux_in_GeV = true;
 double monoE = 0;
 Long64_t skip = 0;
+int nthreads = 1;
+Long64_t shard = 0;
+Long64_t nshards = 1;
+
+bool single_pass = false;
+
+// What the run info of each output is built from, found before converting.
+// fatx_info.while_converting is set if the FATX of each output is to be
+// accumulated from its events, for single_pass or split_targets.
+nvconv::FATXInfo fatx_info;
+std::vector<std::string> file_names;
+
+nvconv::PassthroughLevel passthrough_level = nvconv::PassthroughLevel::Full;
+
+// Events that fail are not converted, see --select
+std::unique_ptr<nvconv::EventSelection> selection;
+
+nvconv::ValidationLevel validation_level = nvconv::ValidationLevel::Full;
+long validate_every = 100;
+std::unique_ptr<nvconv::EventValidator> validator;
+
+bool direct_ascii = false;
+// The number of events written directly that are checked against the text
+// formatted from the HepMC3 event.
+Long64_t const direct_ascii_nchecks = 100;
+std::atomic<Long64_t> direct_ascii_checked{0};
+std::atomic<bool> direct_ascii_failed{false};
 
 Long64_t nmaxevents = std::numeric_limits<Long64_t>::max();
 
 void SayUsage(char const *argv[]) {
   std::cout
       << "[USAGE]: " << argv[0] << "\n"
-      << "\t-i <nv.root> [nv2.root ...]  : neutvect file to read\n"
+      << "\t-i <nv.root> [nv2.root ...]  : neutvect file to read, a "
+         "directory of\n"
+      << "\t                               them, a quoted glob pattern or "
+         "@<list.txt>,\n"
+      << "\t                               a file listing one per line.\n"
       << "\t-N <NMax>                    : Process at most <NMax> events\n"
       << "\t-o <neut.hepmc3>             : hepmc3 file to write\n"
+      << "\t--format <ascii|protobuf>    : Output format, by default "
+         "guessed from\n"
+      << "\t                               the -o extension: .hepmc3 or "
+         ".pb.\n"
+      << "\t-z                           : Compress the output in gzip "
+         "blocks on -j\n"
+      << "\t                               threads, implied by a .gz -o "
+         "extension.\n"
+      << "\t--flat <flat.root>           : Also write a flat tree of event "
+         "values and\n"
+      << "\t                               particle vectors for analysis.\n"
       << "\t-f <flux_file,flux_histname>     : ROOT flux histogram to use to\n"
       << "\t-M                           : -f argument should be interpreted "
          "as being in MeV\n"
-      << "\t-s <N>                       : Skip <N>." << std::endl;
+      << "\t-s <N>                       : Skip <N>.\n"
+      << "\t-j <N>                       : Convert events on <N> worker "
+         "threads.\n"
+      << "\t--cache-size <MB>            : TTreeCache size for reading the "
+         "input,\n"
+      << "\t                               0 disables it, default: 64.\n"
+      << "\t--prefetch                   : Read the next cluster of input "
+         "baskets\n"
+      << "\t                               in the background.\n"
+      << "\t--reuse-objects               : Read every input entry into the "
+         "same\n"
+      << "\t                               NeutVect.\n"
+      << "\t--metadata-cache <dir>       : Keep the entry counts, beam and "
+         "flux\n"
+      << "\t                               histograms of the inputs in "
+         "<dir>, so\n"
+      << "\t                               that later runs skip reading "
+         "them.\n"
+      << "\t--metrics <base>             : Keep <base>.prom up to date with "
+         "Prometheus\n"
+      << "\t                               metrics while converting and "
+         "write a\n"
+      << "\t                               <base>.json summary at exit.\n"
+      << "\t--slowest <N>                : Report the <N> slowest events, "
+         "default: 10.\n"
+      << "\t--shard <k>/<N>              : Only convert the <k>th of <N> "
+         "equal\n"
+      << "\t                               slices of the input entries, -s "
+         "and -N\n"
+      << "\t                               apply within the slice.\n"
+      << "\t--single-pass                : Calculate the FATX from the -f "
+         "flux\n"
+      << "\t                               histogram while converting, "
+         "rather\n"
+      << "\t                               than in a separate pass over the "
+         "input.\n"
+      << "\t--events-per-file <N>        : Start a new output file every "
+         "<N> events.\n"
+      << "\t--bytes-per-file <N[k|M|G]>  : Start a new output file once "
+         "<N> bytes\n"
+      << "\t                               of events, before compression, "
+         "are written.\n"
+      << "\t                               Files are named from -o, which "
+         "may contain\n"
+      << "\t                               e.g. %04d for the file number.\n"
+      << "\t--select <expression>        : Only convert events that pass "
+         "<expression>,\n"
+      << "\t                               e.g. 'abs(Mode) < 30 && nfs(211, "
+         "-211, 111) == 0',\n"
+      << "\t                               see nvselect.h.\n"
+      << "\t--incremental <manifest>     : Only convert the inputs not "
+         "already in\n"
+      << "\t                               <manifest>, into the next "
+         "<neut>.partNNNN\n"
+      << "\t                               output, and record them there.\n"
+      << "\t--checkpoint <file>          : Record the progress of the "
+         "conversion in\n"
+      << "\t                               <file>, for uncompressed "
+         "ASCII output.\n"
+      << "\t--checkpoint-every <N>       : Checkpoint every <N> input "
+         "entries,\n"
+      << "\t                               default: 100000.\n"
+      << "\t--resume                     : Carry on an interrupted "
+         "conversion from\n"
+      << "\t                               its --checkpoint, with the same "
+         "arguments.\n"
+      << "\t--serve <socket>             : Stay resident and run the jobs "
+         "submitted\n"
+      << "\t                               to <socket>, other options are "
+         "defaults\n"
+      << "\t                               for every job.\n"
+      << "\t--spool <dir>                : Also run the <name>.job files "
+         "put in <dir>.\n"
+      << "\t--max-jobs <N>               : Run at most <N> jobs at once, "
+         "default: one\n"
+      << "\t                               per hardware thread.\n"
+      << "\t--daemon <socket>            : Run this conversion in the "
+         "daemon serving\n"
+      << "\t                               <socket>.\n"
+      << "\t--split-targets              : Write the events on each target "
+         "of a\n"
+      << "\t                               multi-target input to its own "
+         "output,\n"
+      << "\t                               named like <neut>.A12Z6H1.hepmc3\n"
+      << "\t--direct-ascii               : Write ASCII output directly from "
+         "the\n"
+      << "\t                               neutvect, without building HepMC3 "
+         "events.\n"
+      << "\t--passthrough <none|event|full> : NEUT attributes to write, "
+         "default: full.\n"
+      << "\t                               event: event-level values only, "
+         "with\n"
+      << "\t                               run-constant values written to the "
+         "run\n"
+      << "\t                               info. full: also per-particle "
+         "values.\n"
+      << "\t--validate <none|sampled[:N]|full> : Check events for beam, "
+         "target and\n"
+      << "\t                               final state particles. full: "
+         "every event,\n"
+      << "\t                               sampled: every <N>th, default "
+         "100, but more\n"
+      << "\t                               thoroughly. default: full."
+      << std::endl;
 }
 
 void handleOpts(int argc, char const *argv[]) {
@@ -40,6 +250,27 @@ void handleOpts(int argc, char const *argv[]) {
     if (std::string(argv[opt]) == "-?" || std::string(argv[opt]) == "--help") {
       SayUsage(argv);
       exit(0);
+    } else if (std::string(argv[opt]) == "--single-pass") {
+      single_pass = true;
+      std::cout << "[INFO]: Calculating FATX while converting." << std::endl;
+    } else if (std::string(argv[opt]) == "--split-targets") {
+      split_targets = true;
+      std::cout << "[INFO]: Writing the events on each target to their own "
+                   "output."
+                << std::endl;
+    } else if (std::string(argv[opt]) == "--direct-ascii") {
+      direct_ascii = true;
+      std::cout << "[INFO]: Writing ASCII output directly." << std::endl;
+    } else if (std::string(argv[opt]) == "--prefetch") {
+      input_tuning.prefetch = true;
+      std::cout << "[INFO]: Prefetching input baskets." << std::endl;
+    } else if (std::string(argv[opt]) == "--reuse-objects") {
+      input_tuning.reuse_objects = true;
+      std::cout << "[INFO]: Reading every input entry into the same NeutVect."
+                << std::endl;
+    } else if (std::string(argv[opt]) == "-z") {
+      compress_output = true;
+      std::cout << "[INFO]: Compressing output." << std::endl;
     } else if (std::string(argv[opt]) == "-M") {
       flux_in_GeV = false;
       std::cout << "[INFO]: Assuming input flux histogram is in MeV."
@@ -59,6 +290,181 @@ void handleOpts(int argc, char const *argv[]) {
         skip = std::stol(argv[++opt]);
         std::cout << "[INFO]: Skipping " << skip << " events before processing."
                   << std::endl;
+      } else if (std::string(argv[opt]) == "-j") {
+        nthreads = std::stoi(argv[++opt]);
+        if (nthreads < 1) {
+          std::cout << "[ERROR]: -j expects a positive number of threads."
+                    << std::endl;
+          exit(1);
+        }
+        std::cout << "[INFO]: Converting with " << nthreads
+                  << " worker threads." << std::endl;
+      } else if (std::string(argv[opt]) == "--shard") {
+        std::string arg = argv[++opt];
+        auto slash = arg.find_first_of('/');
+        if (slash == std::string::npos) {
+          std::cout << "[ERROR]: --shard expects an argument like k/N."
+                    << std::endl;
+          exit(1);
+        }
+        shard = std::stol(arg.substr(0, slash));
+        nshards = std::stol(arg.substr(slash + 1));
+        if ((nshards < 1) || (shard < 0) || (shard >= nshards)) {
+          std::cout << "[ERROR]: --shard " << arg
+                    << " is invalid, expected 0 <= k < N." << std::endl;
+          exit(1);
+        }
+        std::cout << "[INFO]: Converting shard " << shard << " of " << nshards
+                  << "." << std::endl;
+      } else if (std::string(argv[opt]) == "--passthrough") {
+        std::string arg = argv[++opt];
+        if (arg == "none") {
+          passthrough_level = nvconv::PassthroughLevel::None;
+        } else if (arg == "event") {
+          passthrough_level = nvconv::PassthroughLevel::Event;
+        } else if (arg == "full") {
+          passthrough_level = nvconv::PassthroughLevel::Full;
+        } else {
+          std::cout << "[ERROR]: --passthrough expects one of none, event or "
+                       "full, not "
+                    << arg << std::endl;
+          exit(1);
+        }
+        std::cout << "[INFO]: Writing " << arg
+                  << " NEUT passthrough attributes." << std::endl;
+      } else if (std::string(argv[opt]) == "--validate") {
+        std::string arg = argv[++opt];
+        auto colon = arg.find_first_of(':');
+        std::string level = arg.substr(0, colon);
+        if (level == "none") {
+          validation_level = nvconv::ValidationLevel::None;
+        } else if (level == "sampled") {
+          validation_level = nvconv::ValidationLevel::Sampled;
+          if (colon != std::string::npos) {
+            validate_every = std::stol(arg.substr(colon + 1));
+          }
+        } else if (level == "full") {
+          validation_level = nvconv::ValidationLevel::Full;
+        } else {
+          level = "";
+        }
+        if (!level.size() || (validate_every < 1)) {
+          std::cout << "[ERROR]: --validate expects one of none, sampled[:N] "
+                       "or full, not "
+                    << arg << std::endl;
+          exit(1);
+        }
+        std::cout << "[INFO]: Event validation: " << arg << std::endl;
+      } else if (std::string(argv[opt]) == "--format") {
+        output_format_name = argv[++opt];
+        if (output_format_name == "ascii") {
+          output_format = nvconv::OutputFormat::Ascii;
+        } else if (output_format_name == "protobuf") {
+          output_format = nvconv::OutputFormat::Protobuf;
+        } else {
+          std::cout << "[ERROR]: --format expects one of ascii or protobuf, "
+                       "not "
+                    << output_format_name << std::endl;
+          exit(1);
+        }
+        std::cout << "[INFO]: Writing " << output_format_name << " output."
+                  << std::endl;
+      } else if (std::string(argv[opt]) == "--flat") {
+        flat_file = argv[++opt];
+        std::cout << "[INFO]: Writing flat tree to " << flat_file << std::endl;
+      } else if (std::string(argv[opt]) == "--cache-size") {
+        double mb = std::stod(argv[++opt]);
+        if (mb < 0) {
+          std::cout << "[ERROR]: --cache-size expects a size in MB >= 0."
+                    << std::endl;
+          exit(1);
+        }
+        input_tuning.cache_size = Long64_t(mb * (1 << 20));
+        std::cout << "[INFO]: Using a " << mb << " MB TTreeCache." << std::endl;
+      } else if (std::string(argv[opt]) == "--metadata-cache") {
+        try {
+          metadata_cache = std::make_unique<nvconv::MetadataCache>(argv[++opt]);
+        } catch (std::exception const &ex) {
+          std::cout << ex.what() << std::endl;
+          exit(1);
+        }
+        std::cout << "[INFO]: Using input metadata cache in "
+                  << metadata_cache->Dir() << std::endl;
+      } else if (std::string(argv[opt]) == "--incremental") {
+        manifest_file = argv[++opt];
+        std::cout << "[INFO]: Converting only the inputs not in "
+                  << manifest_file << std::endl;
+      } else if (std::string(argv[opt]) == "--checkpoint") {
+        checkpoint_file = argv[++opt];
+        std::cout << "[INFO]: Writing checkpoints to " << checkpoint_file
+                  << std::endl;
+      } else if (std::string(argv[opt]) == "--checkpoint-every") {
+        checkpoint_every = std::stol(argv[++opt]);
+        if (checkpoint_every < 1) {
+          std::cout << "[ERROR]: --checkpoint-every expects a positive number."
+                    << std::endl;
+          exit(1);
+        }
+      } else if (std::string(argv[opt]) == "--resume") {
+        resume = true;
+      } else if (std::string(argv[opt]) == "--serve") {
+        daemon_options.socket_path = argv[++opt];
+      } else if (std::string(argv[opt]) == "--spool") {
+        daemon_options.spool_dir = argv[++opt];
+      } else if (std::string(argv[opt]) == "--max-jobs") {
+        daemon_options.max_jobs = std::stoi(argv[++opt]);
+        if (daemon_options.max_jobs < 1) {
+          std::cout << "[ERROR]: --max-jobs expects a positive number."
+                    << std::endl;
+          exit(1);
+        }
+      } else if (std::string(argv[opt]) == "--select") {
+        try {
+          selection = std::make_unique<nvconv::EventSelection>(argv[++opt]);
+        } catch (std::exception const &ex) {
+          std::cout << ex.what() << std::endl;
+          exit(1);
+        }
+        std::cout << "[INFO]: Selecting events with: "
+                  << selection->Expression() << std::endl;
+      } else if (std::string(argv[opt]) == "--events-per-file") {
+        events_per_file = std::stol(argv[++opt]);
+        if (events_per_file < 1) {
+          std::cout << "[ERROR]: --events-per-file expects a positive number."
+                    << std::endl;
+          exit(1);
+        }
+        std::cout << "[INFO]: Writing at most " << events_per_file
+                  << " events per file." << std::endl;
+      } else if (std::string(argv[opt]) == "--bytes-per-file") {
+        std::string arg = argv[++opt];
+        size_t nchars = 0;
+        double nbytes = std::stod(arg, &nchars);
+        std::string unit = arg.substr(nchars);
+        if (unit == "k") {
+          nbytes *= 1 << 10;
+        } else if (unit == "M") {
+          nbytes *= 1 << 20;
+        } else if (unit == "G") {
+          nbytes *= 1 << 30;
+        } else if (unit.size()) {
+          nbytes = 0;
+        }
+        if (nbytes < 1) {
+          std::cout << "[ERROR]: --bytes-per-file expects a positive size, "
+                       "with an optional k, M or G suffix, not "
+                    << arg << std::endl;
+          exit(1);
+        }
+        bytes_per_file = uint64_t(nbytes);
+        std::cout << "[INFO]: Writing at most " << bytes_per_file
+                  << " bytes of events per file." << std::endl;
+      } else if (std::string(argv[opt]) == "--metrics") {
+        metrics_base = argv[++opt];
+        std::cout << "[INFO]: Writing metrics to " << metrics_base
+                  << ".prom and " << metrics_base << ".json" << std::endl;
+      } else if (std::string(argv[opt]) == "--slowest") {
+        nslowest = std::stoul(argv[++opt]);
       } else if (std::string(argv[opt]) == "-o") {
         file_to_write = argv[++opt];
       } else if (std::string(argv[opt]) == "-f") {
@@ -81,88 +487,978 @@ void handleOpts(int argc, char const *argv[]) {
   }
 }
 
-double GetFATX(TChain &chin, NeutVect *nv, std::unique_ptr<TH1> &flux_hist,
-               bool &isMonoE, int &beam_pid, double &flux_energy_to_MeV) {
+// Formats events for ASCII output, either directly from the NeutVect when
+// --direct-ascii is given, or from the converted HepMC3 event. The first
+// direct_ascii_nchecks directly written events are checked against the HepMC3
+// event, and if any of them differ, every thread goes back to formatting the
+// HepMC3 events for the rest of the run.
+class EventTextFormatter {
+public:
+  EventTextFormatter(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                     nvconv::NEUTPassthrough const &passthrough)
+      : gri(gri), passthrough(passthrough), formatter(gri) {
+    if (direct_ascii) {
+      emitter = std::make_unique<nvconv::AsciiEventEmitter>(gri, passthrough,
+                                                            validator.get());
+    }
+  }
 
-  // reset it so that the caller knows if it comes back set, it was set by this
-  // call
-  flux_hist = nullptr;
+  void Format(NeutVect *nv, Long64_t i, int ifile, Long64_t fentry,
+              std::string &text) {
+    bool direct = emitter && !direct_ascii_failed;
+    if (direct) {
+      emitter->AddEventAttribute("ifile.index", ifile);
+      emitter->AddEventAttribute("ifile.entry", fentry);
+      text.clear();
+      {
+        nvconv::ConversionMetrics::Timer timer(metrics,
+                                               nvconv::Stage::Serialize);
+        emitter->Emit(nv, i, text);
+      }
+      if (direct_ascii_checked++ >= direct_ascii_nchecks) {
+        return;
+      }
+    }
 
-  chin.GetEntries();
-  chin.GetEntry(0);
-  beam_pid = nv->PartInfo(0)->fPID;
-
-  isMonoE = nvconv::isMono(chin, nv);
-  if (isMonoE) {
-    chin.GetEntry(0);
-    double fatx = nv->Totcrs * 1E-2;
-    std::cout << "[INFO]: Calculated FATX from Totcrs for assumed "
-                 "mono-energetic file: "
-              << fatx << " pb/Nucleon" << std::endl;
-    return fatx;
-  } else {
-    std::cout
-        << "[INFO]: Not mono-energetic, so cannot infer FATX from first event."
-        << std::endl;
+    {
+      nvconv::ConversionMetrics::Timer timer(metrics, nvconv::Stage::Convert);
+      // directly written events were already validated by the emitter
+      nvconv::ToGenEvent(nv, gri, hepev, passthrough,
+                         direct ? nullptr : validator.get());
+      nvconv::DecorateEvent(hepev, i, ifile, fentry);
+    }
+    {
+      nvconv::ConversionMetrics::Timer timer(metrics,
+                                             nvconv::Stage::Serialize);
+      formatter.Format(hepev, direct ? check : text);
+    }
+
+    if (direct && (check != text)) {
+      if (!direct_ascii_failed.exchange(true)) {
+        std::cout << "[WARN]: Directly written ASCII for event " << i
+                  << " differs from the HepMC3 event, writing HepMC3 events "
+                     "instead.\n--- direct\n"
+                  << text << "--- HepMC3\n"
+                  << check << std::flush;
+      }
+      text.swap(check);
+    }
+  }
+
+private:
+  std::shared_ptr<HepMC3::GenRunInfo> gri;
+  nvconv::NEUTPassthrough passthrough;
+  std::unique_ptr<nvconv::AsciiEventEmitter> emitter;
+  nvconv::AsciiEventFormatter formatter;
+  HepMC3::GenEvent hepev;
+  std::string check;
+};
+
+// The target nucleus and number of free protons of an event, which events are
+// split on with --split-targets.
+struct TargetKey {
+  int A, Z, H;
+
+  bool operator<(TargetKey const &other) const {
+    return std::tie(A, Z, H) < std::tie(other.A, other.Z, other.H);
+  }
+};
+
+// name with tag inserted before its extension.
+std::string InsertBeforeExtension(std::string const &name,
+                                  std::string const &tag) {
+  for (std::string const ext : {".hepmc3.gz", ".hepmc.gz", ".pb.gz", ".hepmc3",
+                                ".hepmc", ".pb"}) {
+    if ((name.size() > ext.size()) &&
+        !name.compare(name.size() - ext.size(), ext.size(), ext)) {
+      return name.substr(0, name.size() - ext.size()) + tag + ext;
+    }
+  }
+  auto dot = name.find_last_of('.');
+  auto slash = name.find_last_of('/');
+  if ((dot == std::string::npos) ||
+      ((slash != std::string::npos) && (dot < slash))) {
+    return name + tag;
+  }
+  return name.substr(0, dot) + tag + name.substr(dot);
+}
+
+// file_to_write with .A<A>Z<Z>H<H> inserted before its extension.
+std::string TargetOutputName(TargetKey const &target) {
+  return InsertBeforeExtension(
+      file_to_write, ".A" + std::to_string(target.A) + "Z" +
+                         std::to_string(target.Z) + "H" +
+                         std::to_string(target.H));
+}
+
+// The name of the chunk'th file of an output rolled over into several. If
+// name contains a printf-style integer conversion, like %04d, the chunk
+// number is formatted into it, otherwise .<chunk> is inserted before the
+// extension.
+std::string ChunkOutputName(std::string const &name, size_t chunk) {
+  static std::regex const conversion("%0?[0-9]*d");
+  std::smatch match;
+  if (std::regex_search(name, match, conversion)) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), match.str().c_str(), int(chunk));
+    return match.prefix().str() + buf + match.suffix().str();
+  }
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), ".%04d", int(chunk));
+  return InsertBeforeExtension(name, buf);
+}
+
+// One complete output file written by an OutputStream.
+struct OutputChunk {
+  std::string filename;
+  // Moved to a background thread to be closed when the next chunk is opened
+  std::unique_ptr<nvconv::AsciiFileWriter> text_output;
+  std::unique_ptr<HepMC3::Writer> output;
+  // protobuf output is written by a StreamFileWriter, which can be indexed
+  nvconv::StreamFileWriter *indexed_output = nullptr;
+  // Open for ascii and protobuf output, and written next to it as the events
+  // are. Closed on the writing thread when the chunk is full.
+  nvconv::EventIndexWriter event_index;
+  Long64_t nevents = 0;
+  // the events read for this chunk, including those rejected by the
+  // selection, which is its G.C.3 exposure
+  Long64_t nexposure = 0;
+  // event bytes written, before compression
+  uint64_t nbytes = 0;
+};
+
+// One output and everything kept for it: its run info and the NEUT values
+// hoisted into it, its files, each with its writer, event index and event
+// count, and, if the FATX is calculated while converting, its FATX
+// accumulator. With events_per_file or bytes_per_file, the output is rolled
+// over into a new file, a chunk, with the same run info whenever the current
+// one is full, and the full one is closed on a background thread. Streams are
+// opened on the thread reading the input, and only written to by the thread
+// writing the output.
+struct OutputStream {
+  // the name of the output, or the pattern for the names of its chunks
+  std::string filename;
+  std::shared_ptr<HepMC3::GenRunInfo> gri;
+  nvconv::NEUTPassthrough passthrough;
+  std::unique_ptr<nvconv::FATXAccumulator> fatx;
+  // Set if the event count in the header is only known once it is closed
+  bool patch_nevents = false;
+
+  // the last is being written to
+  std::vector<OutputChunk> chunks;
+  // closing the full chunks, oldest first
+  std::deque<std::thread> closers;
+  // at most this many full chunks are being closed at once
+  static constexpr size_t MaxClosers = 2;
+  Long64_t nevents = 0;
+
+  ~OutputStream() { Close(); }
+
+  static bool RollsOver() { return events_per_file || bytes_per_file; }
+
+  bool Open() { return OpenChunk(); }
+
+  OutputChunk &Current() { return chunks.back(); }
+
+  // ASCII events are formatted to text before being written, so that the
+  // offset of each event in the file is known exactly.
+  bool OpenChunk() {
+    chunks.emplace_back();
+    auto &chunk = Current();
+    chunk.filename =
+        RollsOver() ? ChunkOutputName(filename, chunks.size() - 1) : filename;
+    if (output_format == nvconv::OutputFormat::Ascii) {
+      if (resume) {
+        return ResumeChunk(chunk);
+      }
+      chunk.text_output = std::make_unique<nvconv::AsciiFileWriter>(
+          chunk.filename, gri, compress_output, nthreads);
+      return !chunk.text_output->Failed() && OpenIndex(chunk);
+    }
+    chunk.output = nvconv::MakeWriter(chunk.filename, gri, output_format,
+                                      compress_output, nthreads);
+    chunk.indexed_output =
+        dynamic_cast<nvconv::StreamFileWriter *>(chunk.output.get());
+    return !chunk.output->failed() &&
+           (!chunk.indexed_output || OpenIndex(chunk));
+  }
+
+  // Opens the event index of chunk, keeping the first n entries of the index
+  // of a resumed conversion.
+  bool OpenIndex(OutputChunk &chunk, size_t n = 0) {
+    std::string index_file = nvconv::EventIndex::FileName(chunk.filename);
+    if (!chunk.event_index.Open(index_file, file_names, n)) {
+      std::cout << "[ERROR]: Failed to open the event index " << index_file
+                << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  // Reopens the output of an interrupted conversion after the last event
+  // written before its checkpoint, and carries on counting from there.
+  bool ResumeChunk(OutputChunk &chunk) {
+    try {
+      chunk.text_output = std::make_unique<nvconv::AsciiFileWriter>(
+          chunk.filename, checkpoint.offset);
+    } catch (std::exception const &ex) {
+      std::cout << ex.what() << std::endl;
+      return false;
+    }
+    chunk.nevents = checkpoint.nevents;
+    chunk.nexposure = checkpoint.nexposure;
+    chunk.nbytes = checkpoint.nbytes;
+    nevents = checkpoint.nevents;
+    return !chunk.text_output->Failed() && OpenIndex(chunk, checkpoint.nevents);
+  }
+
+  // Hands the current chunk to a background thread to be closed and opens the
+  // next one, if the current one is full. If MaxClosers chunks are still being
+  // closed, waits for the oldest first, so that a writer that outpaces the
+  // compression does not pile up threads and open files.
+  void RollOverIfFull() {
+    auto &chunk = Current();
+    if (!RollsOver() || !chunk.nevents ||
+        !((events_per_file && (chunk.nevents >= events_per_file)) ||
+          (bytes_per_file && (chunk.nbytes >= bytes_per_file)))) {
+      return;
+    }
+    if (!chunk.event_index.Close()) {
+      throw std::runtime_error("neutvect-converter: [ERROR]: Failed to write " +
+                               nvconv::EventIndex::FileName(chunk.filename));
+    }
+    while (closers.size() >= MaxClosers) {
+      closers.front().join();
+      closers.pop_front();
+    }
+    closers.emplace_back([text_output = std::move(chunk.text_output),
+                          output = std::move(chunk.output)]() {
+      if (text_output) {
+        text_output->Close();
+      } else if (output) {
+        output->close();
+      }
+    });
+    if (!OpenChunk()) {
+      throw std::runtime_error("neutvect-converter: [ERROR]: Failed to open " +
+                               Current().filename);
+    }
+  }
+
+  // Records where the event read from entry fentry of input file ifile was
+  // written, in the event index.
+  void IndexEvent(nvconv::EventIndexEntry entry, Long64_t i, int ifile,
+                  Long64_t fentry) {
+    entry.evtno = i;
+    entry.ifile = ifile;
+    entry.fentry = fentry;
+    Current().event_index.Add(entry);
+  }
+
+  void WriteText(std::string const &text, uint32_t checksum, Long64_t i,
+                 int ifile, Long64_t fentry) {
+    RollOverIfFull();
+    auto &chunk = Current();
+    IndexEvent({chunk.text_output->Tell(), uint32_t(text.size()), checksum}, i,
+               ifile, fentry);
+    chunk.text_output->WriteEventText(text);
+    metrics.AddBytesWritten(text.size());
+    chunk.nbytes += text.size();
+    chunk.nevents++;
+    chunk.nexposure++;
+    nevents++;
   }
 
-  flux_hist = nvconv::GetHistFromFile(flux_file, flux_histname);
+  void WriteEvent(HepMC3::GenEvent const &evt, Long64_t i, int ifile,
+                  Long64_t fentry) {
+    RollOverIfFull();
+    auto &chunk = Current();
+    chunk.output->write_event(evt);
+    if (chunk.indexed_output) {
+      IndexEvent(chunk.indexed_output->LastEvent(), i, ifile, fentry);
+      metrics.AddBytesWritten(chunk.indexed_output->LastEvent().length);
+      chunk.nbytes += chunk.indexed_output->LastEvent().length;
+    }
+    chunk.nevents++;
+    chunk.nexposure++;
+    nevents++;
+  }
+
+  // Counts an event rejected by the selection towards the exposure of the
+  // current chunk.
+  void Reject() { Current().nexposure++; }
+
+  void Close() {
+    if (chunks.size()) {
+      auto &chunk = Current();
+      if (chunk.text_output) {
+        chunk.text_output->Close();
+      } else if (chunk.output) {
+        chunk.output->close();
+      }
+      chunk.text_output = nullptr;
+      chunk.output = nullptr;
+      if (!chunk.event_index.Close()) {
+        std::cout << "[ERROR]: Failed to write "
+                  << nvconv::EventIndex::FileName(chunk.filename) << std::endl;
+      }
+    }
+    for (auto &closer : closers) {
+      closer.join();
+    }
+    closers.clear();
+  }
 
-  // if we have a flux file then we can build it
-  if (flux_hist) {
-    auto fatx_opt =
-        nvconv::GetFATXFromFluxHist(chin, nv, flux_hist, flux_in_GeV);
-    if (fatx_opt) {
-      if (flux_in_GeV) {
-        flux_energy_to_MeV = 1E3;
+  // Writes the FATX and event count of each chunk into its header or, if that
+  // cannot be patched in place, into a run info sidecar file next to it.
+  void Finish() {
+    double fatx_value = 0;
+    if (fatx) {
+      fatx_value = fatx->GetFATX(fatx_info.flux_hist);
+      std::cout << "[INFO]: Calculated FATX from converted events as: "
+                << fatx_value << " pb/Nucleon for " << filename << std::endl;
+      nvconv::SetPatchableFluxAveragedTotalXSec(gri, fatx_value);
+    }
+
+    for (auto const &chunk : chunks) {
+      if (chunk.event_index.size()) {
+        std::cout << "[INFO]: Wrote the event index to "
+                  << nvconv::EventIndex::FileName(chunk.filename) << std::endl;
+      }
+
+      if (!fatx && !patch_nevents) {
+        continue;
+      }
+
+      if (patch_nevents) {
+        nvconv::SetPatchableExposureNEvents(gri, chunk.nexposure);
+      }
+
+      // a compressed header cannot be patched in place
+      if ((output_format == nvconv::OutputFormat::Ascii) && !compress_output &&
+          (!fatx ||
+           nvconv::PatchFluxAveragedTotalXSec(chunk.filename, fatx_value)) &&
+          (!patch_nevents ||
+           nvconv::PatchExposureNEvents(chunk.filename, chunk.nexposure))) {
+        std::cout << "[INFO]: Updated the header of " << chunk.filename
+                  << std::endl;
+        continue;
+      }
+
+      std::string sidecar = chunk.filename + ".runinfo.hepmc3";
+      nvconv::WriteRunInfoSidecar(sidecar, gri);
+      std::cout << "[WARN]: Could not update the header of " << chunk.filename
+                << ", the final run info, including G.C.2 and G.C.3, was "
+                   "written to "
+                << sidecar << std::endl;
+    }
+  }
+};
+
+// Holds a single stream unless split_targets is set.
+std::map<TargetKey, std::unique_ptr<OutputStream>> output_streams;
+
+// Builds the run info for an output of nevents events, hoisting the run
+// constant NEUT values of nv into it, and opens the file. Returns nullptr if
+// the file could not be opened.
+OutputStream *OpenOutputStream(TargetKey const &target, NeutVect *nv,
+                               std::string const &filename, Long64_t nevents,
+                               double fatx) {
+  auto stream = std::make_unique<OutputStream>();
+  stream->filename = filename;
+  stream->gri = nvconv::BuildRunInfo(
+      nevents, fatx, fatx_info.flux_hist, fatx_info.isMonoE,
+      fatx_info.beam_pid, fatx_info.flux_energy_to_MeV);
+  if (fatx_info.while_converting) {
+    stream->fatx = std::make_unique<nvconv::FATXAccumulator>(
+        fatx_info.flux_hist, fatx_info.flux_energy_to_MeV != 1);
+    nvconv::SetPatchableFluxAveragedTotalXSec(stream->gri, fatx);
+  }
+  // the number of events in each file is only known once it is closed
+  if (split_targets || OutputStream::RollsOver()) {
+    stream->patch_nevents = true;
+    nvconv::SetPatchableExposureNEvents(stream->gri, nevents);
+  }
+
+  stream->passthrough = nvconv::NEUTPassthrough(passthrough_level);
+  stream->passthrough.AddToRunInfo(nv, stream->gri);
+
+  nvconv::AddInputFileNames(stream->gri, file_names);
+
+  if (!stream->Open()) {
+    std::cout << "[ERROR]: Failed to open " << filename << std::endl;
+    return nullptr;
+  }
+  return (output_streams[target] = std::move(stream)).get();
+}
+
+// Opens the output for the target of nv, the first event read on it, with
+// split_targets. Its event count is only known once it is closed, and its
+// FATX is calculated from its own events, unless the input is mono-energetic.
+OutputStream *OpenTargetStream(NeutVect *nv) {
+  TargetKey target{nv->TargetA, nv->TargetZ, nv->TargetH};
+  std::string filename = TargetOutputName(target);
+  std::cout << "\n[INFO]: Writing events on target A = " << target.A
+            << ", Z = " << target.Z << ", H = " << target.H << " to "
+            << filename << std::endl;
+
+  double fatx = 1;
+  if (fatx_info.while_converting) {
+    // placeholder until the conversion pass is finished
+    fatx = std::numeric_limits<double>::quiet_NaN();
+  } else if (fatx_info.isMonoE) {
+    fatx = nv->Totcrs * 1E-2;
+  }
+  return OpenOutputStream(target, nv, filename, 0, fatx);
+}
+
+// Reads each chain entry in [first_entry, last_entry), keeping track of the
+// index of the input file and the entry in that file it came from, and hands it
+// to process, along with the wall time at which it started to be read, the
+// output stream it is to be written to and whether it passed the selection.
+// Only what is needed to route an event and decide on it is read until it has
+// passed. process returns false to stop early. The chain's tree offsets are
+// used to find the file entry, so starting part way through the chain does not
+// require reading the entries before first_entry.
+template <typename F>
+int ForEachEntry(TChain &chin, NeutVect *&nv, Long64_t first_entry,
+                 Long64_t last_entry, int molecule_A, int molecule_H,
+                 F &&process) {
+
+  Long64_t ents_to_process = last_entry - first_entry;
+
+  std::unique_ptr<nvconv::MemberReader> member_reader;
+  if (selection) {
+    auto members = selection->Members();
+    members.insert(members.end(), {"TargetA", "TargetZ", "TargetH"});
+    if (fatx_info.while_converting) {
+      members.insert(members.end(), nvconv::FATXMembers.begin(),
+                     nvconv::FATXMembers.end());
+    }
+    member_reader = std::make_unique<nvconv::MemberReader>(members);
+  }
+
+  for (Long64_t i = first_entry; i < last_entry; ++i) {
+    double read_start = metrics.Enabled() ? nvconv::WallTime() : 0;
+    Long64_t fentry;
+    bool partial = false;
+    {
+      nvconv::ConversionMetrics::Timer timer(metrics, nvconv::Stage::GetEntry);
+      fentry = chin.LoadTree(i);
+      if (fentry < 0) {
+        std::cout << "\n[ERROR]: Failed to load entry " << i
+                  << " of the input chain, TChain::LoadTree returned " << fentry
+                  << "." << std::endl;
+        return 2;
+      }
+      Int_t nbytes =
+          member_reader
+              ? member_reader->Read(chin.GetTree(), chin.GetTreeNumber(), fentry)
+              : -1;
+      partial = (nbytes >= 0);
+      if (!partial) {
+        nbytes = chin.GetEntry(i);
+      }
+      metrics.AddBytesRead(std::max(nbytes, 0));
+    }
+
+    OutputStream *stream = nullptr;
+    if (split_targets) {
+      auto found =
+          output_streams.find(TargetKey{nv->TargetA, nv->TargetZ, nv->TargetH});
+      if (found != output_streams.end()) {
+        stream = found->second.get();
       } else {
-        flux_energy_to_MeV = 1;
+        // the run info of the new stream is built from the whole event
+        if (partial) {
+          nvconv::ConversionMetrics::Timer timer(metrics,
+                                                 nvconv::Stage::GetEntry);
+          metrics.AddBytesRead(std::max(chin.GetEntry(i), 0));
+          partial = false;
+        }
+        stream = OpenTargetStream(nv);
+      }
+      if (!stream) {
+        return 2;
+      }
+    } else if ((molecule_A != nv->TargetA) || (molecule_H != nv->TargetH)) {
+      std::cout << "neutvect-converter cannot currently convert to NuHepMC for "
+                   "multi-target event vectors into a single output, use "
+                   "--split-targets."
+                << std::endl;
+      return 1;
+    } else {
+      stream = output_streams.begin()->second.get();
+    }
+
+    if (stream->fatx) {
+      stream->fatx->Fill(nv->PartInfo(0)->fP.E(), nv->Totcrs);
+    }
+
+    bool selected = !selection || selection->Select(nv);
+    if (selected && partial) {
+      nvconv::ConversionMetrics::Timer timer(metrics, nvconv::Stage::GetEntry);
+      metrics.AddBytesRead(std::max(chin.GetEntry(i), 0));
+    }
+
+    Long64_t iproc = i - first_entry;
+    if (iproc && (ents_to_process / 100) &&
+        !(iproc % (ents_to_process / 100))) {
+      std::cout << "\rConverting " << iproc << "/" << ents_to_process
+                << std::flush;
+    }
+
+    if (!process(i, chin.GetTreeNumber(), fentry, read_start, *stream,
+                 selected)) {
+      return 0;
+    }
+  }
+  std::cout << "\rConverting " << ents_to_process << "/" << ents_to_process
+            << std::endl;
+
+  return 0;
+}
+
+// Flushes the output and its event index to disk and then records that the
+// conversion carries on from chain entry next_entry, so that the checkpoint
+// never points past what is safely in the output.
+void WriteCheckpoint(OutputStream &stream, Long64_t next_entry) {
+  auto &chunk = stream.Current();
+  if (!chunk.text_output->Flush() || !chunk.event_index.Flush()) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Failed to flush " +
+                             chunk.filename + " for a checkpoint.");
+  }
+  checkpoint.next_entry = next_entry;
+  checkpoint.nevents = chunk.nevents;
+  checkpoint.nexposure = chunk.nexposure;
+  checkpoint.nbytes = chunk.nbytes;
+  checkpoint.offset = chunk.text_output->Tell();
+  if (!checkpoint.Write(checkpoint_file)) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Failed to write " +
+                             checkpoint_file);
+  }
+}
+
+// Called once the event read from chain entry i has been written, or rejected
+// if not written. Writes a checkpoint every checkpoint_every entries.
+void CheckpointAfter(OutputStream &stream, Long64_t i, int ifile,
+                     Long64_t fentry, bool written) {
+  if (!checkpoint_file.size()) {
+    return;
+  }
+  if (written) {
+    checkpoint.last_evtno = i;
+    checkpoint.last_fname = file_names[ifile];
+    checkpoint.last_fentry = fentry;
+  }
+  if (!((i + 1 - checkpoint.first_entry) % checkpoint_every)) {
+    WriteCheckpoint(stream, i + 1);
+  }
+}
+
+struct PipelineEvent {
+  Long64_t i;
+  std::unique_ptr<NeutVect> nv;
+  int ifile;
+  Long64_t fentry;
+  // when the event started to be read, for its latency
+  double read_start;
+  OutputStream *stream;
+  // rejected events are passed along without an nv, so that the writer can
+  // count them and keep the input order
+  bool selected;
+
+  // Holds the converted event if it is written by a HepMC3::Writer, otherwise
+  // it is formatted to text on the worker thread.
+  std::shared_ptr<HepMC3::GenEvent> hepev;
+  std::string text;
+  uint32_t checksum;
+  // only filled if writing flat_output
+  nvconv::FlatEvent flat;
+};
+
+// Reads entries on this thread and hands copies of them to nthreads workers
+// that convert and, for ASCII output, format them. A single writer thread
+// restores the input order so that the output is identical to a serial run.
+int ConvertParallel(TChain &chin, NeutVect *&nv, Long64_t first_entry,
+                    Long64_t last_entry, int molecule_A, int molecule_H) {
+
+  ROOT::EnableThreadSafety();
+
+  bool ascii = (output_format == nvconv::OutputFormat::Ascii);
+
+  // Caps the memory use: no more than this many events are ever held between
+  // being read and being written.
+  size_t const events_in_flight = 64 * nthreads;
+  nvconv::InFlightLimiter limiter(events_in_flight);
+  nvconv::BoundedQueue<PipelineEvent> to_convert(events_in_flight);
+  nvconv::BoundedQueue<PipelineEvent> converted(events_in_flight);
+
+  std::mutex error_mtx;
+  std::exception_ptr error = nullptr;
+  auto abort_pipeline = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(error_mtx);
+      if (!error) {
+        error = std::current_exception();
       }
-      std::cout << "[INFO]: Calculated FATX from input file file as: "
-                << fatx_opt.value() << " pb/Nucleon" << std::endl;
-      return fatx_opt.value();
     }
+    limiter.Close();
+    to_convert.Close();
+    converted.Close();
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 0; t < nthreads; ++t) {
+    workers.emplace_back([&]() {
+      try {
+        // one per output stream, as each has its own run info
+        std::map<OutputStream *, std::unique_ptr<EventTextFormatter>>
+            formatters;
+        while (auto ev = to_convert.Pop()) {
+          if (!ev->selected) {
+            converted.Push(std::move(*ev));
+            continue;
+          }
+          if (ascii) {
+            auto &formatter = formatters[ev->stream];
+            if (!formatter) {
+              formatter = std::make_unique<EventTextFormatter>(
+                  ev->stream->gri, ev->stream->passthrough);
+            }
+            formatter->Format(ev->nv.get(), ev->i, ev->ifile, ev->fentry,
+                              ev->text);
+            ev->checksum = nvconv::EventIndex::Checksum(ev->text);
+          } else {
+            nvconv::ConversionMetrics::Timer timer(metrics,
+                                                   nvconv::Stage::Convert);
+            ev->hepev = std::make_shared<HepMC3::GenEvent>();
+            nvconv::ToGenEvent(ev->nv.get(), ev->stream->gri, *ev->hepev,
+                               ev->stream->passthrough, validator.get());
+            nvconv::DecorateEvent(*ev->hepev, ev->i, ev->ifile, ev->fentry);
+          }
+          if (flat_output) {
+            nvconv::ConversionMetrics::Timer timer(metrics,
+                                                   nvconv::Stage::Convert);
+            ev->flat.Set(ev->nv.get(), ev->i, ev->ifile, ev->fentry);
+          }
+          ev->nv = nullptr;
+          converted.Push(std::move(*ev));
+        }
+      } catch (...) {
+        abort_pipeline();
+      }
+    });
   }
 
-  auto frpair = nvconv::GetFluxRateHistPairFromChain(chin);
-  if (frpair.second) {
+  std::thread writer([&]() {
+    try {
+      std::map<Long64_t, PipelineEvent> pending;
+      Long64_t next = first_entry;
+      while (auto ev = converted.Pop()) {
+        pending.emplace(ev->i, std::move(*ev));
+        for (auto it = pending.begin();
+             (it != pending.end()) && (it->first == next);
+             it = pending.erase(it), ++next) {
+          auto &ev = it->second;
+          if (!ev.selected) {
+            ev.stream->Reject();
+            CheckpointAfter(*ev.stream, ev.i, ev.ifile, ev.fentry, false);
+            limiter.Release();
+            continue;
+          }
+          {
+            nvconv::ConversionMetrics::Timer timer(metrics,
+                                                   nvconv::Stage::Write);
+            if (ascii) {
+              ev.stream->WriteText(ev.text, ev.checksum, ev.i, ev.ifile,
+                                   ev.fentry);
+            } else {
+              ev.stream->WriteEvent(*ev.hepev, ev.i, ev.ifile, ev.fentry);
+            }
+            if (flat_output) {
+              flat_output->Fill(it->second.flat);
+            }
+          }
+          CheckpointAfter(*ev.stream, ev.i, ev.ifile, ev.fentry, true);
+          if (metrics.Enabled()) {
+            metrics.EventDone(nvconv::WallTime() - ev.read_start, ev.i,
+                              ev.ifile, ev.fentry);
+          }
+          limiter.Release();
+        }
+      }
+    } catch (...) {
+      abort_pipeline();
+    }
+  });
 
-    double fatx = 1E-2 * (frpair.first->Integral() / frpair.second->Integral());
+  // the threads have to be joined however reading ends, so an exception from
+  // reading stops the pipeline and is rethrown once they have finished
+  int rtn = 0;
+  try {
+    rtn = ForEachEntry(
+        chin, nv, first_entry, last_entry, molecule_A, molecule_H,
+        [&](Long64_t i, int ifile, Long64_t fentry, double read_start,
+            OutputStream &stream, bool selected) {
+          if (!limiter.Acquire()) {
+            return false;
+          }
+          std::unique_ptr<NeutVect> nv_copy;
+          if (selected) {
+            nvconv::ConversionMetrics::Timer timer(metrics,
+                                                   nvconv::Stage::GetEntry);
+            nv_copy.reset(static_cast<NeutVect *>(nv->Clone()));
+          }
+          return to_convert.Push(PipelineEvent{
+              i, std::move(nv_copy), ifile, fentry, read_start, &stream,
+              selected, nullptr, "", 0, nvconv::FlatEvent()});
+        });
+  } catch (...) {
+    abort_pipeline();
+  }
 
-    flux_hist = std::move(frpair.second);
+  to_convert.Close();
+  for (auto &w : workers) {
+    w.join();
+  }
+  converted.Close();
+  writer.join();
 
-    std::cout
-        << "[INFO]: Calculated FATX from histograms in input file as: 1E-2 * "
-        << frpair.first->Integral() << "/" << flux_hist->Integral() << " = "
-        << fatx << " pb/Nucleon" << std::endl;
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return rtn;
+}
 
-    return fatx;
+// Writes nv to flat_output, if there is one
+void FillFlat(NeutVect *nv, Long64_t i, int ifile, Long64_t fentry) {
+  if (flat_output) {
+    {
+      nvconv::ConversionMetrics::Timer timer(metrics, nvconv::Stage::Convert);
+      flat_output->Current().Set(nv, i, ifile, fentry);
+    }
+    nvconv::ConversionMetrics::Timer timer(metrics, nvconv::Stage::Write);
+    flat_output->Fill();
   }
+}
+
+int ConvertSerial(TChain &chin, NeutVect *&nv, Long64_t first_entry,
+                  Long64_t last_entry, int molecule_A, int molecule_H) {
+
+  // one per output stream, as each has its own run info
+  std::map<OutputStream *, std::unique_ptr<EventTextFormatter>> formatters;
+  std::string text;
+  HepMC3::GenEvent hepev;
 
-  return 1;
+  return ForEachEntry(
+      chin, nv, first_entry, last_entry, molecule_A, molecule_H,
+      [&](Long64_t i, int ifile, Long64_t fentry, double read_start,
+          OutputStream &stream, bool selected) {
+        if (!selected) {
+          stream.Reject();
+          CheckpointAfter(stream, i, ifile, fentry, false);
+          return true;
+        }
+        if (output_format == nvconv::OutputFormat::Ascii) {
+          auto &formatter = formatters[&stream];
+          if (!formatter) {
+            formatter =
+                std::make_unique<EventTextFormatter>(stream.gri,
+                                                     stream.passthrough);
+          }
+          formatter->Format(nv, i, ifile, fentry, text);
+          nvconv::ConversionMetrics::Timer timer(metrics,
+                                                 nvconv::Stage::Write);
+          stream.WriteText(text, nvconv::EventIndex::Checksum(text), i, ifile,
+                           fentry);
+          CheckpointAfter(stream, i, ifile, fentry, true);
+        } else {
+          {
+            nvconv::ConversionMetrics::Timer timer(metrics,
+                                                   nvconv::Stage::Convert);
+            nvconv::ToGenEvent(nv, stream.gri, hepev, stream.passthrough,
+                               validator.get());
+            nvconv::DecorateEvent(hepev, i, ifile, fentry);
+          }
+          nvconv::ConversionMetrics::Timer timer(metrics,
+                                                 nvconv::Stage::Write);
+          stream.WriteEvent(hepev, i, ifile, fentry);
+        }
+        FillFlat(nv, i, ifile, fentry);
+        if (metrics.Enabled()) {
+          metrics.EventDone(nvconv::WallTime() - read_start, i, ifile, fentry);
+        }
+        return true;
+      });
 }
 
-int main(int argc, char const *argv[]) {
+// Writes manifest, which already records the inputs converted by this run,
+// and the run info of every part converted so far, with the combined FATX and
+// exposure, to <output>.runinfo.hepmc3. nv is any event of the run, for the
+// run-constant NEUT values.
+int UpdateManifest(nvconv::ConversionManifest const &manifest,
+                   std::string const &output, NeutVect *nv) {
+  if (!manifest.Write()) {
+    std::cout << "[ERROR]: Failed to write " << manifest.Filename()
+              << std::endl;
+    return 1;
+  }
 
-  handleOpts(argc, argv);
+  std::unique_ptr<TH1> flux_hist;
+  if (manifest.FluxHist()) {
+    flux_hist.reset(static_cast<TH1 *>(manifest.FluxHist()->Clone()));
+    flux_hist->SetDirectory(nullptr);
+  }
+  bool isMonoE = manifest.IsMonoE();
+  auto gri = nvconv::BuildRunInfo(manifest.NEvents(), manifest.FATX(),
+                                  flux_hist, isMonoE, manifest.BeamPID(),
+                                  fatx_info.flux_energy_to_MeV);
+  nvconv::NEUTPassthrough(passthrough_level).AddToRunInfo(nv, gri);
+
+  std::string sidecar = output + ".runinfo.hepmc3";
+  nvconv::WriteRunInfoSidecar(sidecar, gri);
+  std::cout << "[INFO]: " << manifest.Filename() << " now holds "
+            << manifest.Inputs().size() << " inputs with "
+            << manifest.NEvents() << " events in " << manifest.NParts()
+            << " parts, with a combined FATX of " << manifest.FATX()
+            << " pb/Nucleon. Wrote their run info to " << sidecar
+            << std::endl;
+  return 0;
+}
+
+// Runs the conversion set up by handleOpts.
+int Convert() {
 
   if (!files_to_read.size() || !file_to_write.length()) {
     std::cout << "[ERROR]: Expected -i and -o arguments." << std::endl;
     return 1;
   }
 
+  if (!output_format_name.size()) {
+    output_format = nvconv::GuessOutputFormat(file_to_write);
+  }
+  if (nvconv::IsCompressedOutput(file_to_write)) {
+    compress_output = true;
+  }
+
+  if (compress_output && (output_format == nvconv::OutputFormat::Other)) {
+    std::cout << "[ERROR]: Can only compress ascii or protobuf output, use "
+                 "--format to choose one for "
+              << file_to_write << std::endl;
+    return 1;
+  }
+
+  if (bytes_per_file && (output_format == nvconv::OutputFormat::Other)) {
+    std::cout << "[ERROR]: --bytes-per-file needs ascii or protobuf output, "
+                 "use --format to choose one for "
+              << file_to_write << std::endl;
+    return 1;
+  }
+
+  if (manifest_file.size() &&
+      (flux_file.size() || split_targets || (nshards > 1) || skip ||
+       (nmaxevents != std::numeric_limits<Long64_t>::max()))) {
+    std::cout << "[ERROR]: --incremental converts whole inputs and combines "
+                 "their FATX from the flux histograms in them, so cannot be "
+                 "used with -f, -s, -N, --shard or --split-targets."
+              << std::endl;
+    return 1;
+  }
+
+  if (resume && !checkpoint_file.size()) {
+    std::cout << "[ERROR]: --resume needs the --checkpoint <file> of the "
+                 "conversion to resume."
+              << std::endl;
+    return 1;
+  }
+
+  // a checkpoint is an offset into a single file that is truncated to it on
+  // resuming, which compressed output and the other outputs cannot be
+  if (checkpoint_file.size() &&
+      ((output_format != nvconv::OutputFormat::Ascii) || compress_output ||
+       split_targets || OutputStream::RollsOver() || flat_file.size())) {
+    std::cout << "[ERROR]: --checkpoint needs a single uncompressed HepMC3 "
+                 "ASCII output, so cannot be used with -z, --split-targets, "
+                 "--events-per-file, --bytes-per-file or --flat."
+              << std::endl;
+    return 1;
+  }
+
+  if (direct_ascii && (output_format != nvconv::OutputFormat::Ascii)) {
+    std::cout << "[WARN]: --direct-ascii only applies to HepMC3 ASCII output, "
+                 "ignoring it for "
+              << file_to_write << std::endl;
+    direct_ascii = false;
+  }
+
+  // the inputs are opened and their metadata read on a thread pool, after
+  // which the chain is built in the order given without opening them again
+  std::vector<std::shared_ptr<nvconv::FileMetadata const>> input_metadata;
+  if (!metadata_cache) {
+    metadata_cache = std::make_unique<nvconv::MetadataCache>();
+  }
+  try {
+    files_to_read = nvconv::ExpandInputFiles(files_to_read);
+    std::cout << "[INFO]: Reading metadata of " << files_to_read.size()
+              << " input files." << std::endl;
+    input_metadata = metadata_cache->Get(files_to_read);
+  } catch (std::exception const &ex) {
+    std::cout << ex.what() << std::endl;
+    return 1;
+  }
+
+  // the manifest is only written once the new part has been converted
+  std::unique_ptr<nvconv::ConversionManifest> manifest;
+  std::string output_base = file_to_write;
+  if (manifest_file.size()) {
+    std::vector<std::string> new_files;
+    std::vector<std::shared_ptr<nvconv::FileMetadata const>> new_metadata;
+    try {
+      manifest = std::make_unique<nvconv::ConversionManifest>(manifest_file,
+                                                              file_to_write);
+      for (size_t fi = 0; fi < files_to_read.size(); ++fi) {
+        if (!manifest->Contains(*input_metadata[fi])) {
+          new_files.push_back(files_to_read[fi]);
+          new_metadata.push_back(input_metadata[fi]);
+        }
+      }
+      std::cout << "[INFO]: " << (files_to_read.size() - new_files.size())
+                << " of " << files_to_read.size()
+                << " inputs were already converted into " << manifest->NParts()
+                << " parts." << std::endl;
+      if (!new_files.size()) {
+        std::cout << "[INFO]: Nothing new to convert." << std::endl;
+        return 0;
+      }
+      manifest->AddPart(new_files, new_metadata);
+    } catch (std::exception const &ex) {
+      std::cout << ex.what() << std::endl;
+      return 1;
+    }
+    files_to_read = std::move(new_files);
+    input_metadata = std::move(new_metadata);
+
+    char part[32];
+    std::snprintf(part, sizeof(part), ".part%04d", manifest->NParts() - 1);
+    file_to_write = InsertBeforeExtension(output_base, part);
+    std::cout << "[INFO]: Converting " << files_to_read.size()
+              << " new inputs into " << file_to_write << std::endl;
+  }
+
   TChain chin("neuttree");
 
-  for (auto const &ftr : files_to_read) {
-    if (!chin.Add(ftr.c_str(), 0)) {
+  for (size_t fi = 0; fi < files_to_read.size(); ++fi) {
+    auto const &ftr = files_to_read[fi];
+    // with a known entry count, the chain does not open the file until it is
+    // read
+    if (!chin.Add(ftr.c_str(), input_metadata[fi]->nentries)) {
       std::cout << "[ERROR]: Failed to find tree: \"neuttree\" in file: \""
                 << ftr << "\"." << std::endl;
       return 1;
     }
   }
 
-  chin.SetAutoDelete(true);
-
   Long64_t ents = chin.GetEntries();
   // need to do this before opening the other file or... kablamo
   chin.GetEntry(0);
@@ -170,88 +1466,264 @@ int main(int argc, char const *argv[]) {
   NeutVect *nv = nullptr;
   chin.SetBranchAddress("vectorbranch", &nv);
 
-  if (skip >= ents) {
-    std::cout << "Skipping " << skip << ", but only have " << ents
-              << " in the input file." << std::endl;
+  Long64_t shard_begin, shard_end;
+  std::tie(shard_begin, shard_end) = nvconv::ShardRange(ents, shard, nshards);
+  if (nshards > 1) {
+    std::cout << "[INFO]: Shard " << shard << "/" << nshards
+              << " covers chain entries [" << shard_begin << ", " << shard_end
+              << ")." << std::endl;
+  }
+
+  if (skip >= (shard_end - shard_begin)) {
+    std::cout << "Skipping " << skip << ", but only have "
+              << (shard_end - shard_begin) << " in the input "
+              << ((nshards > 1) ? "shard." : "file.") << std::endl;
     return 1;
   }
 
-  Long64_t ents_to_run = std::min(ents, skip + nmaxevents);
-  Long64_t ents_to_process = ents_to_run - skip;
+  Long64_t first_entry = shard_begin + skip;
+  Long64_t last_entry =
+      first_entry + std::min(nmaxevents, shard_end - first_entry);
+  Long64_t ents_to_process = last_entry - first_entry;
 
   auto first_file = std::unique_ptr<TFile>(
       TFile::Open(files_to_read.front().c_str(), "READ"));
 
-  std::unique_ptr<TH1> flux_histo = nullptr;
-  bool isMonoE = false;
-  int beam_pid = 0;
+  metrics.SetNSlowest(nslowest);
+  metrics.SetEnabled(metrics_base.size());
+  if (metrics_base.size()) {
+    metrics.StartExporting(metrics_base + ".prom");
+  }
+
+  file_names = nvconv::ChainFileNames(chin);
+  metrics.SetFileNames(file_names);
+
+  // the -f argument, recorded in the checkpoint
+  std::string flux =
+      flux_file.size() ? (flux_file + "," + flux_histname) : std::string();
+
+  // the entry to start converting from, later than first_entry if resuming
+  Long64_t convert_from = first_entry;
+  if (checkpoint_file.size()) {
+    if (resume) {
+      if (!checkpoint.Read(checkpoint_file)) {
+        std::cout << "[ERROR]: Failed to read checkpoint " << checkpoint_file
+                  << std::endl;
+        return 1;
+      }
+      if ((checkpoint.output != file_to_write) ||
+          (checkpoint.inputs != file_names) ||
+          (checkpoint.first_entry != first_entry) ||
+          (checkpoint.last_entry != last_entry) ||
+          (checkpoint.flux != flux)) {
+        std::cout << "[ERROR]: " << checkpoint_file
+                  << " was written by a conversion with different inputs, "
+                     "output, entry range or flux, resume with the same "
+                     "arguments."
+                  << std::endl;
+        return 1;
+      }
+      convert_from = checkpoint.next_entry;
+      std::cout << "[INFO]: Resuming " << file_to_write << " from entry "
+                << convert_from << " after " << checkpoint.nevents
+                << " events, the last of which was entry "
+                << checkpoint.last_fentry << " of " << checkpoint.last_fname
+                << std::endl;
+    } else {
+      checkpoint.output = file_to_write;
+      checkpoint.inputs = file_names;
+      checkpoint.first_entry = first_entry;
+      checkpoint.last_entry = last_entry;
+      checkpoint.next_entry = first_entry;
+      checkpoint.flux = flux;
+    }
+  }
+
+  nvconv::TuneInput(&chin, input_tuning, convert_from, last_entry);
 
-  double flux_energy_to_MeV = 1E3;
-  double fatx =
-      GetFATX(chin, nv, flux_histo, isMonoE, beam_pid, flux_energy_to_MeV);
+  if (resume) {
+    // the inputs are the same as those the FATX in the checkpoint was found for
+    fatx_info = checkpoint.GetFATXInfo();
+    std::cout << "[INFO]: Using the FATX from the checkpoint: "
+              << fatx_info.fatx << " pb/Nucleon" << std::endl;
+  } else {
+    nvconv::ConversionMetrics::Timer timer(metrics, nvconv::Stage::PrePass);
+    nvconv::FATXOptions fatx_options;
+    fatx_options.flux_file = flux_file;
+    fatx_options.flux_histname = flux_histname;
+    fatx_options.flux_in_GeV = flux_in_GeV;
+    fatx_options.while_converting = single_pass;
+    fatx_options.per_target = split_targets;
+    fatx_options.metadata_cache = metadata_cache.get();
+    fatx_info = nvconv::FindFATX(chin, nv, fatx_options);
+    if (checkpoint_file.size()) {
+      checkpoint.SetFATXInfo(fatx_info);
+    }
+  }
   first_file->Close();
   first_file = nullptr;
+  if (metadata_cache->Dir().size()) {
+    std::cout << "[INFO]: Found " << metadata_cache->NHits() << " of "
+              << (metadata_cache->NHits() + metadata_cache->NMisses())
+              << " input files in the metadata cache." << std::endl;
+  }
+
+  if (checkpoint_file.size() && fatx_info.while_converting) {
+    std::cout << "[ERROR]: --checkpoint cannot be used while the FATX is "
+                 "calculated from the converted events, drop --single-pass."
+              << std::endl;
+    return 1;
+  }
 
   chin.GetEntry(0);
 
   int molecule_A = nv->TargetA;
   int molecule_H = nv->TargetH;
 
-  auto gri = nvconv::BuildRunInfo(ents_to_run, fatx, flux_histo, isMonoE,
-                                  beam_pid, flux_energy_to_MeV);
-
-  std::unique_ptr<HepMC3::Writer> output(
-      NuHepMC::Writer::make_writer(file_to_write, gri));
+  validator = std::make_unique<nvconv::EventValidator>(validation_level,
+                                                       validate_every);
 
-  if (output->failed()) {
+  // With split_targets, each output is opened when its first event is read.
+  // Otherwise, nv still holds the first entry of the chain, rather than of this
+  // shard, so that every shard hoists the same values.
+  if (!split_targets &&
+      !OpenOutputStream(TargetKey{nv->TargetA, nv->TargetZ, nv->TargetH}, nv,
+                        file_to_write, ents_to_process, fatx_info.fatx)) {
     return 2;
   }
 
-  Long64_t fentry = 0;
-  TUUID fuid = chin.GetFile()->GetUUID();
-  std::string fname = chin.GetFile()->GetName();
-  for (Long64_t i = 0; i < ents_to_run; ++i) {
-    if (i >= ents) {
-      break;
+  // so that a conversion that dies before its first checkpoint can be resumed
+  // from the start, rather than left with no checkpoint or a stale one
+  if (checkpoint_file.size()) {
+    try {
+      WriteCheckpoint(*output_streams.begin()->second, convert_from);
+    } catch (std::exception const &ex) {
+      std::cout << ex.what() << std::endl;
+      return 2;
     }
-    chin.GetEntry(i);
+  }
 
-    if (i == 0) {
-      fuid = chin.GetFile()->GetUUID();
-      fname = chin.GetFile()->GetName();
-    } else if (chin.GetFile()->GetUUID() != fuid) {
-      fuid = chin.GetFile()->GetUUID();
-      fname = chin.GetFile()->GetName();
-      fentry = 0;
-    }
+  if (flat_file.size()) {
+    flat_output = std::make_unique<nvconv::FlatTreeWriter>(flat_file);
+  }
 
-    if (i < skip) { // we have to manually skip them to work out the correct
-                    // file indexing
-      fentry++;
-      continue;
+  int rtn = (nthreads > 1) ? ConvertParallel(chin, nv, convert_from,
+                                             last_entry, molecule_A, molecule_H)
+                           : ConvertSerial(chin, nv, convert_from, last_entry,
+                                           molecule_A, molecule_H);
+
+  for (auto &target_stream : output_streams) {
+    target_stream.second->Close();
+  }
+
+  validator->PrintSummary(std::cout);
+  if (selection) {
+    selection->PrintSummary(std::cout);
+  }
+  nvconv::PrintInputStats(&chin, std::cout);
+
+  // a flat tree of part of the events would look like a complete one
+  if (flat_output && rtn) {
+    flat_output->Discard();
+    std::cout << "[WARN]: Removed the incomplete flat output " << flat_file
+              << std::endl;
+  } else if (flat_output) {
+    flat_output->Close();
+  }
+
+  if (!rtn) {
+    for (auto &target_stream : output_streams) {
+      std::cout << "[INFO]: Wrote " << target_stream.second->nevents
+                << " events to " << target_stream.second->filename;
+      if (target_stream.second->chunks.size() > 1) {
+        std::cout << " in " << target_stream.second->chunks.size()
+                  << " files";
+      }
+      std::cout << std::endl;
+      target_stream.second->Finish();
+    }
+    if (manifest) {
+      rtn = UpdateManifest(*manifest, output_base, nv);
+    }
+    // the output and its event index are complete, so nothing is left to
+    // resume
+    if (checkpoint_file.size()) {
+      std::remove(checkpoint_file.c_str());
     }
+  }
 
-    if ((molecule_A != nv->TargetA) || (molecule_H != nv->TargetH)) {
-      std::cout << "neutvect-converter cannot currently convert to NuHepMC for "
-                   "multi-target event vectors."
+  if (metrics_base.size()) {
+    metrics.StopExporting();
+    metrics.PrintSummary(std::cout);
+    if (!metrics.WriteJSON(metrics_base + ".json")) {
+      std::cout << "[WARN]: Failed to write " << metrics_base << ".json"
                 << std::endl;
-      return 1;
     }
+  }
 
-    if (i && (ents_to_process / 100) && !(i % (ents_to_process / 100))) {
-      std::cout << "\rConverting " << i << "/" << ents_to_process << std::flush;
-    }
+  return rtn;
+}
 
-    auto hepev = nvconv::ToGenEvent(nv, gri);
+// Loads what every conversion needs before the first job is forked, so that a
+// job only pays for its own conversion, and then runs each job with its
+// arguments parsed on top of the options given to the daemon.
+int Serve(char const *argv0) {
+  if (files_to_read.size() || file_to_write.size() || checkpoint_file.size()) {
+    std::cout << "[ERROR]: --serve and --spool take the inputs and output of "
+                 "each job from the job, so cannot be given -i, -o or "
+                 "--checkpoint."
+              << std::endl;
+    return 1;
+  }
 
-    hepev->set_event_number(i);
-    NuHepMC::add_attribute(*hepev, "ifile.name", fname);
-    NuHepMC::add_attribute(*hepev, "ifile.entry", fentry++);
+  // loading the NEUT dictionary also starts the ROOT interpreter
+  if (!TClass::GetClass("NeutVect")) {
+    std::cout << "[ERROR]: Failed to load the NeutVect dictionary."
+              << std::endl;
+    return 1;
+  }
 
-    output->write_event(*hepev);
+  try {
+    nvconv::ServeJobs(daemon_options,
+                      [argv0](std::vector<std::string> const &args) {
+                        std::vector<char const *> job_argv = {argv0};
+                        for (auto const &arg : args) {
+                          job_argv.push_back(arg.c_str());
+                        }
+                        metrics.RestartClock();
+                        handleOpts(int(job_argv.size()), job_argv.data());
+                        return Convert();
+                      });
+  } catch (std::exception const &ex) {
+    std::cout << ex.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char const *argv[]) {
+
+  // the rest of the arguments are the job, which is parsed by the daemon
+  for (int opt = 1; opt < argc; ++opt) {
+    if ((std::string(argv[opt]) != "--daemon") || ((opt + 1) >= argc)) {
+      continue;
+    }
+    std::string socket_path = argv[opt + 1];
+    std::vector<std::string> args(argv + 1, argv + opt);
+    args.insert(args.end(), argv + opt + 2, argv + argc);
+    try {
+      return nvconv::SubmitJob(socket_path, args, std::cout);
+    } catch (std::exception const &ex) {
+      std::cout << ex.what() << std::endl;
+      return 1;
+    }
   }
-  std::cout << "\rConverting " << ents_to_process << "/" << ents_to_process
-            << std::endl;
 
-  output->close();
-}
\ No newline at end of file
+  handleOpts(argc, argv);
+
+  if (daemon_options.socket_path.size() || daemon_options.spool_dir.size()) {
+    return Serve(argv[0]);
+  }
+
+  return Convert();
+}
@@ -0,0 +1,265 @@
+#include "nvoutput.h"
+
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+std::vector<std::string> files_to_read;
+bool compare = false;
+long nmaxevents = std::numeric_limits<long>::max();
+long first_event = 0;
+bool verify = false;
+size_t part = 0;
+size_t nparts = 1;
+
+void SayUsage(char const *argv[]) {
+  std::cout << "[USAGE]: " << argv[0] << "\n"
+            << "\t-i <neut.hepmc3> [neut.pb ...] : files to read back\n"
+            << "\t-N <NMax>                      : Read at most <NMax> events "
+               "from each file\n"
+            << "\t-e <N>                         : Start from event <N>, "
+               "using the .idx\n"
+            << "\t                                 event index\n"
+            << "\t--part <k>/<N>                 : Only read the <k>th of <N> "
+               "equal slices\n"
+            << "\t                                 of the events, using the "
+               ".idx event index\n"
+            << "\t--verify                       : Check every event against "
+               "its checksum\n"
+            << "\t                                 in the .idx event index, "
+               "without parsing\n"
+            << "\t-c                             : Check that every file "
+               "holds the same\n"
+            << "\t                                 events as the first, "
+               "which\n"
+            << "\t                                 is held in memory, so use "
+               "with -N."
+            << std::endl;
+}
+
+void handleOpts(int argc, char const *argv[]) {
+  int opt = 1;
+  while (opt < argc) {
+    if (std::string(argv[opt]) == "-?" || std::string(argv[opt]) == "--help") {
+      SayUsage(argv);
+      exit(0);
+    } else if (std::string(argv[opt]) == "-c") {
+      compare = true;
+    } else if (std::string(argv[opt]) == "--verify") {
+      verify = true;
+    } else if ((opt + 1) < argc) {
+      if (std::string(argv[opt]) == "-i") {
+        while (((opt + 1) < argc) && (argv[opt + 1][0] != '-')) {
+          files_to_read.push_back(argv[++opt]);
+        }
+      } else if (std::string(argv[opt]) == "-N") {
+        nmaxevents = std::stol(argv[++opt]);
+      } else if (std::string(argv[opt]) == "-e") {
+        first_event = std::stol(argv[++opt]);
+      } else if (std::string(argv[opt]) == "--part") {
+        std::string arg = argv[++opt];
+        auto slash = arg.find_first_of('/');
+        if (slash == std::string::npos) {
+          std::cout << "[ERROR]: --part expects an argument like k/N."
+                    << std::endl;
+          exit(1);
+        }
+        part = std::stoul(arg.substr(0, slash));
+        nparts = std::stoul(arg.substr(slash + 1));
+        if (!nparts || (part >= nparts)) {
+          std::cout << "[ERROR]: --part " << arg
+                    << " is invalid, expected 0 <= k < N." << std::endl;
+          exit(1);
+        }
+      } else {
+        std::cout << "[ERROR]: Unknown option: " << argv[opt] << std::endl;
+        SayUsage(argv);
+        exit(1);
+      }
+    } else {
+      std::cout << "[ERROR]: Unknown option: " << argv[opt] << std::endl;
+      SayUsage(argv);
+      exit(1);
+    }
+    opt++;
+  }
+}
+
+std::string FormatName(nvconv::EventFileReader const &rdr) {
+  std::string name =
+      (rdr.Format() == nvconv::OutputFormat::Ascii)      ? "ascii"
+      : (rdr.Format() == nvconv::OutputFormat::Protobuf) ? "protobuf"
+                                                         : "other";
+  return rdr.Compressed() ? (name + "+gzip") : name;
+}
+
+// The particles, vertices and attributes of an event, in a form that can be
+// compared between formats. Values are compared as HepMC3 writes them to
+// text, so that floating point values compare equal if they round trip.
+struct EventSummary {
+  int event_number;
+  std::vector<std::string> particles;
+  std::vector<std::string> vertices;
+  std::map<std::pair<std::string, int>, std::string> attributes;
+
+  EventSummary(HepMC3::GenEvent const &evt) : event_number(evt.event_number()) {
+    for (auto const &part : evt.particles()) {
+      std::stringstream ss;
+      ss.precision(16);
+      ss << part->pid() << " " << part->status() << " "
+         << part->momentum().px() << " " << part->momentum().py() << " "
+         << part->momentum().pz() << " " << part->momentum().e() << " "
+         << part->generated_mass();
+      particles.push_back(ss.str());
+    }
+    for (auto const &vtx : evt.vertices()) {
+      std::stringstream ss;
+      ss << vtx->status() << " in:";
+      for (auto const &part : vtx->particles_in()) {
+        ss << " " << part->id();
+      }
+      ss << " out:";
+      for (auto const &part : vtx->particles_out()) {
+        ss << " " << part->id();
+      }
+      vertices.push_back(ss.str());
+    }
+    // includes the per-particle attributes, keyed by particle id
+    for (auto const &[name, attrs] : evt.attributes()) {
+      for (auto const &id_attr : attrs) {
+        attributes[{name, id_attr.first}] =
+            evt.attribute_as_string(name, id_attr.first);
+      }
+    }
+  }
+
+  // Returns a description of the first difference, or an empty string.
+  std::string Difference(EventSummary const &other) const {
+    if (event_number != other.event_number) {
+      return "event number " + std::to_string(event_number) +
+             " != " + std::to_string(other.event_number);
+    }
+    if (particles != other.particles) {
+      return "particles differ";
+    }
+    if (vertices != other.vertices) {
+      return "vertices differ";
+    }
+    if (attributes != other.attributes) {
+      return "attributes differ";
+    }
+    return "";
+  }
+};
+
+int main(int argc, char const *argv[]) {
+
+  handleOpts(argc, argv);
+
+  if (!files_to_read.size()) {
+    std::cout << "[ERROR]: Expected -i argument." << std::endl;
+    return 1;
+  }
+
+  // the summaries of the events in the first file, if comparing
+  std::vector<EventSummary> reference;
+
+  int rtn = 0;
+  for (size_t fi = 0; fi < files_to_read.size(); ++fi) {
+    auto const &ftr = files_to_read[fi];
+    auto start = std::chrono::steady_clock::now();
+
+    nvconv::EventFileReader rdr(ftr);
+
+    if (verify) {
+      auto index = rdr.Index();
+      if (!index) {
+        std::cout << "[ERROR]: " << ftr << " has no event index." << std::endl;
+        return 1;
+      }
+      size_t nbad = 0;
+      for (size_t n = 0; n < index->size(); ++n) {
+        if (!rdr.VerifyEvent(n) && !nbad++) {
+          std::cout << "[ERROR]: Event " << (*index)[n].evtno << " in " << ftr
+                    << " does not match its checksum." << std::endl;
+        }
+      }
+      std::cout << "[INFO]: " << ftr << ": " << (index->size() - nbad) << "/"
+                << index->size() << " events match their checksums."
+                << std::endl;
+      if (nbad) {
+        rtn = 1;
+      }
+      continue;
+    }
+
+    long last_event = std::numeric_limits<long>::max();
+    long begin = first_event;
+    if (nparts > 1) {
+      auto index = rdr.Index();
+      if (!index) {
+        std::cout << "[ERROR]: " << ftr << " has no event index." << std::endl;
+        return 1;
+      }
+      auto range = index->Partition(nparts)[part];
+      begin += range.first;
+      last_event = range.second;
+    }
+    if (begin && !rdr.SeekToEvent(begin)) {
+      std::cout << "[ERROR]: Failed to seek to event " << begin << " in "
+                << ftr << std::endl;
+      return 1;
+    }
+    HepMC3::GenEvent evt;
+    long nevents = 0;
+    long nmismatched = 0;
+    while ((nevents < nmaxevents) && ((begin + nevents) < last_event) &&
+           rdr.ReadEvent(evt)) {
+      if (compare && !fi) {
+        reference.emplace_back(evt);
+      } else if (compare) {
+        std::string diff =
+            (size_t(nevents) < reference.size())
+                ? EventSummary(evt).Difference(reference[nevents])
+                : "not in " + files_to_read.front();
+        if (diff.size() && !nmismatched++) {
+          std::cout << "[ERROR]: Event " << nevents << " in " << ftr
+                    << " does not match " << files_to_read.front() << ": "
+                    << diff << std::endl;
+        }
+      }
+      nevents++;
+    }
+    rdr.Close();
+
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    auto nbytes = std::filesystem::file_size(ftr);
+
+    std::cout << "[INFO]: " << ftr << " (" << FormatName(rdr)
+              << "): " << nevents << " events in " << seconds << " s, "
+              << (nevents / seconds) << " events/s, " << nbytes << " bytes, "
+              << (nevents ? (double(nbytes) / nevents) : 0.0)
+              << " bytes/event." << std::endl;
+
+    if (compare && fi) {
+      if (size_t(nevents) != reference.size()) {
+        std::cout << "[ERROR]: " << ftr << " contains " << nevents
+                  << " events, but " << files_to_read.front() << " contains "
+                  << reference.size() << std::endl;
+        rtn = 1;
+      }
+      if (nmismatched) {
+        std::cout << "[ERROR]: " << nmismatched << " events in " << ftr
+                  << " did not match." << std::endl;
+        rtn = 1;
+      }
+    }
+  }
+
+  return rtn;
+}
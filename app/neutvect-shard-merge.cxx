@@ -0,0 +1,162 @@
+#include "nvoutput.h"
+
+#include "NuHepMC/AttributeUtils.hxx"
+#include "NuHepMC/WriterUtils.hxx"
+
+#include <iostream>
+
+std::vector<std::string> files_to_read;
+std::string file_to_write;
+
+static std::string const FATXAttrName = "NuHepMC.FluxAveragedTotalCrossSection";
+static std::string const NEventsAttrName = "NuHepMC.Exposure.NEvents";
+
+void SayUsage(char const *argv[]) {
+  std::cout << "[USAGE]: " << argv[0] << "\n"
+            << "\t-i <shard0.hepmc3> [shard1.hepmc3 ...] : neutvect-converter "
+               "--shard outputs\n"
+            << "\t                                         to merge, in order\n"
+            << "\t-o <neut.hepmc3>                       : merged file to "
+               "write, .pb\n"
+            << "\t                                         for protobuf, .gz "
+               "to compress"
+            << std::endl;
+}
+
+void handleOpts(int argc, char const *argv[]) {
+  int opt = 1;
+  while (opt < argc) {
+    if (std::string(argv[opt]) == "-?" || std::string(argv[opt]) == "--help") {
+      SayUsage(argv);
+      exit(0);
+    } else if ((opt + 1) < argc) {
+      if (std::string(argv[opt]) == "-i") {
+        while (((opt + 1) < argc) && (argv[opt + 1][0] != '-')) {
+          files_to_read.push_back(argv[++opt]);
+          std::cout << "[INFO]: Merging " << files_to_read.back() << std::endl;
+        }
+      } else if (std::string(argv[opt]) == "-o") {
+        file_to_write = argv[++opt];
+      } else {
+        std::cout << "[ERROR]: Unknown option: " << argv[opt] << std::endl;
+        SayUsage(argv);
+        exit(1);
+      }
+    } else {
+      std::cout << "[ERROR]: Unknown option: " << argv[opt] << std::endl;
+      SayUsage(argv);
+      exit(1);
+    }
+    opt++;
+  }
+}
+
+struct ShardInfo {
+  std::shared_ptr<HepMC3::GenRunInfo> run_info;
+  double fatx;
+  long nevents;
+};
+
+// Reads the run info from a shard, and the number of events in it, either from
+// the G.C.3 exposure attribute or, if that is missing, by counting them.
+ShardInfo ReadShardInfo(std::string const &fname) {
+  nvconv::EventFileReader rdr(fname);
+  if (rdr.Failed()) {
+    throw std::runtime_error("neutvect-shard-merge: [ERROR]: Failed to open " +
+                             fname);
+  }
+
+  HepMC3::GenEvent evt;
+  long nevents = 0;
+  if (rdr.ReadEvent(evt)) {
+    nevents++;
+  }
+
+  auto run_info = rdr.RunInfo();
+  if (!run_info) {
+    throw std::runtime_error(
+        "neutvect-shard-merge: [ERROR]: Failed to read run info from " + fname);
+  }
+
+  auto fatx_attr = run_info->attribute<HepMC3::DoubleAttribute>(FATXAttrName);
+  if (!fatx_attr) {
+    throw std::runtime_error("neutvect-shard-merge: [ERROR]: " + fname +
+                             " has no G.C.2 attribute: " + FATXAttrName);
+  }
+
+  auto nevents_attr = run_info->attribute<HepMC3::IntAttribute>(NEventsAttrName);
+  if (nevents_attr) {
+    nevents = nevents_attr->value();
+  } else {
+    std::cout << "[INFO]: " << fname
+              << " has no G.C.3 exposure, counting events." << std::endl;
+    while (rdr.ReadEvent(evt)) {
+      nevents++;
+    }
+  }
+  rdr.Close();
+
+  return {run_info, fatx_attr->value(), nevents};
+}
+
+int main(int argc, char const *argv[]) {
+
+  handleOpts(argc, argv);
+
+  if (!files_to_read.size() || !file_to_write.length()) {
+    std::cout << "[ERROR]: Expected -i and -o arguments." << std::endl;
+    return 1;
+  }
+
+  std::vector<ShardInfo> shards;
+  for (auto const &ftr : files_to_read) {
+    shards.push_back(ReadShardInfo(ftr));
+    std::cout << "[INFO]: " << ftr << " contains " << shards.back().nevents
+              << " events with FATX = " << shards.back().fatx << " pb/Nucleon"
+              << std::endl;
+  }
+
+  // weight the contribution of each shard to the average by the number of
+  // events in it, as nvconv::GetFluxRateHistPairFromChain does for the files
+  // in a chain.
+  long nevents = 0;
+  double fatx_sum = 0;
+  for (auto const &shard : shards) {
+    nevents += shard.nevents;
+    fatx_sum += shard.fatx * shard.nevents;
+  }
+  double fatx = nevents ? (fatx_sum / nevents) : shards.front().fatx;
+
+  std::cout << "[INFO]: Merged FATX = " << fatx << " pb/Nucleon from "
+            << nevents << " events." << std::endl;
+
+  auto gri = std::make_shared<HepMC3::GenRunInfo>(*shards.front().run_info);
+  NuHepMC::GC2::SetFluxAveragedTotalXSec(gri, fatx);
+  NuHepMC::add_attribute(gri, NEventsAttrName, int(nevents));
+
+  auto output = nvconv::MakeWriter(file_to_write, gri,
+                                  nvconv::GuessOutputFormat(file_to_write),
+                                  nvconv::IsCompressedOutput(file_to_write));
+
+  if (output->failed()) {
+    return 2;
+  }
+
+  int evnum = 0;
+  for (auto const &ftr : files_to_read) {
+    nvconv::EventFileReader rdr(ftr);
+
+    HepMC3::GenEvent evt;
+    while (rdr.ReadEvent(evt)) {
+      evt.set_run_info(gri);
+      evt.set_event_number(evnum++);
+      output->write_event(evt);
+    }
+    rdr.Close();
+  }
+
+  std::cout << "[INFO]: Wrote " << evnum << " events to " << file_to_write
+            << std::endl;
+
+  output->close();
+}
@@ -0,0 +1,342 @@
+#include "nvsynth.h"
+
+#include "nvasciiemitter.h"
+#include "nvasciitools.h"
+#include "nvcolumnar.h"
+#include "nvconv.h"
+#include "nvoutput.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+
+// Every allocation made by the process is counted, so that each stage can
+// report how many allocations it makes per event. The whole set of replaceable
+// allocation functions is replaced, so that no form of new goes uncounted, and
+// every form of delete frees what the matching new returned.
+std::atomic<uint64_t> nallocations{0};
+std::atomic<uint64_t> nallocated_bytes{0};
+
+static void *CountedAlloc(std::size_t size, std::size_t align) noexcept {
+  nallocations.fetch_add(1, std::memory_order_relaxed);
+  nallocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  size = size ? size : 1;
+  if (align <= alignof(std::max_align_t)) {
+    return std::malloc(size);
+  }
+  // aligned_alloc needs a size that is a multiple of the alignment
+  return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+static void *CountedAllocOrThrow(std::size_t size, std::size_t align) {
+  if (void *ptr = CountedAlloc(size, align)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size) { return CountedAllocOrThrow(size, 0); }
+void *operator new[](std::size_t size) { return CountedAllocOrThrow(size, 0); }
+void *operator new(std::size_t size, std::nothrow_t const &) noexcept {
+  return CountedAlloc(size, 0);
+}
+void *operator new[](std::size_t size, std::nothrow_t const &) noexcept {
+  return CountedAlloc(size, 0);
+}
+void *operator new(std::size_t size, std::align_val_t align) {
+  return CountedAllocOrThrow(size, std::size_t(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+  return CountedAllocOrThrow(size, std::size_t(align));
+}
+void *operator new(std::size_t size, std::align_val_t align,
+                   std::nothrow_t const &) noexcept {
+  return CountedAlloc(size, std::size_t(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align,
+                     std::nothrow_t const &) noexcept {
+  return CountedAlloc(size, std::size_t(align));
+}
+
+// malloc and aligned_alloc memory are both released with free
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::nothrow_t const &) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, std::nothrow_t const &) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+void operator delete(void *ptr, std::align_val_t,
+                     std::nothrow_t const &) noexcept {
+  std::free(ptr);
+}
+void operator delete[](void *ptr, std::align_val_t,
+                       std::nothrow_t const &) noexcept {
+  std::free(ptr);
+}
+
+long nevents = 20000;
+// The number of distinct events that are generated up front and cycled
+// through by each stage.
+long const npregenerated = 1000;
+std::string results_file = "neutvect-bench.json";
+std::string work_dir = ".";
+uint64_t seed = 12345;
+int nthreads = 1;
+bool end_to_end = true;
+
+void SayUsage(char const *argv[]) {
+  std::cout << "[USAGE]: " << argv[0] << "\n"
+            << "\t-n <N>           : Time each stage over <N> events, "
+               "default: 20000\n"
+            << "\t-o <results.json> : Where to write the results, default: "
+               "neutvect-bench.json\n"
+            << "\t-d <dir>         : Where to write the synthetic input and "
+               "the outputs,\n"
+            << "\t                   default: the working directory\n"
+            << "\t--seed <S>       : Seed for the synthetic events\n"
+            << "\t-j <N>           : Worker threads for the end-to-end "
+               "conversion and\n"
+            << "\t                   output compression\n"
+            << "\t--no-e2e         : Skip the end-to-end conversion"
+            << std::endl;
+}
+
+void handleOpts(int argc, char const *argv[]) {
+  int opt = 1;
+  while (opt < argc) {
+    if (std::string(argv[opt]) == "-?" || std::string(argv[opt]) == "--help") {
+      SayUsage(argv);
+      exit(0);
+    } else if (std::string(argv[opt]) == "--no-e2e") {
+      end_to_end = false;
+    } else if ((opt + 1) < argc) {
+      if (std::string(argv[opt]) == "-n") {
+        nevents = std::stol(argv[++opt]);
+      } else if (std::string(argv[opt]) == "-o") {
+        results_file = argv[++opt];
+      } else if (std::string(argv[opt]) == "-d") {
+        work_dir = argv[++opt];
+      } else if (std::string(argv[opt]) == "--seed") {
+        seed = std::stoull(argv[++opt]);
+      } else if (std::string(argv[opt]) == "-j") {
+        nthreads = std::stoi(argv[++opt]);
+      } else {
+        std::cout << "[ERROR]: Unknown option: " << argv[opt] << std::endl;
+        SayUsage(argv);
+        exit(1);
+      }
+    } else {
+      std::cout << "[ERROR]: Unknown option: " << argv[opt] << std::endl;
+      SayUsage(argv);
+      exit(1);
+    }
+    opt++;
+  }
+  if ((nevents < 1) || (nthreads < 1)) {
+    std::cout << "[ERROR]: -n and -j expect positive numbers." << std::endl;
+    exit(1);
+  }
+}
+
+struct StageResult {
+  std::string name;
+  long nevents;
+  double seconds;
+  uint64_t nallocations;
+  uint64_t nbytes;
+
+  double EventsPerSecond() const { return nevents / seconds; }
+  double AllocationsPerEvent() const { return double(nallocations) / nevents; }
+  double BytesPerEvent() const { return double(nbytes) / nevents; }
+};
+
+std::vector<StageResult> results;
+
+// Times stage(i) for i in [0, n), reporting rates per nreported events if
+// given, rather than per call.
+void RunStage(std::string const &name, long n,
+              std::function<void(long)> const &stage, long nreported = 0) {
+  uint64_t allocs_before = nallocations.load();
+  uint64_t bytes_before = nallocated_bytes.load();
+  auto start = std::chrono::steady_clock::now();
+
+  for (long i = 0; i < n; ++i) {
+    stage(i);
+  }
+
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+  results.push_back(StageResult{name, nreported ? nreported : n, seconds,
+                                nallocations.load() - allocs_before,
+                                nallocated_bytes.load() - bytes_before});
+
+  auto const &res = results.back();
+  std::printf("[INFO]: %-34s %12.0f events/s %10.1f allocs/event %12.0f "
+              "bytes/event\n",
+              name.c_str(), res.EventsPerSecond(), res.AllocationsPerEvent(),
+              res.BytesPerEvent());
+  std::fflush(stdout);
+}
+
+bool WriteResults(std::string const &filename) {
+  std::ofstream fout(filename);
+  fout << "{\n  \"nevents\": " << nevents << ",\n  \"seed\": " << seed
+       << ",\n  \"threads\": " << nthreads << ",\n  \"stages\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto const &res = results[i];
+    fout << "    {\"name\": \"" << res.name << "\", \"nevents\": "
+         << res.nevents << ", \"seconds\": " << res.seconds
+         << ", \"events_per_second\": " << res.EventsPerSecond()
+         << ", \"allocations_per_event\": " << res.AllocationsPerEvent()
+         << ", \"bytes_allocated_per_event\": " << res.BytesPerEvent() << "}"
+         << ((i + 1) < results.size() ? "," : "") << "\n";
+  }
+  fout << "  ]\n}\n";
+  return fout.good();
+}
+
+int main(int argc, char const *argv[]) {
+
+  handleOpts(argc, argv);
+
+  nvbench::SynthConfig config;
+  config.seed = seed;
+  nvbench::NeutVectSynthesizer synth(config);
+
+  std::vector<std::unique_ptr<NeutVect>> events;
+  for (long i = 0; i < npregenerated; ++i) {
+    events.push_back(std::make_unique<NeutVect>());
+    synth.Generate(events.back().get());
+  }
+  auto event = [&](long i) { return events[i % npregenerated].get(); };
+
+  std::unique_ptr<TH1> flux_histo = synth.FluxHist();
+  bool isMonoE = false;
+  std::shared_ptr<HepMC3::GenRunInfo> gri;
+
+  RunStage("BuildRunInfo", 100, [&](long) {
+    std::unique_ptr<TH1> flux = synth.FluxHist();
+    gri = nvconv::BuildRunInfo(nevents, 1, flux, isMonoE, 14, 1E3);
+  });
+
+  nvconv::NEUTPassthrough passthrough;
+  passthrough.AddToRunInfo(event(0), gri);
+
+  RunStage("ToGenEvent", nevents,
+           [&](long i) { nvconv::ToGenEvent(event(i), gri, passthrough); });
+
+  HepMC3::GenEvent hepev;
+  RunStage("ToGenEvent (reused event)", nevents, [&](long i) {
+    nvconv::ToGenEvent(event(i), gri, hepev, passthrough);
+  });
+
+  // the converted events, for the output stages
+  std::vector<std::shared_ptr<HepMC3::GenEvent>> converted;
+  for (long i = 0; i < npregenerated; ++i) {
+    converted.push_back(nvconv::ToGenEvent(event(i), gri, passthrough));
+    converted.back()->set_event_number(int(i));
+  }
+
+  nvconv::AsciiEventFormatter formatter(gri);
+  std::string text;
+  RunStage("AsciiEventFormatter::Format", nevents, [&](long i) {
+    formatter.Format(*converted[i % npregenerated], text);
+  });
+
+  nvconv::AsciiEventEmitter emitter(gri, passthrough);
+  RunStage("AsciiEventEmitter::Emit", nevents, [&](long i) {
+    text.clear();
+    emitter.Emit(event(i), int(i), text);
+  });
+
+  nvconv::FlatEvent flat;
+  RunStage("FlatEvent::Set", nevents,
+           [&](long i) { flat.Set(event(i), i, 0, i); });
+
+  // the output stages write pre-formatted text or pre-converted events, so
+  // only time the writing
+  std::vector<std::string> texts(npregenerated);
+  for (long i = 0; i < npregenerated; ++i) {
+    formatter.Format(*converted[i], texts[i]);
+  }
+
+  for (bool compress : {false, true}) {
+    std::string filename =
+        work_dir + "/neutvect-bench.hepmc3" + (compress ? ".gz" : "");
+    nvconv::AsciiFileWriter writer(filename, gri, compress,
+                                   compress ? nthreads : 0);
+    RunStage(compress ? "AsciiFileWriter (gzip)" : "AsciiFileWriter", nevents,
+             [&](long i) { writer.WriteEventText(texts[i % npregenerated]); });
+    writer.Close();
+    std::filesystem::remove(filename);
+    std::filesystem::remove(filename + ".gzi");
+  }
+
+  std::string pb_filename = work_dir + "/neutvect-bench.pb";
+  try {
+    auto writer = nvconv::MakeWriter(pb_filename, gri,
+                                     nvconv::OutputFormat::Protobuf, false);
+    RunStage("Protobuf writer", nevents, [&](long i) {
+      writer->write_event(*converted[i % npregenerated]);
+    });
+    writer->close();
+    std::filesystem::remove(pb_filename);
+  } catch (std::exception const &ex) {
+    std::cout << "[WARN]: Skipping the protobuf writer: " << ex.what()
+              << std::endl;
+  }
+
+#ifdef NEUTVECT_CONVERTER
+  if (end_to_end) {
+    std::string input = work_dir + "/neutvect-bench.root";
+    std::string output = work_dir + "/neutvect-bench-e2e.hepmc3";
+    std::cout << "[INFO]: Writing " << nevents << " synthetic events to "
+              << input << std::endl;
+    nvbench::WriteSyntheticFile(input, nevents, synth);
+
+    std::string cmd = std::string(NEUTVECT_CONVERTER) + " -i " + input +
+                      " -o " + output + " -j " + std::to_string(nthreads) +
+                      " > " + work_dir + "/neutvect-bench-e2e.log";
+    std::cout << "[INFO]: Running " << cmd << std::endl;
+    int status = 0;
+    RunStage(
+        "neutvect-converter end-to-end", 1,
+        [&](long) { status = std::system(cmd.c_str()); }, nevents);
+    if (status) {
+      std::cout << "[ERROR]: neutvect-converter failed, see "
+                << work_dir << "/neutvect-bench-e2e.log" << std::endl;
+      results.pop_back();
+    }
+    std::filesystem::remove(output);
+    std::filesystem::remove(output + ".idx");
+  }
+#endif
+
+  if (!WriteResults(results_file)) {
+    std::cout << "[ERROR]: Failed to write " << results_file << std::endl;
+    return 1;
+  }
+  std::cout << "[INFO]: Wrote results to " << results_file << std::endl;
+}
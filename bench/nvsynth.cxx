@@ -0,0 +1,363 @@
+#include "nvsynth.h"
+
+#include "nvconv.h"
+
+#include "TFile.h"
+#include "TH1D.h"
+#include "TTree.h"
+
+#include <cmath>
+
+namespace nvbench {
+
+namespace {
+
+double const ProtonMass = 938.272;
+double const NeutronMass = 939.565;
+double const MuonMass = 105.658;
+double const ChargedPionMass = 139.570;
+double const NeutralPionMass = 134.977;
+double const EtaMass = 547.862;
+double const KaonMass = 493.677;
+
+// The flux binning, in GeV
+int const NEnergyBins = 100;
+double const MaxEnergy = 10;
+
+// A numu-like spectrum peaked at 0.6 GeV
+double FluxShape(double E) { return E * E * std::exp(-E / 0.3); }
+
+// A total cross section per nucleon, in 1E-38 cm^2, that rises and saturates
+// like the sum of the NEUT channels.
+double TotalXSec(double E) { return 0.8 * E * (1 - std::exp(-E / 0.5)) + 0.5; }
+
+// Relative rates of each NEUT mode, by |mode|
+double ModeWeight(int mode) {
+  switch (std::abs(mode)) {
+  case 1: {
+    return 40;
+  }
+  case 2: {
+    return 10;
+  }
+  case 11:
+  case 12:
+  case 13: {
+    return 6;
+  }
+  case 26: {
+    return 5;
+  }
+  case 51:
+  case 52: {
+    return 4;
+  }
+  case 21:
+  case 46: {
+    return 2;
+  }
+  case 31:
+  case 32:
+  case 33:
+  case 34:
+  case 41: {
+    return 1.5;
+  }
+  case 16:
+  case 36: {
+    return 1;
+  }
+  default: { // eta, kaon, gamma and diffractive
+    return 0.2;
+  }
+  }
+}
+
+int PionPID(int charge) { return (charge > 0) ? 211 : (charge < 0) ? -211 : 111; }
+
+double MassOf(int pid) {
+  switch (std::abs(pid)) {
+  case 2212: {
+    return ProtonMass;
+  }
+  case 2112: {
+    return NeutronMass;
+  }
+  case 13: {
+    return MuonMass;
+  }
+  case 211: {
+    return ChargedPionMass;
+  }
+  case 111: {
+    return NeutralPionMass;
+  }
+  case 221: {
+    return EtaMass;
+  }
+  case 321: {
+    return KaonMass;
+  }
+  default: {
+    return 0;
+  }
+  }
+}
+
+NeutPart MakePart(int pid, int status, bool alive) {
+  NeutPart part;
+  part.fPID = pid;
+  part.fMass = MassOf(pid);
+  part.fStatus = status;
+  part.fIsAlive = alive;
+  part.fP.SetXYZT(0, 0, 0, part.fMass);
+  return part;
+}
+
+} // namespace
+
+NeutVectSynthesizer::NeutVectSynthesizer(SynthConfig const &config)
+    : config(config), rng(config.seed), evtno(0) {
+
+  std::vector<double> weights;
+  for (auto const &mode_channel : nvconv::ChannelNameIndexModeMapping) {
+    int mode = mode_channel.first;
+    modes.push_back(mode);
+    weights.push_back(ModeWeight(mode) * ((mode > 0) ? (1 - config.nubar_fraction)
+                                                     : config.nubar_fraction));
+  }
+  mode_dist = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+
+  auto rate = RateHist();
+  std::vector<double> rates;
+  for (int bi = 0; bi < NEnergyBins; ++bi) {
+    rates.push_back(rate->GetBinContent(bi + 1));
+  }
+  energy_bin_dist = std::discrete_distribution<int>(rates.begin(), rates.end());
+}
+
+std::unique_ptr<TH1> NeutVectSynthesizer::FluxHist() const {
+  auto flux = std::make_unique<TH1D>("fluxhisto", ";E_{#nu} (GeV);Flux",
+                                     NEnergyBins, 0, MaxEnergy);
+  flux->SetDirectory(nullptr);
+  for (int bi = 0; bi < NEnergyBins; ++bi) {
+    flux->SetBinContent(bi + 1, FluxShape(flux->GetXaxis()->GetBinCenter(bi + 1)));
+  }
+  return flux;
+}
+
+std::unique_ptr<TH1> NeutVectSynthesizer::RateHist() const {
+  auto rate = FluxHist();
+  rate->SetName("ratehisto");
+  for (int bi = 0; bi < NEnergyBins; ++bi) {
+    rate->SetBinContent(bi + 1,
+                        rate->GetBinContent(bi + 1) *
+                            TotalXSec(rate->GetXaxis()->GetBinCenter(bi + 1)));
+  }
+  return rate;
+}
+
+double NeutVectSynthesizer::SampleEnergy() {
+  double bin_width = MaxEnergy / NEnergyBins;
+  return (energy_bin_dist(rng) +
+          std::uniform_real_distribution<double>(0, 1)(rng)) *
+         bin_width;
+}
+
+double NeutVectSynthesizer::SampleMomentum(double mean) {
+  return std::exponential_distribution<double>(1 / mean)(rng);
+}
+
+void NeutVectSynthesizer::SetIsotropic(NeutPart &part, double p) {
+  double cost = std::uniform_real_distribution<double>(-1, 1)(rng);
+  double phi = std::uniform_real_distribution<double>(0, 2 * M_PI)(rng);
+  double sint = std::sqrt(1 - cost * cost);
+  part.fP.SetXYZM(p * sint * std::cos(phi), p * sint * std::sin(phi), p * cost,
+                  part.fMass);
+}
+
+void NeutVectSynthesizer::Generate(NeutVect *nv) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+
+  int mode = modes[mode_dist(rng)];
+  int amode = std::abs(mode);
+  bool nubar = mode < 0;
+  bool cc = amode < 30;
+  bool coherent = (amode == 16) || (amode == 36);
+  bool diffractive = (amode == 15) || (amode == 35);
+
+  // interactions on the free protons of the target molecule
+  double free_fraction =
+      double(config.target_H) / (config.target_A + config.target_H);
+  bool bound = coherent || diffractive || (amode == 2) ||
+               (uniform(rng) >= free_fraction);
+
+  double E = SampleEnergy();
+
+  parts.clear();
+
+  // beam
+  int beam_pid = nubar ? -14 : 14;
+  parts.push_back(MakePart(beam_pid, -1, false));
+  parts.back().fP.SetXYZM(0, 0, E * 1E3, 0);
+
+  // target
+  int nucleus_pid =
+      1000000000 + config.target_Z * 10000 + config.target_A * 10;
+  int struck_pid = coherent                        ? nucleus_pid
+                   : (!bound || (uniform(rng) < 0.5)) ? 2212
+                                                       : 2112;
+  parts.push_back(MakePart(struck_pid, -1, false));
+  if (bound && !coherent) {
+    SetIsotropic(parts.back(), 220 * std::cbrt(uniform(rng)));
+  }
+
+  // lepton
+  int lepton_pid = cc ? (nubar ? -13 : 13) : beam_pid;
+  parts.push_back(MakePart(lepton_pid, 0, true));
+  {
+    double p = E * 1E3 * std::uniform_real_distribution<double>(0.3, 0.9)(rng);
+    double cost = std::uniform_real_distribution<double>(0.5, 1)(rng);
+    double sint = std::sqrt(1 - cost * cost);
+    parts.back().fP.SetXYZM(p * sint, 0, p * cost, parts.back().fMass);
+  }
+
+  // primary hadrons
+  std::vector<int> hadrons;
+  auto nucleon = [&]() { return (uniform(rng) < 0.5) ? 2212 : 2112; };
+  auto pion = [&]() { return PionPID(int(uniform(rng) * 3) - 1); };
+  switch (amode) {
+  case 1:
+  case 51:
+  case 52: {
+    hadrons = {nucleon()};
+    break;
+  }
+  case 2: {
+    hadrons = {nucleon(), nucleon()};
+    break;
+  }
+  case 11:
+  case 12:
+  case 13:
+  case 31:
+  case 32:
+  case 33:
+  case 34: {
+    hadrons = {nucleon(), pion()};
+    break;
+  }
+  case 21:
+  case 26:
+  case 41:
+  case 46: {
+    hadrons = {nucleon()};
+    int npi = 1 + std::poisson_distribution<int>((amode % 10 == 6) ? 3 : 1)(rng);
+    for (int i = 0; i < npi; ++i) {
+      hadrons.push_back(pion());
+    }
+    break;
+  }
+  case 16:
+  case 36: {
+    hadrons = {cc ? (nubar ? -211 : 211) : 111};
+    break;
+  }
+  case 15:
+  case 35: {
+    hadrons = {2212, cc ? (nubar ? -211 : 211) : 111};
+    break;
+  }
+  case 22:
+  case 42:
+  case 43: {
+    hadrons = {nucleon(), 221};
+    break;
+  }
+  case 23:
+  case 44:
+  case 45: {
+    hadrons = {nucleon(), 321};
+    break;
+  }
+  default: { // single gamma
+    hadrons = {nucleon(), 22};
+    break;
+  }
+  }
+
+  // hadrons that interact in the nucleus are replaced by what comes out of
+  // the cascade, listed after the primary particles
+  std::vector<int> fsi_products;
+  for (int pid : hadrons) {
+    bool rescatters =
+        bound && !coherent && !diffractive && (pid != 22) && (uniform(rng) < 0.4);
+    parts.push_back(MakePart(pid, rescatters ? 3 : 0, !rescatters));
+    SetIsotropic(parts.back(), SampleMomentum(350));
+    if (rescatters) {
+      // absorbed, charge exchanged or knocked out extra nucleons
+      int nout = std::uniform_int_distribution<int>(0, 3)(rng);
+      for (int i = 0; i < nout; ++i) {
+        fsi_products.push_back((i || (std::abs(pid) == 2212) ||
+                                (std::abs(pid) == 2112))
+                                   ? nucleon()
+                                   : pion());
+      }
+    }
+  }
+  int nprimary = int(parts.size());
+
+  for (int pid : fsi_products) {
+    parts.push_back(MakePart(pid, 0, true));
+    SetIsotropic(parts.back(), SampleMomentum(250));
+  }
+
+  nv->SetNpart(int(parts.size()));
+  nv->SetNprimary(nprimary);
+  for (size_t i = 0; i < parts.size(); ++i) {
+    nv->SetPartInfo(int(i), parts[i]);
+  }
+
+  nv->EventNo = int(evtno++);
+  nv->Mode = mode;
+  nv->Totcrs = TotalXSec(E);
+  nv->TargetA = config.target_A;
+  nv->TargetZ = config.target_Z;
+  nv->TargetH = config.target_H;
+  nv->Ibound = (bound && !coherent && !diffractive) ? 1 : 0;
+  nv->VNuclIni = -27;
+  nv->VNuclFin = -27;
+  nv->PFSurf = 217;
+  nv->PFMax = 217;
+  nv->QEModel = 2;
+  nv->QEVForm = 1;
+  nv->RADcorr = 0;
+  nv->SPIModel = 1;
+  nv->COHModel = 1;
+  nv->DISModel = 0;
+}
+
+void WriteSyntheticFile(std::string const &filename, long nevents,
+                        NeutVectSynthesizer &synth) {
+  TFile fout(filename.c_str(), "RECREATE");
+
+  // owned by fout
+  auto tree = new TTree("neuttree", "synthetic neutvect events");
+  tree->SetDirectory(&fout);
+
+  auto nv = std::make_unique<NeutVect>();
+  NeutVect *nv_ptr = nv.get();
+  tree->Branch("vectorbranch", &nv_ptr);
+
+  for (long i = 0; i < nevents; ++i) {
+    synth.Generate(nv_ptr);
+    tree->Fill();
+  }
+
+  fout.WriteTObject(synth.FluxHist().get(), "fluxhisto");
+  fout.WriteTObject(synth.RateHist().get(), "ratehisto");
+  tree->Write();
+  fout.Close();
+}
+
+} // namespace nvbench
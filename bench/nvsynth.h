@@ -0,0 +1,64 @@
+#pragma once
+
+#include "neutvect.h"
+
+#include "TH1.h"
+
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nvbench {
+
+struct SynthConfig {
+  uint64_t seed = 12345;
+  // The target molecule, CH by default, so that some events are on free
+  // protons.
+  int target_A = 12;
+  int target_Z = 6;
+  int target_H = 1;
+  // The fraction of events generated with antineutrino modes
+  double nubar_fraction = 0.2;
+};
+
+// Builds NeutVects that look like NEUT output for a numu/numubar beam: every
+// mode in nvconv::ChannelNameIndexModeMapping, in roughly the proportions NEUT
+// produces them at a few hundred MeV to a few GeV, with realistic numbers of
+// primary and FSI particles, on bound nucleons and on the free protons of the
+// target molecule. Kinematics are plausible rather than physical.
+class NeutVectSynthesizer {
+public:
+  NeutVectSynthesizer(SynthConfig const &config = SynthConfig());
+
+  // Fills nv with the next event.
+  void Generate(NeutVect *nv);
+
+  // The flux, in GeV, and event rate histograms that NEUT writes alongside
+  // the events, consistent with the energies and Totcrs of the events.
+  std::unique_ptr<TH1> FluxHist() const;
+  std::unique_ptr<TH1> RateHist() const;
+
+private:
+  double SampleEnergy();
+  double SampleMomentum(double mean);
+  // An isotropic momentum with magnitude p
+  void SetIsotropic(NeutPart &part, double p);
+
+  SynthConfig config;
+  std::mt19937_64 rng;
+  std::vector<int> modes;
+  std::discrete_distribution<size_t> mode_dist;
+  std::discrete_distribution<int> energy_bin_dist;
+  std::vector<NeutPart> parts;
+  long evtno;
+};
+
+// Writes nevents generated by synth to filename, laid out like a NEUT output
+// file: the neuttree tree with a NeutVect in vectorbranch, and the fluxhisto
+// and ratehisto histograms.
+void WriteSyntheticFile(std::string const &filename, long nevents,
+                        NeutVectSynthesizer &synth);
+
+} // namespace nvbench
@@ -0,0 +1,389 @@
+#include "nvasciiemitter.h"
+
+#include "nvasciitools.h"
+
+#include "NuHepMC/WriterUtils.hxx"
+
+#include "HepMC3/GenParticle.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+namespace nvconv {
+
+namespace {
+
+enum VertexIndex { kIAVertex = 0, kPrimVertex, kFSIVertex, kNVertices };
+
+std::vector<std::pair<std::string, std::string>>
+GetAttributes(HepMC3::GenEvent const &evt, int id) {
+  std::vector<std::pair<std::string, std::string>> attrs;
+  for (auto const &name : evt.attribute_names(id)) {
+    attrs.emplace_back(name, evt.attribute_as_string(name, id));
+  }
+  return attrs;
+}
+
+// As HepMC3::WriterAscii::escape
+void AppendEscaped(std::string_view str, std::string &out) {
+  for (char c : str) {
+    switch (c) {
+    case '\\': {
+      out += "\\\\";
+      break;
+    }
+    case '\n': {
+      out += "\\|";
+      break;
+    }
+    default: {
+      out += c;
+    }
+    }
+  }
+}
+
+} // namespace
+
+AsciiEventEmitter::AsciiEventEmitter(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                                     NEUTPassthrough const &passthrough,
+                                     EventValidator *validator)
+    : gri(gri), passthrough(passthrough), validator(validator),
+      scratch(gri, HepMC3::Units::MEV, HepMC3::Units::CM),
+      total_xs_event(gri, HepMC3::Units::MEV, HepMC3::Units::CM),
+      vertices(kNVertices) {
+
+  vertices[kIAVertex].status = NuHepMC::VertexStatus::NucleonSeparation;
+  vertices[kPrimVertex].status = NuHepMC::VertexStatus::Primary;
+  vertices[kFSIVertex].status = NuHepMC::VertexStatus::FSISummary;
+
+  // Every event has the same units and a single CV weight of 1, so take the
+  // lines that follow the E line from an empty event formatted by HepMC3.
+  HepMC3::GenEvent empty(gri, HepMC3::Units::MEV, HepMC3::Units::CM);
+  empty.weight("CV") = 1;
+  std::string empty_text;
+  AsciiEventFormatter(gri).Format(empty, empty_text);
+  event_preamble = empty_text.substr(empty_text.find('\n') + 1);
+
+  NuHepMC::EC2::SetTotalCrossSection(total_xs_event, 0);
+  total_xs_names = total_xs_event.attribute_names();
+  total_xs_values.resize(total_xs_names.size());
+
+  HepMC3::GenEvent lab_position_event(gri, HepMC3::Units::MEV,
+                                      HepMC3::Units::CM);
+  NuHepMC::ER5::SetLabPosition(lab_position_event,
+                               std::vector<double>{0, 0, 0, 0});
+  lab_position_attributes = GetAttributes(lab_position_event, 0);
+}
+
+int AsciiEventEmitter::AddParticle(double px, double py, double pz, double e,
+                                   double m, int pid, int status) {
+  particles.push_back(Particle{px, py, pz, e, m, pid, status, -1, 0});
+  return int(particles.size()) - 1;
+}
+
+void AsciiEventEmitter::AddParticleOut(int vertex, int particle) {
+  vertices[vertex].out.push_back(particle);
+  particles[particle].production_vertex = vertex;
+}
+
+void AsciiEventEmitter::WriteVertex(int vertex, std::string &out) {
+  vertex_in_ids.clear();
+  for (int p : vertices[vertex].in) {
+    vertex_in_ids.push_back(particles[p].id);
+  }
+  std::sort(vertex_in_ids.begin(), vertex_in_ids.end());
+
+  char buf[64];
+  out.append(buf, std::snprintf(buf, sizeof(buf), "V %d %d [",
+                                vertices[vertex].id, vertices[vertex].status));
+  for (size_t i = 0; i < vertex_in_ids.size(); ++i) {
+    if (i) {
+      out += ',';
+    }
+    out += std::to_string(vertex_in_ids[i]);
+  }
+  out += "]\n";
+  vertex_written[vertex] = true;
+}
+
+void AsciiEventEmitter::Emit(NeutVect *nv, int evtno, std::string &out) {
+
+  particles.clear();
+  for (auto &v : vertices) {
+    v.in.clear();
+    v.out.clear();
+    v.id = 0;
+  }
+  neut_particle_ids.clear();
+
+  bool isbound = IsBoundTarget(nv);
+
+  int nuclear_PDG = 1000000000 + nv->TargetZ * 10000 + nv->TargetA * 10;
+  int nuclear_remnant_PDG = nuclear_PDG;
+  int nuclear_remnant_internal = -1;
+  if (isbound) {
+    int target_nucleus = AddParticle(0, 0, 0, 0, 0, nuclear_PDG,
+                                     NuHepMC::ParticleStatus::Target);
+    nuclear_remnant_internal =
+        AddParticle(0, 0, 0, 0, 0, NuHepMC::ParticleNumber::NuclearRemnant,
+                    NuHepMC::ParticleStatus::DocumentationLine);
+    int nuclear_remnant_external =
+        AddParticle(0, 0, 0, 0, 0, NuHepMC::ParticleNumber::NuclearRemnant,
+                    NuHepMC::ParticleStatus::UndecayedPhysical);
+
+    vertices[kIAVertex].in.push_back(target_nucleus);
+    AddParticleOut(kIAVertex, nuclear_remnant_internal);
+    vertices[kFSIVertex].in.push_back(nuclear_remnant_internal);
+    AddParticleOut(kFSIVertex, nuclear_remnant_external);
+  }
+
+  neut_particles.Fill(nv);
+  int npart = neut_particles.npart;
+  int nprimary = neut_particles.nprimary;
+
+  for (int p_it = 0; p_it < npart; ++p_it) {
+    bool isprim = p_it < nprimary;
+
+    int NuHepPartStatus = neut_particles.status[p_it];
+    if (!NuHepPartStatus) {
+      // let ToGenEvent report the particle that could not be converted
+      HepMC3::GenEvent evt;
+      ToGenEvent(nv, gri, evt, passthrough);
+    }
+
+    int part = AddParticle(neut_particles.px[p_it], neut_particles.py[p_it],
+                           neut_particles.pz[p_it], neut_particles.e[p_it],
+                           neut_particles.m[p_it], neut_particles.pid[p_it],
+                           NuHepPartStatus);
+    neut_particle_ids.push_back(part);
+
+    switch (neut_particles.role[p_it]) {
+    case ParticleRole::Beam: {
+      vertices[kPrimVertex].in.push_back(part);
+      break;
+    }
+    case ParticleRole::StruckNucleon: {
+      if (isbound) {
+        AddParticleOut(kIAVertex, part);
+
+        if (particles[part].pid == 2212) {
+          nuclear_remnant_PDG -= (1 * 10000 + 1 * 10);
+        } else {
+          nuclear_remnant_PDG -= (0 * 10000 + 1 * 10);
+        }
+      } else { // use stuck nucleon as target for unbound interactions
+        particles[part].status = NuHepMC::ParticleStatus::Target;
+        particles[part].pid =
+            (particles[part].pid == 2212) ? 1000010010 : 1000000010;
+      }
+      vertices[kPrimVertex].in.push_back(part);
+      break;
+    }
+    case ParticleRole::FinalState: {
+      if (isprim) {
+        Particle const copy = particles[part];
+        int part_copy = AddParticle(copy.px, copy.py, copy.pz, copy.e, copy.m,
+                                    copy.pid, copy.status);
+        if (isbound) {
+          particles[part_copy].status =
+              NuHepMC::ParticleStatus::DocumentationLine;
+        }
+        AddParticleOut(kPrimVertex, part_copy);
+        if (isbound) {
+          vertices[kFSIVertex].in.push_back(part_copy);
+        }
+      }
+      if (isbound) {
+        AddParticleOut(kFSIVertex, part);
+      }
+      break;
+    }
+    case ParticleRole::Intermediate: {
+      AddParticleOut(kPrimVertex, part);
+      vertices[kFSIVertex].in.push_back(part);
+      break;
+    }
+    default: {
+      std::stringstream ss;
+      ss << "[ERROR]: Failed to find vertex for particle: " << (p_it + 1);
+      std::cout << ss.str() << std::endl;
+      throw ss.str();
+    }
+    }
+  }
+
+  // Number the vertices and particles as HepMC3::GenEvent::add_vertex would
+  vertices_in_event.clear();
+  if (isbound) {
+    vertices_in_event.push_back(kIAVertex);
+  }
+  vertices_in_event.push_back(kPrimVertex);
+  if (isbound) {
+    vertices_in_event.push_back(kFSIVertex);
+  }
+
+  particle_order.clear();
+  for (size_t vi = 0; vi < vertices_in_event.size(); ++vi) {
+    auto &v = vertices[vertices_in_event[vi]];
+    v.id = -int(vi + 1);
+    for (auto const *list : {&v.in, &v.out}) {
+      for (int p : *list) {
+        if (!particles[p].id) {
+          particle_order.push_back(p);
+          particles[p].id = int(particle_order.size());
+        }
+      }
+    }
+  }
+
+  if (validator && validator->ShouldValidate()) {
+    ParticleCounts counts;
+    for (int p : particle_order) {
+      switch (particles[p].status) {
+      case NuHepMC::ParticleStatus::IncomingBeam: {
+        counts.beam++;
+        break;
+      }
+      case NuHepMC::ParticleStatus::Target: {
+        counts.target++;
+        break;
+      }
+      case NuHepMC::ParticleStatus::UndecayedPhysical: {
+        counts.final_state++;
+        break;
+      }
+      }
+    }
+    if (!validator->Record(counts) && validator->ShouldReport()) {
+      HepMC3::GenEvent evt;
+      ToGenEvent(nv, gri, evt, passthrough);
+      ReportInvalidEvent(evt, nv, counts);
+    }
+  }
+
+  attributes.clear();
+
+  event_values.clear();
+
+  passthrough.Visit(
+      nv, [&](int i) { return particles[neut_particle_ids[i]].id; },
+      [&](char const *name, auto const &value) {
+        attributes.push_back({name, 0, FormatCachedAttribute(name, value)});
+      });
+
+  // E.C.4
+  static double const cm2_to_pb = 1E36;
+
+  // E.C.2
+  NuHepMC::EC2::SetTotalCrossSection(total_xs_event,
+                                     nv->Totcrs * 1E-38 * cm2_to_pb);
+  for (size_t i = 0; i < total_xs_names.size(); ++i) {
+    total_xs_values[i] = total_xs_event.attribute_as_string(total_xs_names[i]);
+    attributes.push_back({total_xs_names[i], 0, total_xs_values[i]});
+  }
+
+  // E.R.5
+  for (auto const &attr : lab_position_attributes) {
+    attributes.push_back({attr.first, 0, attr.second});
+  }
+
+  // E.R.3
+  auto process_id = process_id_attributes.find(nv->Mode);
+  if (process_id == process_id_attributes.end()) {
+    HepMC3::GenEvent evt(gri, HepMC3::Units::MEV, HepMC3::Units::CM);
+    NuHepMC::ER3::SetProcessID(evt, GetEC1Channel(nv->Mode));
+    process_id =
+        process_id_attributes.emplace(nv->Mode, GetAttributes(evt, 0)).first;
+  }
+  for (auto const &attr : process_id->second) {
+    attributes.push_back({attr.first, 0, attr.second});
+  }
+
+  // P.C.2
+  if (isbound) {
+    int Z = (nuclear_remnant_PDG / 10000) % 1000;
+    int A = (nuclear_remnant_PDG / 10) % 1000;
+    auto remnant = remnant_info.find(Z * 1000 + A);
+    if (remnant == remnant_info.end()) {
+      HepMC3::GenEvent evt(gri, HepMC3::Units::MEV, HepMC3::Units::CM);
+      auto remnant_part = std::make_shared<HepMC3::GenParticle>(
+          HepMC3::FourVector{0, 0, 0, 0},
+          NuHepMC::ParticleNumber::NuclearRemnant,
+          NuHepMC::ParticleStatus::DocumentationLine);
+      evt.add_particle(remnant_part);
+      NuHepMC::PC2::SetRemnantNucleusParticleNumber(remnant_part, Z, A);
+      RemnantInfo info{remnant_part->pid(), remnant_part->status(),
+                       GetAttributes(evt, remnant_part->id())};
+      remnant = remnant_info.emplace(Z * 1000 + A, std::move(info)).first;
+    }
+    auto &part = particles[nuclear_remnant_internal];
+    part.pid = remnant->second.pid;
+    part.status = remnant->second.status;
+    for (auto const &attr : remnant->second.attributes) {
+      attributes.push_back({attr.first, part.id, attr.second});
+    }
+  }
+
+  for (auto const &attr : extra_attributes) {
+    attributes.push_back({attr.first, 0, attr.second});
+  }
+
+  // HepMC3 keeps attributes ordered by name and then by id
+  std::sort(attributes.begin(), attributes.end(),
+            [](Attribute const &a, Attribute const &b) {
+              return (a.name == b.name) ? (a.id < b.id) : (a.name < b.name);
+            });
+
+  char buf[256];
+  out.append(buf, std::snprintf(buf, sizeof(buf), "E %d %zu %zu\n", evtno,
+                                vertices_in_event.size(),
+                                particle_order.size()));
+  out += event_preamble;
+
+  for (auto const &attr : attributes) {
+    out += "A ";
+    out += std::to_string(attr.id);
+    out += ' ';
+    out += attr.name;
+    out += ' ';
+    AppendEscaped(attr.value, out);
+    out += '\n';
+  }
+
+  // As HepMC3::WriterAscii::write_event, a vertex is written just before the
+  // first particle that comes out of it, if it is referred to by its own id.
+  vertex_written.assign(kNVertices, false);
+  for (int p : particle_order) {
+    auto const &part = particles[p];
+    int parent = 0;
+    if (part.production_vertex >= 0) {
+      auto const &v = vertices[part.production_vertex];
+      // none of the vertices have a position, so only the status counts
+      if ((v.in.size() > 1) || v.status) {
+        parent = v.id;
+      } else if (v.in.size() == 1) {
+        parent = particles[v.in.front()].id;
+      }
+      if ((parent < 0) && !vertex_written[part.production_vertex]) {
+        WriteVertex(part.production_vertex, out);
+      }
+    }
+    out.append(buf, std::snprintf(buf, sizeof(buf),
+                                  "P %d %d %d %.16e %.16e %.16e %.16e %.16e "
+                                  "%d\n",
+                                  part.id, parent, part.pid, part.px, part.py,
+                                  part.pz, part.e, part.m, part.status));
+  }
+  for (int v : vertices_in_event) {
+    if (!vertex_written[v]) {
+      WriteVertex(v, out);
+    }
+  }
+
+  extra_attributes.clear();
+}
+
+} // namespace nvconv
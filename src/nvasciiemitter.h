@@ -0,0 +1,174 @@
+#pragma once
+
+#include "nvconv.h"
+#include "nvparticles.h"
+
+#include "NuHepMC/AttributeUtils.hxx"
+
+#include "HepMC3/GenEvent.h"
+#include "HepMC3/GenRunInfo.h"
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace nvconv {
+
+// Writes the HepMC3 ASCII text of a converted NeutVect event straight from the
+// NeutVect, without building the HepMC3::GenEvent graph. Particles, vertices
+// and attributes follow the same logic as ToGenEvent, and the text is
+// byte-identical to formatting the ToGenEvent result with an
+// AsciiEventFormatter, so it can be written with an AsciiFileWriter. If a
+// validator is given, events are validated from the particle statuses, at
+// either ValidationLevel.
+//
+// Attribute values are formatted by the same HepMC3 attribute types that
+// NuHepMC::add_attribute would use, and cached, as most of them repeat from
+// event to event. ToGenEvent's diagnostic printout of events with no beam,
+// target or final state particles is not repeated.
+class AsciiEventEmitter {
+public:
+  AsciiEventEmitter(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                    NEUTPassthrough const &passthrough = NEUTPassthrough(),
+                    EventValidator *validator = nullptr);
+
+  // Adds an event attribute to the next emitted event, with the value that
+  // NuHepMC::add_attribute(evt, name, val) would give it.
+  template <typename T>
+  void AddEventAttribute(std::string const &name, T const &val) {
+    extra_attributes.emplace_back(name, FormatAttribute(name, val));
+  }
+  void AddEventAttribute(std::string const &name, std::string const &val) {
+    extra_attributes.emplace_back(name, val);
+  }
+
+  // Appends the text of nv, as event number evtno, to out.
+  void Emit(NeutVect *nv, int evtno, std::string &out);
+
+private:
+  struct Particle {
+    double px, py, pz, e, m;
+    int pid, status;
+    // index of the vertex that the particle comes out of, or -1
+    int production_vertex;
+    // HepMC3 particle id, or 0 if the particle is not in the event
+    int id;
+  };
+
+  struct Vertex {
+    int status;
+    // HepMC3 vertex id, or 0 if the vertex is not in the event
+    int id;
+    std::vector<int> in, out;
+  };
+
+  struct Attribute {
+    std::string_view name;
+    int id;
+    std::string_view value;
+  };
+
+  struct CacheKey {
+    std::string_view name;
+    uint64_t value;
+
+    bool operator==(CacheKey const &other) const {
+      return (value == other.value) && (name == other.name);
+    }
+  };
+
+  struct CacheKeyHash {
+    size_t operator()(CacheKey const &key) const {
+      return std::hash<std::string_view>()(key.name) ^
+             (std::hash<uint64_t>()(key.value) * 31);
+    }
+  };
+
+  template <typename T> static uint64_t ValueBits(T const &val) {
+    if constexpr (std::is_floating_point_v<T>) {
+      uint64_t bits = 0;
+      std::memcpy(&bits, &val, sizeof(T));
+      return bits;
+    } else {
+      return uint64_t(val);
+    }
+  }
+
+  template <typename T>
+  std::string FormatAttribute(std::string const &name, T const &val) {
+    NuHepMC::add_attribute(scratch, name, val);
+    std::string str = scratch.attribute_as_string(name);
+    scratch.remove_attribute(name);
+    return str;
+  }
+
+  // name must outlive the emitter, as the names of the NEUT passthrough
+  // attributes do.
+  template <typename T>
+  std::string const &FormatCachedAttribute(char const *name, T const &val) {
+    CacheKey key{name, ValueBits(val)};
+    auto cached = attribute_cache.find(key);
+    if (cached != attribute_cache.end()) {
+      return cached->second;
+    }
+    return attribute_cache.emplace(key, FormatAttribute(name, val))
+        .first->second;
+  }
+  // vector values are not cached, but kept until the end of the event
+  std::string const &FormatCachedAttribute(char const *name,
+                                           std::vector<int> const &val) {
+    return event_values.emplace_back(FormatAttribute(name, val));
+  }
+
+  int AddParticle(double px, double py, double pz, double e, double m, int pid,
+                  int status);
+  void AddParticleOut(int vertex, int particle);
+  void WriteVertex(int vertex, std::string &out);
+
+  std::shared_ptr<HepMC3::GenRunInfo> gri;
+  NEUTPassthrough passthrough;
+  EventValidator *validator;
+
+  // The U and W lines, which are the same for every event.
+  std::string event_preamble;
+
+  HepMC3::GenEvent scratch;
+  std::unordered_map<CacheKey, std::string, CacheKeyHash> attribute_cache;
+  std::deque<std::string> event_values;
+
+  // E.C.2, formatted for each event
+  HepMC3::GenEvent total_xs_event;
+  std::vector<std::string> total_xs_names;
+  std::vector<std::string> total_xs_values;
+  // E.R.5, the same for every event
+  std::vector<std::pair<std::string, std::string>> lab_position_attributes;
+  // E.R.3, cached by NEUT mode
+  std::unordered_map<int, std::vector<std::pair<std::string, std::string>>>
+      process_id_attributes;
+  // P.C.2, cached by remnant Z and A, along with the remnant pid and status
+  struct RemnantInfo {
+    int pid, status;
+    std::vector<std::pair<std::string, std::string>> attributes;
+  };
+  std::unordered_map<int, RemnantInfo> remnant_info;
+
+  std::vector<std::pair<std::string, std::string>> extra_attributes;
+
+  NeutParticles neut_particles;
+  std::vector<Particle> particles;
+  std::vector<Vertex> vertices;
+  std::vector<int> vertices_in_event;
+  std::vector<int> particle_order;
+  std::vector<int> neut_particle_ids;
+  std::vector<Attribute> attributes;
+  std::vector<bool> vertex_written;
+  std::vector<int> vertex_in_ids;
+};
+
+} // namespace nvconv
@@ -0,0 +1,122 @@
+#include "nvasciitools.h"
+
+#include "nvgzip.h"
+#include "nvindex.h"
+
+#include "HepMC3/WriterAscii.h"
+
+#include <filesystem>
+#include <stdexcept>
+
+namespace nvconv {
+
+static std::string const AsciiFooter = "HepMC::Asciiv3-END_EVENT_LISTING\n\n";
+
+bool IsAsciiOutput(std::string const &filename) {
+  for (std::string const ext : {".hepmc3", ".hepmc"}) {
+    if ((filename.size() > ext.size()) &&
+        !filename.compare(filename.size() - ext.size(), ext.size(), ext)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+AsciiEventFormatter::AsciiEventFormatter(
+    std::shared_ptr<HepMC3::GenRunInfo> gri)
+    : writer(std::make_unique<HepMC3::WriterAscii>(ss, gri)) {
+  // WriterAscii holds the run info in its buffer until the first event is
+  // written, so write an empty event to push it out and then discard
+  // everything that came before the first real event.
+  HepMC3::GenEvent primer(gri, HepMC3::Units::MEV, HepMC3::Units::CM);
+  writer->write_event(primer);
+  ss.str("");
+}
+
+AsciiEventFormatter::~AsciiEventFormatter() = default;
+
+void AsciiEventFormatter::Format(HepMC3::GenEvent const &evt,
+                                 std::string &out) {
+  writer->write_event(evt);
+  out = ss.str();
+  ss.str("");
+}
+
+AsciiFileWriter::AsciiFileWriter(std::string const &filename,
+                                 std::shared_ptr<HepMC3::GenRunInfo> gri,
+                                 bool compress, int compress_threads)
+    : filename(filename), fout(filename, std::ios::binary), out(fout.rdbuf()),
+      nwritten(0) {
+
+  if (compress) {
+    gzbuf =
+        std::make_unique<GzipBlockOutputBuf>(fout.rdbuf(), compress_threads);
+    out.rdbuf(gzbuf.get());
+  }
+
+  // Let HepMC3 write an empty file to get the exact header it would write.
+  std::stringstream ss;
+  HepMC3::WriterAscii header_writer(ss, gri);
+  header_writer.close();
+
+  std::string header = ss.str();
+  if ((header.size() < AsciiFooter.size()) ||
+      header.compare(header.size() - AsciiFooter.size(), AsciiFooter.size(),
+                     AsciiFooter)) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Unexpected HepMC3 ASCII footer.");
+  }
+  header.resize(header.size() - AsciiFooter.size());
+
+  out << header;
+  nwritten = header.size();
+}
+
+AsciiFileWriter::AsciiFileWriter(std::string const &filename,
+                                 uint64_t resume_offset)
+    : filename(filename), out(nullptr), nwritten(resume_offset) {
+  std::error_code ec;
+  auto size = std::filesystem::file_size(filename, ec);
+  if (ec || (size < resume_offset)) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Cannot resume " +
+                             filename + " after " +
+                             std::to_string(resume_offset) +
+                             " bytes, it is missing or shorter.");
+  }
+  std::filesystem::resize_file(filename, resume_offset, ec);
+  if (ec) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Failed to truncate " +
+                             filename + ": " + ec.message());
+  }
+  fout.open(filename, std::ios::binary | std::ios::app);
+  out.rdbuf(fout.rdbuf());
+}
+
+AsciiFileWriter::~AsciiFileWriter() { Close(); }
+
+uint64_t AsciiFileWriter::Tell() const { return nwritten; }
+
+void AsciiFileWriter::WriteEventText(std::string const &text) {
+  out.write(text.data(), text.size());
+  nwritten += text.size();
+}
+
+bool AsciiFileWriter::Flush() {
+  out.flush();
+  fout.flush();
+  return !Failed() && fout.good() && SyncFile(filename);
+}
+
+void AsciiFileWriter::Close() {
+  if (!fout.is_open()) {
+    return;
+  }
+  out << AsciiFooter;
+  if (gzbuf) {
+    gzbuf->Finish();
+    gzbuf->Index().Write(filename + ".gzi");
+  }
+  fout.close();
+}
+
+} // namespace nvconv
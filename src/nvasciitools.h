@@ -0,0 +1,77 @@
+#pragma once
+
+#include "HepMC3/GenEvent.h"
+#include "HepMC3/GenRunInfo.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace HepMC3 {
+class WriterAscii;
+}
+
+namespace nvconv {
+
+class GzipBlockOutputBuf;
+
+// Returns true for file names that NuHepMC::Writer::make_writer would open
+// with a plain HepMC3::WriterAscii.
+bool IsAsciiOutput(std::string const &filename);
+
+// Formats events one at a time to the text that a HepMC3::WriterAscii writing
+// the whole file would produce for them, so that events can be serialized on
+// a different thread than the one writing the file.
+class AsciiEventFormatter {
+public:
+  AsciiEventFormatter(std::shared_ptr<HepMC3::GenRunInfo> gri);
+  ~AsciiEventFormatter();
+
+  void Format(HepMC3::GenEvent const &evt, std::string &out);
+
+private:
+  std::stringstream ss;
+  std::unique_ptr<HepMC3::WriterAscii> writer;
+};
+
+// Writes a HepMC3 ASCII file from event text produced by an
+// AsciiEventFormatter. The header and footer are identical to those written by
+// a HepMC3::WriterAscii with the same run info. If compress is set, the file is
+// written as BGZF blocks compressed on compress_threads threads, see
+// GzipBlockOutputBuf, and the block index is written to filename.gzi on Close.
+class AsciiFileWriter {
+public:
+  AsciiFileWriter(std::string const &filename,
+                  std::shared_ptr<HepMC3::GenRunInfo> gri,
+                  bool compress = false, int compress_threads = 0);
+  // Reopens an uncompressed file written by an AsciiFileWriter to carry on
+  // writing events after its first resume_offset bytes, which must end where
+  // an event did. Anything after them is discarded. Throws std::runtime_error
+  // if the file is shorter than that.
+  AsciiFileWriter(std::string const &filename, uint64_t resume_offset);
+  ~AsciiFileWriter();
+
+  bool Failed() const { return !fout.is_open() || !out.good(); }
+
+  // The offset at which the next event will be written, in the uncompressed
+  // stream if compressing.
+  uint64_t Tell() const;
+
+  void WriteEventText(std::string const &text);
+  // Makes sure everything written so far is in the file and on disk, so that
+  // it survives the process and the machine. Compressed output is only
+  // complete up to the last full block.
+  bool Flush();
+  void Close();
+
+private:
+  std::string filename;
+  std::ofstream fout;
+  std::unique_ptr<GzipBlockOutputBuf> gzbuf;
+  std::ostream out;
+  uint64_t nwritten;
+};
+
+} // namespace nvconv
@@ -0,0 +1,173 @@
+#include "nvcheckpoint.h"
+#include "nvindex.h"
+
+#include "TH1D.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace nvconv {
+
+static int const CheckpointVersion = 2;
+
+static void WriteValues(std::ostream &os, char const *name,
+                        std::vector<double> const &values) {
+  os << name;
+  for (double value : values) {
+    os << " " << value;
+  }
+  os << "\n";
+}
+
+static void ReadValues(std::istream &is, std::vector<double> &values) {
+  double value;
+  while (is >> value) {
+    values.push_back(value);
+  }
+}
+
+void Checkpoint::SetFATXInfo(FATXInfo const &info) {
+  fatx = info.fatx;
+  isMonoE = info.isMonoE;
+  beam_pid = info.beam_pid;
+  flux_energy_to_MeV = info.flux_energy_to_MeV;
+  flux_edges.clear();
+  flux_content.clear();
+  flux_units = "";
+  if (info.flux_hist) {
+    TAxis const *axis = info.flux_hist->GetXaxis();
+    flux_edges.push_back(axis->GetBinLowEdge(1));
+    for (int i = 0; i < axis->GetNbins(); ++i) {
+      flux_edges.push_back(axis->GetBinUpEdge(i + 1));
+      flux_content.push_back(info.flux_hist->GetBinContent(i + 1));
+    }
+    flux_units = info.flux_hist->GetYaxis()->GetTitle();
+  }
+}
+
+FATXInfo Checkpoint::GetFATXInfo() const {
+  FATXInfo info;
+  info.fatx = fatx;
+  info.isMonoE = isMonoE;
+  info.beam_pid = beam_pid;
+  info.flux_energy_to_MeV = flux_energy_to_MeV;
+  if (flux_edges.size() > 1) {
+    info.flux_hist = std::make_unique<TH1D>(
+        "fluxhisto_c", "", int(flux_edges.size() - 1), flux_edges.data());
+    info.flux_hist->SetDirectory(nullptr);
+    for (size_t i = 0; i < flux_content.size(); ++i) {
+      info.flux_hist->SetBinContent(int(i + 1), flux_content[i]);
+    }
+    info.flux_hist->GetYaxis()->SetTitle(flux_units.c_str());
+  }
+  return info;
+}
+
+bool Checkpoint::Write(std::string const &filename) const {
+  std::string tmp = filename + ".tmp";
+  {
+    std::ofstream fout(tmp);
+    // so that the FATX and flux histogram read back are the ones written
+    fout << std::setprecision(std::numeric_limits<double>::max_digits10);
+    fout << "version " << CheckpointVersion << "\n"
+         << "output " << output << "\n";
+    for (auto const &input : inputs) {
+      fout << "input " << input << "\n";
+    }
+    fout << "first_entry " << first_entry << "\n"
+         << "last_entry " << last_entry << "\n"
+         << "flux " << flux << "\n"
+         << "fatx " << fatx << "\n"
+         << "isMonoE " << isMonoE << "\n"
+         << "beam_pid " << beam_pid << "\n"
+         << "flux_energy_to_MeV " << flux_energy_to_MeV << "\n";
+    WriteValues(fout, "flux_edges", flux_edges);
+    WriteValues(fout, "flux_content", flux_content);
+    fout << "flux_units " << flux_units << "\n"
+         << "next_entry " << next_entry << "\n"
+         << "last_evtno " << last_evtno << "\n"
+         << "last_fname " << last_fname << "\n"
+         << "last_fentry " << last_fentry << "\n"
+         << "nevents " << nevents << "\n"
+         << "nexposure " << nexposure << "\n"
+         << "nbytes " << nbytes << "\n"
+         << "offset " << offset << "\n";
+    fout.close();
+    if (fout.fail() || !SyncFile(tmp)) {
+      return false;
+    }
+  }
+  return !std::rename(tmp.c_str(), filename.c_str()) &&
+         SyncFile(filename, true);
+}
+
+bool Checkpoint::Read(std::string const &filename) {
+  std::ifstream fin(filename);
+  if (!fin) {
+    return false;
+  }
+
+  *this = Checkpoint();
+  int version = 0;
+  std::string line;
+  while (std::getline(fin, line)) {
+    auto space = line.find(' ');
+    std::string name = line.substr(0, space);
+    std::string value =
+        (space == std::string::npos) ? "" : line.substr(space + 1);
+    std::istringstream ss(value);
+    if (name == "version") {
+      ss >> version;
+    } else if (name == "output") {
+      output = value;
+    } else if (name == "input") {
+      inputs.push_back(value);
+    } else if (name == "first_entry") {
+      ss >> first_entry;
+    } else if (name == "last_entry") {
+      ss >> last_entry;
+    } else if (name == "flux") {
+      flux = value;
+    } else if (name == "fatx") {
+      ss >> fatx;
+    } else if (name == "isMonoE") {
+      ss >> isMonoE;
+    } else if (name == "beam_pid") {
+      ss >> beam_pid;
+    } else if (name == "flux_energy_to_MeV") {
+      ss >> flux_energy_to_MeV;
+    } else if (name == "flux_edges") {
+      ReadValues(ss, flux_edges);
+    } else if (name == "flux_content") {
+      ReadValues(ss, flux_content);
+    } else if (name == "flux_units") {
+      flux_units = value;
+    } else if (name == "next_entry") {
+      ss >> next_entry;
+    } else if (name == "last_evtno") {
+      ss >> last_evtno;
+    } else if (name == "last_fname") {
+      last_fname = value;
+    } else if (name == "last_fentry") {
+      ss >> last_fentry;
+    } else if (name == "nevents") {
+      ss >> nevents;
+    } else if (name == "nexposure") {
+      ss >> nexposure;
+    } else if (name == "nbytes") {
+      ss >> nbytes;
+    } else if (name == "offset") {
+      ss >> offset;
+    }
+    if (!ss && !ss.eof()) {
+      return false;
+    }
+  }
+  return (version == CheckpointVersion) && output.size() &&
+         (flux_edges.empty() || (flux_edges.size() == flux_content.size() + 1));
+}
+
+} // namespace nvconv
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "nvfatxtools.h"
+
+#include "Rtypes.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace nvconv {
+
+// How far a conversion had got when it last made sure that everything it had
+// written was in its output, so that it can be resumed from there. Written as
+// a text file of name value lines.
+struct Checkpoint {
+  // The output, the input files and the range of chain entries converted, to
+  // check that a resumed run does the same conversion
+  std::string output;
+  std::vector<std::string> inputs;
+  Long64_t first_entry = 0;
+  Long64_t last_entry = 0;
+  // The -f flux file and histogram name, if any
+  std::string flux = "";
+
+  // The FATX found for the inputs before converting, so that a resumed run
+  // does not read them again for it. flux_edges and flux_content are the bins
+  // of FATXInfo::flux_hist, empty if it has none.
+  double fatx = 1;
+  bool isMonoE = false;
+  int beam_pid = 0;
+  double flux_energy_to_MeV = 1E3;
+  std::vector<double> flux_edges;
+  std::vector<double> flux_content;
+  std::string flux_units = "";
+
+  // The next chain entry to read
+  Long64_t next_entry = 0;
+  // The event number of the last event written, and the input file and entry
+  // it was read from, or -1 if none has been written
+  Long64_t last_evtno = -1;
+  std::string last_fname = "";
+  Long64_t last_fentry = -1;
+
+  // The events written, the events read, including those rejected by the
+  // selection, and the bytes of events written
+  Long64_t nevents = 0;
+  Long64_t nexposure = 0;
+  uint64_t nbytes = 0;
+  // The length of the output up to the end of the last event written
+  uint64_t offset = 0;
+
+  void SetFATXInfo(FATXInfo const &info);
+  // With the flux histogram rebuilt from its bins
+  FATXInfo GetFATXInfo() const;
+
+  // Writes to a temporary file that is synced to disk and renamed over
+  // filename, so that a conversion or machine that dies while checkpointing
+  // leaves the last checkpoint.
+  bool Write(std::string const &filename) const;
+  // Returns false if filename does not exist or is not a checkpoint.
+  bool Read(std::string const &filename);
+};
+
+} // namespace nvconv
@@ -0,0 +1,111 @@
+#include "nvcolumnar.h"
+
+#include "nvconv.h"
+#include "nvparticles.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace nvconv {
+
+void FlatEvent::Set(NeutVect *nv, Long64_t evtno, int ifile,
+                    Long64_t fentry) {
+  this->evtno = evtno;
+  this->ifile = ifile;
+  this->fentry = fentry;
+
+  Mode = nv->Mode;
+  ProcessID = GetEC1Channel(nv->Mode);
+  Totcrs = nv->Totcrs * 1E-2;
+  weight = 1;
+  target_A = nv->TargetA;
+  target_Z = nv->TargetZ;
+  Ibound = nv->Ibound;
+
+  thread_local NeutParticles particles;
+  particles.Fill(nv);
+
+  int npart = particles.npart;
+  pdg.resize(npart);
+  status.resize(npart);
+  px.resize(npart);
+  py.resize(npart);
+  pz.resize(npart);
+  E.resize(npart);
+
+  std::copy(particles.pid.begin(), particles.pid.end(), pdg.begin());
+  std::copy(particles.status.begin(), particles.status.end(), status.begin());
+  std::copy(particles.px.begin(), particles.px.end(), px.begin());
+  std::copy(particles.py.begin(), particles.py.end(), py.begin());
+  std::copy(particles.pz.begin(), particles.pz.end(), pz.begin());
+  std::copy(particles.e.begin(), particles.e.end(), E.begin());
+
+  beam_pdg = npart ? pdg[0] : 0;
+  beam_E = npart ? E[0] : 0;
+}
+
+FlatTreeWriter::FlatTreeWriter(std::string const &filename,
+                               std::string const &treename)
+    : fout(TFile::Open(filename.c_str(), "RECREATE")), tree(nullptr) {
+
+  if (Failed()) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to open flat output file " +
+        filename);
+  }
+
+  tree = new TTree(treename.c_str(), "neutvect-converter flat events");
+  tree->SetDirectory(fout.get());
+
+  tree->Branch("evtno", &current.evtno, "evtno/L");
+  tree->Branch("ifile", &current.ifile, "ifile/I");
+  tree->Branch("fentry", &current.fentry, "fentry/L");
+  tree->Branch("Mode", &current.Mode, "Mode/I");
+  tree->Branch("ProcessID", &current.ProcessID, "ProcessID/I");
+  tree->Branch("Totcrs", &current.Totcrs, "Totcrs/D");
+  tree->Branch("weight", &current.weight, "weight/D");
+  tree->Branch("beam_pdg", &current.beam_pdg, "beam_pdg/I");
+  tree->Branch("beam_E", &current.beam_E, "beam_E/D");
+  tree->Branch("target_A", &current.target_A, "target_A/I");
+  tree->Branch("target_Z", &current.target_Z, "target_Z/I");
+  tree->Branch("Ibound", &current.Ibound, "Ibound/I");
+  tree->Branch("pdg", &current.pdg);
+  tree->Branch("status", &current.status);
+  tree->Branch("px", &current.px);
+  tree->Branch("py", &current.py);
+  tree->Branch("pz", &current.pz);
+  tree->Branch("E", &current.E);
+}
+
+FlatTreeWriter::~FlatTreeWriter() { Close(); }
+
+void FlatTreeWriter::Fill(FlatEvent const &ev) {
+  // copies into the existing vectors, so their storage is reused
+  current = ev;
+  tree->Fill();
+}
+
+void FlatTreeWriter::Fill() { tree->Fill(); }
+
+void FlatTreeWriter::Close() {
+  if (!tree) {
+    return;
+  }
+  fout->cd();
+  tree->Write();
+  fout->Close();
+  tree = nullptr;
+}
+
+void FlatTreeWriter::Discard() {
+  if (!tree) {
+    return;
+  }
+  std::string filename = fout->GetName();
+  fout->Close();
+  tree = nullptr;
+  std::remove(filename.c_str());
+}
+
+} // namespace nvconv
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "neutvect.h"
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nvconv {
+
+// The values of one event written to the flat tree, filled straight from the
+// NeutVect without building a HepMC3 event. Momenta and energies are in MeV,
+// as in the converted events. There is one entry in each of the particle
+// vectors per NEUT particle, with its NuHepMC status, so the final state
+// particles are those with status == 1.
+struct FlatEvent {
+  Long64_t evtno = 0;
+  Int_t ifile = 0;
+  Long64_t fentry = 0;
+
+  Int_t Mode = 0;
+  // the NuHepMC E.R.3 process ID
+  Int_t ProcessID = 0;
+  // the total cross section, in pb, as in E.C.2
+  Double_t Totcrs = 0;
+  // the E.C.1 CV weight
+  Double_t weight = 1;
+  Int_t beam_pdg = 0;
+  Double_t beam_E = 0;
+  Int_t target_A = 0;
+  Int_t target_Z = 0;
+  Int_t Ibound = 0;
+
+  std::vector<Int_t> pdg;
+  std::vector<Int_t> status;
+  std::vector<Double_t> px;
+  std::vector<Double_t> py;
+  std::vector<Double_t> pz;
+  std::vector<Double_t> E;
+
+  void Set(NeutVect *nv, Long64_t evtno, int ifile, Long64_t fentry);
+};
+
+// Writes FlatEvents to a TTree of plain values and vectors, one entry per
+// event, so that analyses can read only the branches they need.
+class FlatTreeWriter {
+public:
+  FlatTreeWriter(std::string const &filename,
+                 std::string const &treename = "nvflat");
+  ~FlatTreeWriter();
+
+  bool Failed() const { return !fout || fout->IsZombie(); }
+
+  void Fill(FlatEvent const &ev);
+  // The event that the tree branches point to, which can be set in place and
+  // then written with Fill(), without copying it.
+  FlatEvent &Current() { return current; }
+  void Fill();
+  void Close();
+  // Closes the file without writing the tree and removes it, for a conversion
+  // that failed part way through.
+  void Discard();
+
+private:
+  std::unique_ptr<TFile> fout;
+  // owned by fout
+  TTree *tree;
+  // the tree branches point into this
+  FlatEvent current;
+};
+
+} // namespace nvconv
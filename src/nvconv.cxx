@@ -1,5 +1,7 @@
 #include "nvconv.h"
 
+#include "nvparticles.h"
+
 #include "NuHepMC/EventUtils.hxx"
 #include "NuHepMC/WriterUtils.hxx"
 
@@ -8,12 +10,78 @@
 
 #include "HepMC3/Print.h"
 
+#include <algorithm>
+#include <limits>
 #include <memory>
-#include <set>
+#include <memory_resource>
 #include <utility>
+#include <vector>
 
 namespace nvconv {
 
+namespace {
+
+// Allocates from a shared pool and keeps the pool alive for as long as any
+// object allocated from it, so that events may outlive the thread that
+// converted them.
+template <typename T> struct PoolAllocator {
+  typedef T value_type;
+
+  std::shared_ptr<std::pmr::memory_resource> pool;
+
+  PoolAllocator(std::shared_ptr<std::pmr::memory_resource> pool)
+      : pool(std::move(pool)) {}
+  template <typename U>
+  PoolAllocator(PoolAllocator<U> const &other) : pool(other.pool) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(pool->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *p, size_t n) {
+    pool->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  template <typename U> bool operator==(PoolAllocator<U> const &other) const {
+    return pool == other.pool;
+  }
+  template <typename U> bool operator!=(PoolAllocator<U> const &other) const {
+    return pool != other.pool;
+  }
+};
+
+// Events may be released on a different thread than the one that built them,
+// so the per-thread pools still have to be synchronized, but are uncontended
+// in the common case.
+std::shared_ptr<std::pmr::memory_resource> const &GetThreadPool() {
+  thread_local std::shared_ptr<std::pmr::memory_resource> pool =
+      std::make_shared<std::pmr::synchronized_pool_resource>();
+  return pool;
+}
+
+template <typename T, typename... Args>
+std::shared_ptr<T> MakePooled(Args &&...args) {
+  return std::allocate_shared<T>(PoolAllocator<T>(GetThreadPool()),
+                                 std::forward<Args>(args)...);
+}
+
+// NEUT reports Ibound == 0 for coherent and diffractive events on nuclear
+// targets.
+bool IsNuclearWithoutIbound(int neutmode) {
+  switch (std::abs(neutmode)) {
+  case 15:
+  case 16:
+  case 35:
+  case 36: {
+    return true;
+  }
+  default: {
+    return false;
+  }
+  }
+}
+
+} // namespace
+
 static const double GeV = 1E-3;
 static const double MeV = 1;
 
@@ -115,53 +183,88 @@ const std::map<int, std::pair<std::string, int>> ChannelNameIndexModeMapping{
 };
 
 int GetEC1Channel(int neutmode) {
-  if (!ChannelNameIndexModeMapping.count(neutmode)) {
+  // ChannelNameIndexModeMapping as a dense table indexed by neutmode +
+  // max_mode, with 0 for the modes it does not have
+  static int const max_mode = std::max(
+      -ChannelNameIndexModeMapping.begin()->first,
+      ChannelNameIndexModeMapping.rbegin()->first);
+  static std::vector<int> const channels = []() {
+    std::vector<int> channels(2 * max_mode + 1, 0);
+    for (auto const &neutchan : ChannelNameIndexModeMapping) {
+      channels[neutchan.first + max_mode] = neutchan.second.second;
+    }
+    return channels;
+  }();
+
+  int channel =
+      (std::abs(neutmode) <= max_mode) ? channels[neutmode + max_mode] : 0;
+  if (!channel) {
     std::cout << "[ERROR]: neutmode: " << neutmode << " unaccounted for."
               << std::endl;
     throw neutmode;
   }
-  return ChannelNameIndexModeMapping.at(neutmode).second;
+  return channel;
+}
+
+int GetNuHepMCParticleStatus(NeutVect *nv, int p_it) {
+  NeutPart *pinfo = nv->PartInfo(p_it);
+  return NuHepMCParticleStatus(pinfo->fStatus, pinfo->fIsAlive, pinfo->fPID,
+                               p_it, nv->Mode);
+}
+
+bool IsBoundTarget(NeutVect *nv) {
+  // Correct confusing 'isbound == false' for certain modes
+  return nv->Ibound || IsNuclearWithoutIbound(nv->Mode);
+}
+
+void NEUTPassthrough::AddToRunInfo(
+    NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> run_info) {
+
+  static std::map<PassthroughLevel, std::string> const level_names = {
+      {PassthroughLevel::None, "none"},
+      {PassthroughLevel::Event, "event"},
+      {PassthroughLevel::Full, "full"}};
+  NuHepMC::add_attribute(run_info, "NEUT.Passthrough", level_names.at(level));
+
+  run_constants.clear();
+  if (level == PassthroughLevel::None) {
+    return;
+  }
+
+  VisitRunConstants(nv, [&](char const *name, auto const &value) {
+    NuHepMC::add_attribute(run_info, name, value);
+    run_constants.push_back(double(value));
+  });
 }
 
 void AddNEUTPassthrough(HepMC3::GenEvent &evt,
                         std::vector<HepMC3::GenParticlePtr> &parts,
-                        NeutVect *nv) {
-
-  NuHepMC::add_attribute(evt, "NEUT.TargetA", nv->TargetA);
-  NuHepMC::add_attribute(evt, "NEUT.TargetZ", nv->TargetZ);
-  NuHepMC::add_attribute(evt, "NEUT.TargetH", nv->TargetH);
-  NuHepMC::add_attribute(evt, "NEUT.Ibound", nv->Ibound);
-  NuHepMC::add_attribute(evt, "NEUT.VNuclIni", nv->VNuclIni);
-  NuHepMC::add_attribute(evt, "NEUT.VNuclFin", nv->VNuclFin);
-  NuHepMC::add_attribute(evt, "NEUT.PFSurf", nv->PFSurf);
-  NuHepMC::add_attribute(evt, "NEUT.PFMax", nv->PFMax);
-  NuHepMC::add_attribute(evt, "NEUT.QEModel", nv->QEModel);
-  NuHepMC::add_attribute(evt, "NEUT.QEVForm", nv->QEVForm);
-  NuHepMC::add_attribute(evt, "NEUT.RADcorr", nv->RADcorr);
-  NuHepMC::add_attribute(evt, "NEUT.SPIModel", nv->SPIModel);
-  NuHepMC::add_attribute(evt, "NEUT.COHModel", nv->COHModel);
-  NuHepMC::add_attribute(evt, "NEUT.DISModel", nv->DISModel);
-  NuHepMC::add_attribute(evt, "NEUT.Mode", nv->Mode);
-
-  NeutPart *pinfo = nullptr;
-  int npart = nv->Npart();
-  int nprimary = nv->Nprimary();
-
-  NuHepMC::add_attribute(evt, "NEUT.npart", npart);
-  NuHepMC::add_attribute(evt, "NEUT.nprimary", nprimary);
-
-  for (int i = 0; i < npart; ++i) {
-    pinfo = nv->PartInfo(i);
-    if (parts[i]->in_event()) {
-      NuHepMC::add_attribute(parts[i], "NEUT.i", i);
-      NuHepMC::add_attribute(parts[i], "NEUT.fStatus", pinfo->fStatus);
-      NuHepMC::add_attribute(parts[i], "NEUT.fIsAlive", pinfo->fIsAlive);
-    }
+                        NeutVect *nv, NEUTPassthrough const &passthrough) {
+  passthrough.Visit(
+      nv,
+      [&](int i) { return parts[i]->in_event() ? parts[i]->id() : 0; },
+      [&](char const *name, auto const &value) {
+        NuHepMC::add_attribute(evt, name, value);
+      });
+}
+
+void DecorateEvent(HepMC3::GenEvent &evt, Long64_t i, int ifile,
+                   Long64_t fentry) {
+  evt.set_event_number(i);
+  NuHepMC::add_attribute(evt, "ifile.index", ifile);
+  NuHepMC::add_attribute(evt, "ifile.entry", fentry);
+}
+
+void AddInputFileNames(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                       std::vector<std::string> const &names) {
+  NuHepMC::add_attribute(gri, "ifile.nfiles", int(names.size()));
+  for (size_t n = 0; n < names.size(); ++n) {
+    NuHepMC::add_attribute(gri, "ifile.name." + std::to_string(n), names[n]);
   }
 }
 
 std::shared_ptr<HepMC3::GenRunInfo>
-BuildRunInfo(int nevents, double flux_averaged_total_cross_section,
+BuildRunInfo(Long64_t nevents, double flux_averaged_total_cross_section,
              std::unique_ptr<TH1> &flux_hist, bool &isMonoE, int beam_pid,
              double flux_to_MeV) {
 
@@ -247,7 +350,7 @@ BuildRunInfo(int nevents, double flux_averaged_total_cross_section,
 
   // G.R.4 Signalling Followed Conventions
   std::vector<std::string> conventions = {
-      "G.C.2", "E.C.1", "E.C.2", "V.C.1", "P.C.1", "P.C.2",
+      "G.C.2", "G.C.3", "E.C.1", "E.C.2", "V.C.1", "P.C.1", "P.C.2",
   };
 
   // G.R.6 Cross Section Units and Target Scaling
@@ -257,6 +360,15 @@ BuildRunInfo(int nevents, double flux_averaged_total_cross_section,
   NuHepMC::GC2::SetFluxAveragedTotalXSec(run_info,
                                          flux_averaged_total_cross_section);
 
+  // G.C.3 Exposure, also used to weight G.C.2 when merging files. It is read
+  // back as an IntAttribute.
+  if (nevents > std::numeric_limits<int>::max()) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Cannot record an exposure of " +
+        std::to_string(nevents) + " events in NuHepMC.Exposure.NEvents.");
+  }
+  NuHepMC::add_attribute(run_info, "NuHepMC.Exposure.NEvents", int(nevents));
+
   if (flux_hist || isMonoE) {
     conventions.push_back("G.C.7");
 
@@ -294,175 +406,88 @@ BuildRunInfo(int nevents, double flux_averaged_total_cross_section,
 }
 
 std::shared_ptr<HepMC3::GenEvent>
-ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri) {
+ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri,
+           NEUTPassthrough const &passthrough, EventValidator *validator) {
+  auto evt =
+      std::make_shared<HepMC3::GenEvent>(HepMC3::Units::MEV, HepMC3::Units::CM);
+  ToGenEvent(nv, gri, *evt, passthrough, validator);
+  return evt;
+}
+
+void ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri,
+                HepMC3::GenEvent &evt, NEUTPassthrough const &passthrough,
+                EventValidator *validator) {
 
 #ifdef NEUTCONV_DEBUG
   std::cout << ">>>>>>>>>>>>>>>ToGenEvent" << std::endl;
   nv->Dump();
 #endif
 
-  auto evt =
-      std::make_shared<HepMC3::GenEvent>(HepMC3::Units::MEV, HepMC3::Units::CM);
-  evt->set_run_info(gri);
+  // dropping the previous event returns its particles and vertices to the pool
+  evt.clear();
+  evt.set_units(HepMC3::Units::MEV, HepMC3::Units::CM);
+  evt.set_run_info(gri);
+
+  // counted as the event is built, so that it does not have to be walked again
+  // to validate it
+  bool validate = validator && validator->ShouldValidate();
+  ParticleCounts counts;
 
   HepMC3::GenVertexPtr IAVertex =
-      std::make_shared<HepMC3::GenVertex>(HepMC3::FourVector{});
+      MakePooled<HepMC3::GenVertex>(HepMC3::FourVector{});
   IAVertex->set_status(NuHepMC::VertexStatus::NucleonSeparation);
 
-  bool isbound = nv->Ibound;
-
-  std::set<int> not_bound_modes = {16, 15, -16, -15, 36, 35, -36, -35};
-  if (!isbound && (not_bound_modes.count(nv->Mode))) {
-    // Correct confusing 'isbound == false' for certain modes
-    isbound = true;
-  }
+  bool isbound = IsBoundTarget(nv);
 
   int nuclear_PDG = 1000000000 + nv->TargetZ * 10000 + nv->TargetA * 10;
   int nuclear_remnant_PDG = nuclear_PDG;
   HepMC3::GenParticlePtr nuclear_remnant_internal = nullptr;
   HepMC3::GenParticlePtr nuclear_remnant_external = nullptr;
   if (isbound) {
-    HepMC3::GenParticlePtr target_nucleus =
-        std::make_shared<HepMC3::GenParticle>(HepMC3::FourVector{0, 0, 0, 0},
-                                              nuclear_PDG,
-                                              NuHepMC::ParticleStatus::Target);
+    HepMC3::GenParticlePtr target_nucleus = MakePooled<HepMC3::GenParticle>(
+        HepMC3::FourVector{0, 0, 0, 0}, nuclear_PDG,
+        NuHepMC::ParticleStatus::Target);
 
-    nuclear_remnant_internal = std::make_shared<HepMC3::GenParticle>(
+    nuclear_remnant_internal = MakePooled<HepMC3::GenParticle>(
         HepMC3::FourVector{0, 0, 0, 0}, NuHepMC::ParticleNumber::NuclearRemnant,
         NuHepMC::ParticleStatus::DocumentationLine);
 
-    nuclear_remnant_external = std::make_shared<HepMC3::GenParticle>(
+    nuclear_remnant_external = MakePooled<HepMC3::GenParticle>(
         HepMC3::FourVector{0, 0, 0, 0}, NuHepMC::ParticleNumber::NuclearRemnant,
         NuHepMC::ParticleStatus::UndecayedPhysical);
 
     IAVertex->add_particle_in(target_nucleus);
     IAVertex->add_particle_out(nuclear_remnant_internal);
+    counts.target++;
+    counts.final_state++;
   }
 
   // E.R.5
   HepMC3::GenVertexPtr primvertex =
-      std::make_shared<HepMC3::GenVertex>(HepMC3::FourVector{});
+      MakePooled<HepMC3::GenVertex>(HepMC3::FourVector{});
   primvertex->set_status(NuHepMC::VertexStatus::Primary);
 
   HepMC3::GenVertexPtr fsivertex =
-      std::make_shared<HepMC3::GenVertex>(HepMC3::FourVector{});
+      MakePooled<HepMC3::GenVertex>(HepMC3::FourVector{});
   fsivertex->set_status(NuHepMC::VertexStatus::FSISummary);
   fsivertex->add_particle_in(nuclear_remnant_internal);
   fsivertex->add_particle_out(nuclear_remnant_external);
 
-  NeutPart *pinfo = nullptr;
-  int npart = nv->Npart();
-  int nprimary = nv->Nprimary();
+  // unpacked once, with the energies, masses and statuses of every particle
+  thread_local NeutParticles particles;
+  particles.Fill(nv);
+  int npart = particles.npart;
+  int nprimary = particles.nprimary;
 
   // need to keep this stack so that we can add metadata attributes after we
   // have added them to the event.
-  std::vector<HepMC3::GenParticlePtr> parts;
+  thread_local std::vector<HepMC3::GenParticlePtr> parts;
+  parts.clear();
 
   for (int p_it = 0; p_it < npart; ++p_it) {
-    pinfo = nv->PartInfo(p_it);
-
     bool isprim = p_it < nprimary;
 
-    int NuHepPartStatus = 0;
-
-    switch (pinfo->fStatus) {
-    case -1: {
-      NuHepPartStatus = (p_it == 0) ? NuHepMC::ParticleStatus::IncomingBeam
-                                    : NuHepMC::ParticleStatus::StruckNucleon;
-      break;
-    }
-    case 0: {
-      if (pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::UndecayedPhysical;
-      } else if ((std::abs(pinfo->fPID) == 12) ||
-                 (std::abs(pinfo->fPID) == 14) ||
-                 (std::abs(pinfo->fPID) == 16)) { // NC FS Neutrino
-        NuHepPartStatus = NuHepMC::ParticleStatus::UndecayedPhysical;
-      }
-      break;
-    }
-    case 1: {
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::DecayedPhysical;
-      }
-      break;
-    }
-    case 2: {
-      if (pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::UndecayedPhysical;
-      } else if ((std::abs(pinfo->fPID) == 12) ||
-                 (std::abs(pinfo->fPID) == 14) ||
-                 (std::abs(pinfo->fPID) == 16)) { // NC FS Neutrino
-        NuHepPartStatus = NuHepMC::ParticleStatus::UndecayedPhysical;
-      }
-      break;
-    }
-    case 3: {
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::NEUT::UnderwentFSI;
-      }
-      break;
-    }
-    case 4: {
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::NEUT::UnderwentFSI;
-      }
-      break;
-    }
-    case 5: {
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::NEUT::PauliBlocked;
-      }
-      break;
-    }
-    case 6: {
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::NEUT::SecondaryInteraction;
-      }
-      break;
-    }
-    case 7: {
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::NEUT::UnderwentFSI;
-      }
-      break;
-    }
-    case 8: {
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::NEUT::UnderwentFSI;
-      }
-      break;
-    }
-    case 9: {
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::NEUT::UnderwentFSI;
-      }
-      break;
-    }
-    case -3: { // absorbed pion
-      if (!pinfo->fIsAlive) {
-        NuHepPartStatus = NuHepMC::ParticleStatus::NEUT::UnderwentFSI;
-      }
-    }
-    }
-
-    if ((std::abs(nv->Mode) == 15) ||
-        (std::abs(nv->Mode) == 35)) { // special case for diffractive
-      switch (p_it) {
-      case 0: {
-        NuHepPartStatus = NuHepMC::ParticleStatus::IncomingBeam;
-        break;
-      }
-      case 1: {
-        NuHepPartStatus = NuHepMC::ParticleStatus::StruckNucleon;
-        break;
-      }
-      default: {
-        NuHepPartStatus = NuHepMC::ParticleStatus::UndecayedPhysical;
-        break;
-      }
-      }
-    }
+    int NuHepPartStatus = particles.status[p_it];
 
     if (!NuHepPartStatus) {
 
@@ -482,16 +507,15 @@ ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri) {
       throw ss.str();
     }
 
-    TLorentzVector fmom;
-    fmom.SetXYZM(pinfo->fP.X(), pinfo->fP.Y(), pinfo->fP.Z(), pinfo->fMass);
-
-    HepMC3::GenParticlePtr part = std::make_shared<HepMC3::GenParticle>(
-        HepMC3::FourVector{fmom.X(), fmom.Y(), fmom.Z(), fmom.E()}, pinfo->fPID,
-        NuHepPartStatus);
+    HepMC3::GenParticlePtr part = MakePooled<HepMC3::GenParticle>(
+        HepMC3::FourVector{particles.px[p_it], particles.py[p_it],
+                           particles.pz[p_it], particles.e[p_it]},
+        particles.pid[p_it], NuHepPartStatus);
     parts.push_back(part);
-    part->set_generated_mass(fmom.M());
+    part->set_generated_mass(particles.m[p_it]);
 
 #ifdef NEUTCONV_DEBUG
+    NeutPart *pinfo = nv->PartInfo(p_it);
     std::cout << "Processing NEUT particle(" << p_it << "/" << npart
               << ", nprim:" << nprimary << ") pid: " << pinfo->fPID
               << ", status: " << pinfo->fStatus
@@ -499,12 +523,16 @@ ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri) {
     std::cout << "\t->NuHepPartStatus: " << NuHepPartStatus << std::endl;
 #endif
 
-    if (NuHepPartStatus == NuHepMC::ParticleStatus::IncomingBeam) {
+    switch (particles.role[p_it]) {
+    case ParticleRole::Beam: {
       primvertex->add_particle_in(part);
+      counts.beam++;
 #ifdef NEUTCONV_DEBUG
       std::cout << "\t->Added as /in/ to primvertex" << std::endl;
 #endif
-    } else if (NuHepPartStatus == NuHepMC::ParticleStatus::StruckNucleon) {
+      break;
+    }
+    case ParticleRole::StruckNucleon: {
       if (isbound) {
         IAVertex->add_particle_out(part);
 
@@ -516,6 +544,7 @@ ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri) {
       } else { // use stuck nucleon as target for unbound interactions
         part->set_status(NuHepMC::ParticleStatus::Target);
         part->set_pid(part->pid() == 2212 ? 1000010010 : 1000000010);
+        counts.target++;
       }
       primvertex->add_particle_in(part);
 
@@ -525,15 +554,19 @@ ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri) {
       }
       std::cout << "\t->Added as /in/ to primvertex" << std::endl;
 #endif
-    } else if (NuHepPartStatus == NuHepMC::ParticleStatus::UndecayedPhysical) {
+      break;
+    }
+    case ParticleRole::FinalState: {
       if (isprim) {
-        auto part_copy = std::make_shared<HepMC3::GenParticle>(part->data());
+        auto part_copy = MakePooled<HepMC3::GenParticle>(part->data());
         if (isbound) {
           part_copy->set_status(NuHepMC::ParticleStatus::DocumentationLine);
         }
         primvertex->add_particle_out(part_copy);
         if (isbound) {
           fsivertex->add_particle_in(part_copy);
+        } else {
+          counts.final_state++;
         }
 #ifdef NEUTCONV_DEBUG
         std::cout << "\t->Copied particle with status: "
@@ -546,34 +579,29 @@ ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri) {
       }
       if (isbound) {
         fsivertex->add_particle_out(part);
+        counts.final_state++;
 #ifdef NEUTCONV_DEBUG
         std::cout << "\t->Added as /out/ from fsivertex" << std::endl;
 #endif
       }
-    } else if ((NuHepPartStatus == NuHepMC::ParticleStatus::DecayedPhysical) ||
-               (NuHepPartStatus ==
-                NuHepMC::ParticleStatus::NEUT::PauliBlocked) ||
-               (NuHepPartStatus ==
-                NuHepMC::ParticleStatus::NEUT::SecondaryInteraction)) {
-      primvertex->add_particle_out(part);
-      fsivertex->add_particle_in(part);
-#ifdef NEUTCONV_DEBUG
-      std::cout << "\t->Added as /out/ from primvertex" << std::endl;
-      std::cout << "\t->Added as /in/ to fsivertex" << std::endl;
-#endif
-    } else if (NuHepPartStatus == NuHepMC::ParticleStatus::NEUT::UnderwentFSI) {
+      break;
+    }
+    case ParticleRole::Intermediate: {
       primvertex->add_particle_out(part);
       fsivertex->add_particle_in(part);
 #ifdef NEUTCONV_DEBUG
       std::cout << "\t->Added as /out/ from primvertex" << std::endl;
       std::cout << "\t->Added as /in/ to fsivertex" << std::endl;
 #endif
-    } else {
+      break;
+    }
+    default: {
       std::stringstream ss;
       ss << "[ERROR]: Failed to find vertex for particle: " << (p_it + 1);
       std::cout << ss.str() << std::endl;
       throw ss.str();
     }
+    }
   }
 
   if (isbound && !fsivertex->particles_in().size()) {
@@ -582,25 +610,25 @@ ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri) {
   }
 
   if (isbound) {
-    evt->add_vertex(IAVertex);
+    evt.add_vertex(IAVertex);
   }
-  evt->add_vertex(primvertex);
+  evt.add_vertex(primvertex);
   if (isbound) {
-    evt->add_vertex(fsivertex);
+    evt.add_vertex(fsivertex);
   }
 
   // E.C.1
-  evt->weight("CV") = 1;
+  evt.weight("CV") = 1;
 
   // E.C.4
   static double const cm2_to_pb = 1E36;
 
   // E.C.2
-  NuHepMC::EC2::SetTotalCrossSection(*evt, nv->Totcrs * 1E-38 * cm2_to_pb);
+  NuHepMC::EC2::SetTotalCrossSection(evt, nv->Totcrs * 1E-38 * cm2_to_pb);
   // E.R.5
-  NuHepMC::ER5::SetLabPosition(*evt, std::vector<double>{0, 0, 0, 0});
+  NuHepMC::ER5::SetLabPosition(evt, std::vector<double>{0, 0, 0, 0});
 
-  NuHepMC::ER3::SetProcessID(*evt, GetEC1Channel(nv->Mode));
+  NuHepMC::ER3::SetProcessID(evt, GetEC1Channel(nv->Mode));
 
   if (isbound) {
     NuHepMC::PC2::SetRemnantNucleusParticleNumber(
@@ -608,72 +636,21 @@ ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri) {
         (nuclear_remnant_PDG / 10) % 1000);
   }
 
-  auto beamp = NuHepMC::Event::GetBeamParticle(*evt);
-  auto tgtp = NuHepMC::Event::GetTargetParticle(*evt);
-  auto nfs = NuHepMC::Event::GetParticles_All(
-                 *evt, NuHepMC::ParticleStatus::UndecayedPhysical)
-                 .size();
-
-  if (!beamp) {
-    HepMC3::Print::listing(*evt);
-    std::stringstream ss;
-
-    for (int p_it = 0; p_it < npart; ++p_it) {
-      auto pinfo = nv->PartInfo(p_it);
-      ss << "p[" << p_it << "]- pid: " << pinfo->fPID
-         << ", prim: " << (p_it < nprimary) << ", status: " << pinfo->fStatus
-         << ", alive: " << pinfo->fIsAlive << "\n";
-    }
-
-    std::cout << ss.str() << std::endl;
-    nv->Dump();
-#ifdef NEUTCONV_DEBUG
-    throw std::runtime_error("neutvect event contained no beam particle");
-#endif
-  }
-  if (!tgtp) {
-    HepMC3::Print::listing(*evt);
-    std::stringstream ss;
-
-    for (int p_it = 0; p_it < npart; ++p_it) {
-      auto pinfo = nv->PartInfo(p_it);
-      ss << "p[" << p_it << "]- pid: " << pinfo->fPID
-         << ", prim: " << (p_it < nprimary) << ", status: " << pinfo->fStatus
-         << ", alive: " << pinfo->fIsAlive << "\n";
+  if (validate) {
+    if (validator->Level() == ValidationLevel::Sampled) {
+      counts = CountParticles(evt);
     }
-
-    std::cout << ss.str() << std::endl;
-    nv->Dump();
-#ifdef NEUTCONV_DEBUG
-    throw std::runtime_error("neutvect event contained no target particle");
-#endif
-  }
-  if (!nfs) {
-    HepMC3::Print::listing(*evt);
-    std::stringstream ss;
-
-    for (int p_it = 0; p_it < npart; ++p_it) {
-      auto pinfo = nv->PartInfo(p_it);
-      ss << "p[" << p_it << "]- pid: " << pinfo->fPID
-         << ", prim: " << (p_it < nprimary) << ", status: " << pinfo->fStatus
-         << ", alive: " << pinfo->fIsAlive << "\n";
+    if (!validator->Record(counts) && validator->ShouldReport()) {
+      ReportInvalidEvent(evt, nv, counts);
     }
-
-    std::cout << ss.str() << std::endl;
-    nv->Dump();
-#ifdef NEUTCONV_DEBUG
-    throw std::runtime_error(
-        "neutvect event contained no final state particles");
-#endif
   }
 
-  AddNEUTPassthrough(*evt, parts, nv);
+  AddNEUTPassthrough(evt, parts, nv, passthrough);
+  parts.clear();
 
 #ifdef NEUTCONV_DEBUG
-  HepMC3::Print::listing(*evt);
+  HepMC3::Print::listing(evt);
   std::cout << "<<<<<<<<<<<<<<<ToGenEvent" << std::endl;
 #endif
-
-  return evt;
 }
 } // namespace nvconv
\ No newline at end of file
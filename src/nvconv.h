@@ -1,11 +1,17 @@
 #pragma once
 
+#include "nvvalidation.h"
+
 #include "neutvect.h"
 
 #include "HepMC3/GenEvent.h"
 
 #include "TH1.h"
 
+#include <map>
+#include <string>
+#include <vector>
+
 namespace NuHepMC {
 
 namespace ParticleStatus {
@@ -21,9 +27,136 @@ const int SecondaryInteraction = 99;
 
 namespace nvconv {
 std::shared_ptr<HepMC3::GenRunInfo>
-BuildRunInfo(int nevents, double flux_averaged_total_cross_section,
+BuildRunInfo(Long64_t nevents, double flux_averaged_total_cross_section,
              std::unique_ptr<TH1> &flux_histo, bool &isMonoE, int beam_pid,
              double flux_to_MeV = 1);
+enum class PassthroughLevel { None, Event, Full };
+
+// Decides which NEUT values are passed through to the converted events as
+// attributes. From PassthroughLevel::Event, the event-level NEUT values are
+// written, except that those that are normally constant over a run, the target
+// and the nuclear model settings, are only written to the events where they
+// differ from the values given to AddToRunInfo, which stores them in the run
+// info. PassthroughLevel::Full also writes the NEUT status, the alive flag and
+// the HepMC3 particle id of each NEUT particle as vector event attributes,
+// indexed by NEUT particle number.
+class NEUTPassthrough {
+public:
+  NEUTPassthrough(PassthroughLevel level = PassthroughLevel::Full)
+      : level(level) {}
+
+  PassthroughLevel Level() const { return level; }
+
+  // Writes the passthrough level and the run-constant values of nv to
+  // run_info.
+  void AddToRunInfo(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> run_info);
+
+  // Calls visit(name, value) for each NEUT attribute to add to the event
+  // converted from nv. particle_id(i) is the HepMC3 id of NEUT particle i, or 0
+  // if it is not in the event.
+  template <typename I, typename V>
+  void Visit(NeutVect *nv, I &&particle_id, V &&visit) const {
+    if (level == PassthroughLevel::None) {
+      return;
+    }
+
+    size_t i_const = 0;
+    VisitRunConstants(nv, [&](char const *name, auto const &value) {
+      if ((i_const >= run_constants.size()) ||
+          (double(value) != run_constants[i_const])) {
+        visit(name, value);
+      }
+      i_const++;
+    });
+
+    int npart = nv->Npart();
+    int nprimary = nv->Nprimary();
+
+    visit("NEUT.Ibound", nv->Ibound);
+    visit("NEUT.Mode", nv->Mode);
+    visit("NEUT.npart", npart);
+    visit("NEUT.nprimary", nprimary);
+
+    if (level != PassthroughLevel::Full) {
+      return;
+    }
+
+    std::vector<int> ids(npart), statuses(npart), alive(npart);
+    for (int i = 0; i < npart; ++i) {
+      NeutPart *pinfo = nv->PartInfo(i);
+      ids[i] = particle_id(i);
+      statuses[i] = pinfo->fStatus;
+      alive[i] = pinfo->fIsAlive;
+    }
+    visit("NEUT.HepMC3Id", ids);
+    visit("NEUT.fStatus", statuses);
+    visit("NEUT.fIsAlive", alive);
+  }
+
+private:
+  template <typename V> static void VisitRunConstants(NeutVect *nv, V &&visit) {
+    visit("NEUT.TargetA", nv->TargetA);
+    visit("NEUT.TargetZ", nv->TargetZ);
+    visit("NEUT.TargetH", nv->TargetH);
+    visit("NEUT.VNuclIni", nv->VNuclIni);
+    visit("NEUT.VNuclFin", nv->VNuclFin);
+    visit("NEUT.PFSurf", nv->PFSurf);
+    visit("NEUT.PFMax", nv->PFMax);
+    visit("NEUT.QEModel", nv->QEModel);
+    visit("NEUT.QEVForm", nv->QEVForm);
+    visit("NEUT.RADcorr", nv->RADcorr);
+    visit("NEUT.SPIModel", nv->SPIModel);
+    visit("NEUT.COHModel", nv->COHModel);
+    visit("NEUT.DISModel", nv->DISModel);
+  }
+
+  PassthroughLevel level;
+  // values of the VisitRunConstants attributes written to the run info
+  std::vector<double> run_constants;
+};
+
+// Converts nv to a NuHepMC event, which is only validated if a validator is
+// given.
 std::shared_ptr<HepMC3::GenEvent>
-ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri);
+ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri,
+           NEUTPassthrough const &passthrough = NEUTPassthrough(),
+           EventValidator *validator = nullptr);
+// Clears evt and fills it with the converted event, reusing the capacity of its
+// particle and vertex lists. The particles and vertices themselves are
+// allocated from a per-thread pool that is recycled as previous events are
+// cleared. This cuts down, but does not remove, the heap allocations per
+// event: HepMC3 still allocates a new root vertex in GenEvent::clear, the
+// particle lists of each vertex and every attribute.
+void ToGenEvent(NeutVect *nv, std::shared_ptr<HepMC3::GenRunInfo> gri,
+                HepMC3::GenEvent &evt,
+                NEUTPassthrough const &passthrough = NEUTPassthrough(),
+                EventValidator *validator = nullptr);
+
+// Sets the event number of evt to i, its entry in the input chain, and records
+// the index of the input file it came from, as in the ifile.name.<n> run info
+// attributes, and its entry in that file as the ifile.index and ifile.entry
+// attributes.
+void DecorateEvent(HepMC3::GenEvent &evt, Long64_t i, int ifile,
+                   Long64_t fentry);
+
+// Records the input files in gri as the ifile.nfiles attribute and one
+// ifile.name.<n> string attribute per file, rather than as one list attribute,
+// which would split names with whitespace in them.
+void AddInputFileNames(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                       std::vector<std::string> const &names);
+
+// The NuHepMC status of particle p_it in nv, or 0 if its NEUT status cannot be
+// converted.
+int GetNuHepMCParticleStatus(NeutVect *nv, int p_it);
+// Whether the interaction in nv was on a nucleon bound in a nucleus, in which
+// case ToGenEvent adds the nuclear target and the FSI vertex.
+bool IsBoundTarget(NeutVect *nv);
+// The E.C.1 process ID for a NEUT mode.
+int GetEC1Channel(int neutmode);
+
+// NEUT mode -> (channel name, E.C.1 process ID) for every mode that can be
+// converted.
+extern const std::map<int, std::pair<std::string, int>>
+    ChannelNameIndexModeMapping;
+
 } // namespace nvconv
\ No newline at end of file
@@ -0,0 +1,529 @@
+#include "nvdaemon.h"
+
+#include "nvmetrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace nvconv {
+
+// A request is the working directory and then each argument, each terminated
+// by a NUL, and ended by an empty field. The reply is the output of the job, a
+// NUL and then its exit status on a line.
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+// written to by the signal handlers to wake the poll loop
+int wake_pipe[2] = {-1, -1};
+
+void OnStop(int) {
+  stop_requested = 1;
+  char c = 's';
+  (void)!::write(wake_pipe[1], &c, 1);
+}
+
+void OnChild(int) {
+  char c = 'c';
+  (void)!::write(wake_pipe[1], &c, 1);
+}
+
+struct Job {
+  // for the daemon's log
+  std::string name;
+  std::string cwd;
+  std::vector<std::string> args;
+  // the connection the job was submitted on, or -1 for a spool job
+  int fd = -1;
+  // the <name> of a spool job's files
+  std::string spool_base = "";
+};
+
+bool WriteAll(int fd, char const *data, size_t n) {
+  while (n) {
+    ssize_t nw = ::write(fd, data, n);
+    if (nw < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += nw;
+    n -= nw;
+  }
+  return true;
+}
+
+// Fills in job from the request received so far in buf. Returns false if the
+// request has not ended yet.
+bool ParseRequest(std::string const &buf, Job &job) {
+  // the request ends with an empty field, after at least the working directory
+  size_t start = 0;
+  std::vector<std::string> fields;
+  for (size_t end; (end = buf.find('\0', start)) != std::string::npos;
+       start = end + 1) {
+    if ((end == start) && fields.size()) {
+      job.cwd = fields.front();
+      job.args.assign(fields.begin() + 1, fields.end());
+      return true;
+    }
+    fields.emplace_back(buf, start, end - start);
+  }
+  return false;
+}
+
+// Reads what has arrived on the non-blocking connection fd onto buf. Returns
+// false if the connection closed or failed.
+bool ReadAvailable(int fd, std::string &buf) {
+  char chunk[4096];
+  while (true) {
+    ssize_t nr = ::read(fd, chunk, sizeof(chunk));
+    if (nr > 0) {
+      buf.append(chunk, nr);
+    } else if (nr < 0 && (errno == EINTR)) {
+      continue;
+    } else {
+      return (nr < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+    }
+  }
+}
+
+int Listen(std::string const &socket_path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Socket path " +
+                             socket_path + " is too long.");
+  }
+  std::strcpy(addr.sun_path, socket_path.c_str());
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to create socket: " +
+        std::string(std::strerror(errno)));
+  }
+  // a socket left behind by a daemon that died is replaced, a live one is not
+  if (std::filesystem::is_socket(socket_path)) {
+    if (!::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+      ::close(fd);
+      throw std::runtime_error("neutvect-converter: [ERROR]: A daemon is "
+                               "already listening on " +
+                               socket_path);
+    }
+    ::close(fd);
+    ::unlink(socket_path.c_str());
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  }
+  if ((fd < 0) ||
+      ::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) ||
+      ::listen(fd, 64)) {
+    std::string err = std::strerror(errno);
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    throw std::runtime_error("neutvect-converter: [ERROR]: Failed to listen on " +
+                             socket_path + ": " + err);
+  }
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  // so that accept can take every waiting connection without blocking
+  ::fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+
+// Claims up to nfree of the job files in spool_dir, in name order, by renaming
+// them to .running. Only as many are claimed as can be started straight away,
+// so that several daemons sharing a spool directory share its jobs, and a
+// daemon that is killed leaves the jobs it had not started for the others.
+void ScanSpool(std::string const &spool_dir, int nfree,
+               std::deque<Job> &queue) {
+  if (nfree < 1) {
+    return;
+  }
+  std::vector<std::filesystem::path> job_files;
+  std::error_code ec;
+  for (auto const &entry :
+       std::filesystem::directory_iterator(spool_dir, ec)) {
+    if (entry.path().extension() == ".job") {
+      job_files.push_back(entry.path());
+    }
+  }
+  std::sort(job_files.begin(), job_files.end());
+
+  for (auto const &job_file : job_files) {
+    if (nfree < 1) {
+      break;
+    }
+    Job job;
+    job.spool_base = (job_file.parent_path() / job_file.stem()).string();
+    if (std::rename(job_file.c_str(), (job.spool_base + ".running").c_str())) {
+      continue;
+    }
+    job.name = job_file.string();
+    std::ifstream fin(job.spool_base + ".running");
+    std::getline(fin, job.cwd);
+    std::string arg;
+    while (std::getline(fin, arg)) {
+      if (arg.size()) {
+        job.args.push_back(arg);
+      }
+    }
+    queue.push_back(std::move(job));
+    nfree--;
+  }
+}
+
+// other_fds are closed in the child, so that it does not keep open the
+// connections of the other jobs.
+pid_t StartJob(Job const &job, JobRunner const &run,
+               std::vector<int> const &other_fds) {
+  // anything still buffered would otherwise be written again by the child
+  std::cout.flush();
+  std::fflush(nullptr);
+
+  pid_t pid = ::fork();
+  if (pid) {
+    return pid;
+  }
+
+  std::signal(SIGINT, SIG_DFL);
+  std::signal(SIGTERM, SIG_DFL);
+  std::signal(SIGCHLD, SIG_DFL);
+  // a job whose submitter has gone away is stopped by its next write
+  std::signal(SIGPIPE, SIG_DFL);
+  for (int fd : other_fds) {
+    ::close(fd);
+  }
+  ::close(wake_pipe[0]);
+  ::close(wake_pipe[1]);
+
+  int out = (job.fd >= 0) ? job.fd
+                          : ::open((job.spool_base + ".log").c_str(),
+                                   O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out >= 0) {
+    ::dup2(out, STDOUT_FILENO);
+    ::dup2(out, STDERR_FILENO);
+  }
+
+  if (::chdir(job.cwd.c_str())) {
+    std::cout << "[ERROR]: Failed to change to the job's working directory "
+              << job.cwd << ": " << std::strerror(errno) << std::endl;
+    std::exit(1);
+  }
+
+  int rtn = 1;
+  try {
+    rtn = run(job.args);
+  } catch (std::exception const &ex) {
+    std::cout << ex.what() << std::endl;
+  }
+  std::cout.flush();
+  std::exit(rtn);
+}
+
+void FinishJob(Job const &job, int status) {
+  if (job.fd >= 0) {
+    std::string reply = std::string(1, '\0') + std::to_string(status) + "\n";
+    WriteAll(job.fd, reply.c_str(), reply.size());
+    ::close(job.fd);
+    return;
+  }
+  {
+    std::ofstream log(job.spool_base + ".log", std::ios::app);
+    log << "[INFO]: Job finished with exit status " << status << std::endl;
+  }
+  std::rename((job.spool_base + ".running").c_str(),
+              (job.spool_base + (status ? ".failed" : ".done")).c_str());
+}
+
+// Returns a job that was queued but never started to where it came from.
+void DropJob(Job const &job) {
+  if (job.fd >= 0) {
+    std::string reply = "[ERROR]: The daemon stopped before running the job.\n";
+    reply += std::string(1, '\0') + "1\n";
+    WriteAll(job.fd, reply.c_str(), reply.size());
+    ::close(job.fd);
+    return;
+  }
+  std::rename((job.spool_base + ".running").c_str(),
+              (job.spool_base + ".job").c_str());
+}
+
+int ExitStatus(int status) {
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+} // namespace
+
+void ServeJobs(DaemonOptions const &options, JobRunner const &run) {
+  int max_jobs = options.max_jobs;
+  if (max_jobs < 1) {
+    max_jobs = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  int listen_fd =
+      options.socket_path.size() ? Listen(options.socket_path) : -1;
+
+  if (::pipe(wake_pipe)) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to create pipe: " +
+        std::string(std::strerror(errno)));
+  }
+  ::fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+  ::fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+
+  struct sigaction sa {};
+  sa.sa_handler = OnStop;
+  ::sigaction(SIGINT, &sa, nullptr);
+  ::sigaction(SIGTERM, &sa, nullptr);
+  sa.sa_handler = OnChild;
+  sa.sa_flags = SA_NOCLDSTOP;
+  ::sigaction(SIGCHLD, &sa, nullptr);
+  // a submitter that has gone away must not stop the daemon
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::cout << "[INFO]: Serving up to " << max_jobs << " jobs at once";
+  if (listen_fd >= 0) {
+    std::cout << " on " << options.socket_path;
+  }
+  if (options.spool_dir.size()) {
+    std::cout << ((listen_fd >= 0) ? " and" : "") << " from "
+              << options.spool_dir;
+  }
+  std::cout << std::endl;
+
+  std::deque<Job> queue;
+  std::map<pid_t, Job> running;
+  // connections whose request has not all arrived yet, and what has. They are
+  // non-blocking and read as they become ready, so a client that stalls
+  // mid-request holds up no one else.
+  std::map<int, std::string> requests;
+  long njobs = 0;
+  double last_scan = -options.poll_interval;
+
+  // returns how many jobs finished
+  auto reap = [&](int flags) {
+    int nreaped = 0;
+    int status;
+    pid_t pid;
+    while ((pid = ::waitpid(-1, &status, flags)) > 0) {
+      auto found = running.find(pid);
+      if (found == running.end()) {
+        continue;
+      }
+      std::cout << "[INFO]: " << found->second.name
+                << " finished with exit status " << ExitStatus(status)
+                << std::endl;
+      FinishJob(found->second, ExitStatus(status));
+      running.erase(found);
+      nreaped++;
+    }
+    return nreaped;
+  };
+
+  while (!stop_requested) {
+    // the wake pipe, then the listening socket and the requests, if serving
+    // one
+    std::vector<pollfd> fds = {{wake_pipe[0], POLLIN, 0}};
+    if (listen_fd >= 0) {
+      fds.push_back({listen_fd, POLLIN, 0});
+    }
+    for (auto const &request : requests) {
+      fds.push_back({request.first, POLLIN, 0});
+    }
+    double timeout = options.spool_dir.size()
+                         ? std::max(0., last_scan + options.poll_interval -
+                                            WallTime())
+                         : -1;
+    int nready = ::poll(fds.data(), fds.size(),
+                        (timeout < 0) ? -1 : int(timeout * 1E3));
+
+    if (nready > 0) {
+      char drain[64];
+      while (::read(wake_pipe[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+
+    for (size_t i = 2; (nready > 0) && (i < fds.size()); ++i) {
+      if (!fds[i].revents) {
+        continue;
+      }
+      int fd = fds[i].fd;
+      Job job;
+      job.fd = fd;
+      if (!ReadAvailable(fd, requests[fd])) {
+        ::close(fd);
+        requests.erase(fd);
+      } else if (ParseRequest(requests[fd], job)) {
+        requests.erase(fd);
+        // the job writes its output to it with ordinary blocking writes
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        queue.push_back(std::move(job));
+      }
+    }
+
+    if ((nready > 0) && (listen_fd >= 0) && (fds[1].revents & POLLIN)) {
+      int fd;
+      while ((fd = ::accept(listen_fd, nullptr, nullptr)) >= 0) {
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        ::fcntl(fd, F_SETFL, O_NONBLOCK);
+        requests[fd];
+      }
+    }
+
+    // a finished job frees a slot for the next spool job straight away
+    bool freed = reap(WNOHANG);
+
+    if (options.spool_dir.size() &&
+        (freed || (WallTime() - last_scan >= options.poll_interval))) {
+      ScanSpool(options.spool_dir,
+                max_jobs - int(running.size()) - int(queue.size()), queue);
+      last_scan = WallTime();
+    }
+
+    while (queue.size() && (int(running.size()) < max_jobs)) {
+      Job job = std::move(queue.front());
+      queue.pop_front();
+      if (job.fd >= 0) {
+        job.name = "job " + std::to_string(njobs);
+      }
+      njobs++;
+      std::vector<int> other_fds = {listen_fd};
+      for (auto const &request : requests) {
+        other_fds.push_back(request.first);
+      }
+      for (auto const &other : queue) {
+        other_fds.push_back(other.fd);
+      }
+      for (auto const &other : running) {
+        other_fds.push_back(other.second.fd);
+      }
+      other_fds.erase(std::remove(other_fds.begin(), other_fds.end(), -1),
+                      other_fds.end());
+      pid_t pid = StartJob(job, run, other_fds);
+      if (pid < 0) {
+        std::cout << "[ERROR]: Failed to fork for " << job.name << ": "
+                  << std::strerror(errno) << std::endl;
+        FinishJob(job, 1);
+        continue;
+      }
+      std::cout << "[INFO]: Started " << job.name << " in " << job.cwd
+                << std::endl;
+      // only the child writes to a socket job until it has finished
+      running.emplace(pid, std::move(job));
+    }
+  }
+
+  std::cout << "[INFO]: Stopping, waiting for " << running.size()
+            << " running jobs." << std::endl;
+  if (listen_fd >= 0) {
+    ::close(listen_fd);
+    ::unlink(options.socket_path.c_str());
+  }
+  for (auto const &request : requests) {
+    ::close(request.first);
+  }
+  for (auto const &job : queue) {
+    DropJob(job);
+  }
+  while (running.size()) {
+    reap(0);
+  }
+  ::close(wake_pipe[0]);
+  ::close(wake_pipe[1]);
+}
+
+int SubmitJob(std::string const &socket_path,
+              std::vector<std::string> const &args, std::ostream &out) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Socket path " +
+                             socket_path + " is too long.");
+  }
+  std::strcpy(addr.sun_path, socket_path.c_str());
+
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((fd < 0) ||
+      ::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr))) {
+    std::string err = std::strerror(errno);
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to connect to daemon on " +
+        socket_path + ": " + err);
+  }
+
+  std::string request = std::filesystem::current_path().string();
+  request += '\0';
+  for (auto const &arg : args) {
+    request += arg;
+    request += '\0';
+  }
+  request += '\0';
+  if (!WriteAll(fd, request.c_str(), request.size())) {
+    ::close(fd);
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to send job to daemon on " +
+        socket_path);
+  }
+
+  // the output of the job is copied until the NUL before its exit status
+  bool finished = false;
+  std::string status;
+  char chunk[4096];
+  ssize_t nr;
+  while ((nr = ::read(fd, chunk, sizeof(chunk))) != 0) {
+    if (nr < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    char const *begin = chunk;
+    char const *end = chunk + nr;
+    char const *nul = finished ? begin : std::find(begin, end, '\0');
+    if (!finished) {
+      out.write(begin, nul - begin);
+      out.flush();
+      if (nul == end) {
+        continue;
+      }
+      finished = true;
+      nul++;
+    }
+    status.append(nul, end);
+    if (status.find('\n') != std::string::npos) {
+      break;
+    }
+  }
+  ::close(fd);
+
+  if (!finished || (status.find('\n') == std::string::npos)) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: The daemon on " +
+                             socket_path +
+                             " stopped before the job finished.");
+  }
+  return std::stoi(status);
+}
+
+} // namespace nvconv
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace nvconv {
+
+struct DaemonOptions {
+  // Unix socket that jobs are submitted to with SubmitJob, none if empty
+  std::string socket_path = "";
+  // Directory polled for job files, none if empty. A job file is named
+  // <name>.job and holds the working directory of the job on its first line
+  // and then one argument per line. It is renamed to <name>.running when it
+  // is picked up, which happens only once there is a free slot to run it in,
+  // and to <name>.done or <name>.failed once it has run, with its output in
+  // <name>.log.
+  std::string spool_dir = "";
+  // At most this many jobs run at once, one per hardware thread if 0. Others
+  // wait in the order they arrived.
+  int max_jobs = 0;
+  // How often spool_dir is checked for new jobs, in seconds
+  double poll_interval = 1;
+};
+
+// Runs a job, in the process forked for it, and returns its exit status.
+using JobRunner = std::function<int(std::vector<std::string> const &args)>;
+
+// Serves jobs from options.socket_path and options.spool_dir until SIGINT or
+// SIGTERM, after which the jobs that are running are waited for. Each job is
+// run by run in a child forked from the calling process, in the working
+// directory it was submitted from and with its stdout and stderr sent back to
+// the submitter or to its log, so that everything the calling process set up
+// before serving, such as loaded dictionaries and open caches, is not paid for
+// again by each job. The calling process must not have other threads running.
+// Throws std::runtime_error if the socket cannot be listened on.
+void ServeJobs(DaemonOptions const &options, JobRunner const &run);
+
+// Submits args to be run in the current working directory by the ServeJobs
+// listening on socket_path, copying the output of the job to out as it runs.
+// Returns the exit status of the job. Throws std::runtime_error if the daemon
+// cannot be reached or stops before the job has finished.
+int SubmitJob(std::string const &socket_path,
+              std::vector<std::string> const &args, std::ostream &out);
+
+} // namespace nvconv
@@ -1,26 +1,92 @@
 #include "nvfatxtools.h"
 
+#include "nvinputtools.h"
+#include "nvmetacache.h"
+
 #include "TChainElement.h"
 #include "TFile.h"
-
+#include "TROOT.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 namespace nvconv {
 
-bool isMono(TChain &chin, NeutVect *nv, Long64_t ntocheck) {
-  Long64_t ents = chin.GetEntries();
-  chin.GetEntry(0);
+std::vector<std::string> const FATXMembers = {"Totcrs", "PartInfo", "Npart",
+                                              "Nprimary"};
+
+namespace {
+
+// Reads only the FATXMembers of at most maxents entries from the split'th of
+// nsplits equal slices of the neuttree in fname, and calls fill with the beam
+// energy and total cross section of each until fill returns false. If align is
+// set, both ends of the slice are moved to cluster boundaries so that
+// neighbouring slices read disjoint baskets.
+template <typename F>
+void ReadFATXMembers(std::string const &fname, int split, int nsplits,
+                     Long64_t maxents, bool align, F &&fill) {
+  auto nv = std::make_unique<NeutVect>();
+  NeutVect *nv_addr = nv.get();
+
+  std::unique_ptr<TFile> fin(TFile::Open(fname.c_str(), "READ"));
+  if (!fin || !fin->IsOpen() || fin->IsZombie()) {
+    throw std::runtime_error("Failed to open file in chain: " + fname);
+  }
+  auto tree = fin->Get<TTree>("neuttree");
+  if (!tree) {
+    throw std::runtime_error("Failed to find neuttree in file in chain: " +
+                             fname);
+  }
+
+  tree->SetBranchAddress("vectorbranch", &nv_addr);
+  ActivateOnlyMembers(tree, FATXMembers);
 
-  double first_E = 0;
-  for (Long64_t i = 0; i < std::min(ntocheck, ents); ++i) {
-    chin.GetEntry(i);
-    if (!i) {
-      first_E = nv->PartInfo(0)->fP.E();
-    } else if (std::fabs(first_E - nv->PartInfo(0)->fP.E()) > 1E-6) {
-      return false;
+  Long64_t ents = tree->GetEntries();
+  Long64_t begin = (ents * split) / nsplits;
+  Long64_t end = (ents * (split + 1)) / nsplits;
+  end = begin + std::min(end - begin, maxents);
+  if (align) {
+    begin = AlignToCluster(tree, begin);
+    end = AlignToCluster(tree, end);
+  }
+
+  for (Long64_t i = begin; i < end; ++i) {
+    tree->GetEntry(i);
+    if (!fill(nv->PartInfo(0)->fP.E(), nv->Totcrs)) {
+      break;
     }
   }
-  return true;
+  fin->Close();
+}
+
+} // namespace
+
+bool isMono(TChain &chin, NeutVect *, Long64_t ntocheck) {
+  auto files = chin.GetListOfFiles();
+
+  Long64_t nchecked = 0;
+  double first_E = 0;
+  bool mono = true;
+  for (int fi = 0; (fi < files->GetEntries()) && mono && (nchecked < ntocheck);
+       ++fi) {
+    ReadFATXMembers(static_cast<TChainElement *>(files->At(fi))->GetTitle(), 0,
+                    1, ntocheck - nchecked, false, [&](double E, double) {
+                      if (!nchecked) {
+                        first_E = E;
+                      } else if (std::fabs(first_E - E) > 1E-6) {
+                        mono = false;
+                      }
+                      nchecked++;
+                      return mono;
+                    });
+  }
+  return mono;
 }
 
 std::unique_ptr<TH1> GetHistFromFile(std::string const &flux_file,
@@ -56,42 +122,113 @@ std::unique_ptr<TH1> GetHistFromFile(std::string const &flux_file,
   return fhc;
 }
 
-std::optional<double> GetFATXFromFluxHist(TChain &chin, NeutVect *nv,
-                                          std::unique_ptr<TH1> const &flux_hist,
-                                          bool flux_in_GeV) {
-
-  if (!flux_hist) {
-    return std::optional<double>();
-  }
-
-  std::unique_ptr<TH1> xsechisto(
-      static_cast<TH1 *>(flux_hist->Clone("xsechisto")));
+FATXAccumulator::FATXAccumulator(std::unique_ptr<TH1> const &flux_hist,
+                                 bool flux_in_GeV)
+    : flux_in_GeV(flux_in_GeV) {
+  xsechisto =
+      std::unique_ptr<TH1>(static_cast<TH1 *>(flux_hist->Clone("xsechisto")));
   xsechisto->SetDirectory(nullptr);
   xsechisto->Reset();
-  std::unique_ptr<TH1> entryhisto(
-      static_cast<TH1 *>(flux_hist->Clone("entryhisto")));
+  entryhisto =
+      std::unique_ptr<TH1>(static_cast<TH1 *>(flux_hist->Clone("entryhisto")));
   entryhisto->SetDirectory(nullptr);
   entryhisto->Reset();
+}
 
-  Long64_t ents = chin.GetEntries();
-  for (Long64_t i = 0; i < ents; ++i) {
-    chin.GetEntry(i);
-    double E_flux_units = nv->PartInfo(0)->fP.E() * (flux_in_GeV ? 1E-3 : 1);
-    xsechisto->Fill(E_flux_units, nv->Totcrs);
-    entryhisto->Fill(E_flux_units);
-  }
-
-  xsechisto->Divide(entryhisto.get());
+void FATXAccumulator::Add(FATXAccumulator const &other) {
+  xsechisto->Add(other.xsechisto.get());
+  entryhisto->Add(other.entryhisto.get());
+}
 
+double
+FATXAccumulator::GetFATX(std::unique_ptr<TH1> const &flux_hist) const {
   std::unique_ptr<TH1> ratehisto(
       static_cast<TH1 *>(xsechisto->Clone("ratehisto")));
   ratehisto->SetDirectory(nullptr);
 
+  ratehisto->Divide(entryhisto.get());
   ratehisto->Multiply(flux_hist.get());
 
-  double fatx = 1E-2 * (ratehisto->Integral() / flux_hist->Integral());
+  return 1E-2 * (ratehisto->Integral() / flux_hist->Integral());
+}
+
+std::optional<double> GetFATXFromFluxHist(TChain &chin, NeutVect *,
+                                          std::unique_ptr<TH1> const &flux_hist,
+                                          bool flux_in_GeV, int nthreads) {
+
+  if (!flux_hist) {
+    return std::optional<double>();
+  }
+
+  if (nthreads < 1) {
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // Split each file into enough pieces that there are a few tasks per thread,
+  // even for chains of only one or two large files.
+  auto files = chin.GetListOfFiles();
+  int nfiles = files->GetEntries();
+  int splits = std::max(1, (4 * nthreads + nfiles - 1) / std::max(1, nfiles));
+
+  struct Task {
+    std::string fname;
+    int split;
+    std::unique_ptr<FATXAccumulator> acc;
+  };
+  std::vector<Task> tasks;
+  for (int fi = 0; fi < nfiles; ++fi) {
+    for (int split = 0; split < splits; ++split) {
+      // the histograms are cloned up front as that touches ROOT's global
+      // directory
+      tasks.push_back(
+          {static_cast<TChainElement *>(files->At(fi))->GetTitle(), split,
+           std::make_unique<FATXAccumulator>(flux_hist, flux_in_GeV)});
+    }
+  }
+
+  ROOT::EnableThreadSafety();
+
+  std::atomic<size_t> next_task(0);
+  std::mutex error_mtx;
+  std::exception_ptr error = nullptr;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < std::min(nthreads, int(tasks.size())); ++t) {
+    threads.emplace_back([&]() {
+      for (size_t ti = next_task++; ti < tasks.size(); ti = next_task++) {
+        auto &task = tasks[ti];
+        try {
+          ReadFATXMembers(task.fname, task.split, splits,
+                          std::numeric_limits<Long64_t>::max(), true,
+                          [&](double E, double totcrs) {
+                            task.acc->Fill(E, totcrs);
+                            return true;
+                          });
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(error_mtx);
+          if (!error) {
+            error = std::current_exception();
+          }
+          next_task = tasks.size();
+        }
+      }
+    });
+  }
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
 
-  return fatx;
+  // merge in task order so that the result does not depend on scheduling
+  FATXAccumulator acc(flux_hist, flux_in_GeV);
+  for (auto const &task : tasks) {
+    acc.Add(*task.acc);
+  }
+
+  return acc.GetFATX(flux_hist);
 }
 
 std::pair<std::unique_ptr<TH1>, std::unique_ptr<TH1>>
@@ -146,4 +283,97 @@ GetFluxRateHistPairFromChain(TChain &chin) {
   return fluxrate;
 }
 
-} // namespace nvconv
\ No newline at end of file
+FATXInfo FindFATX(TChain &chin, NeutVect *nv, FATXOptions const &options) {
+
+  FATXInfo info;
+
+  std::vector<std::shared_ptr<FileMetadata const>> metadata;
+  if (options.metadata_cache) {
+    metadata = options.metadata_cache->Get(chin, options.nthreads);
+    // the first entry of the chain is in the first non-empty file
+    auto first = std::find_if(metadata.begin(), metadata.end(),
+                              [](auto const &meta) { return meta->nentries; });
+    if (first == metadata.end()) {
+      metadata.clear();
+    } else {
+      info.beam_pid = (*first)->beam_pid;
+      info.isMonoE = isMono(metadata);
+      if (info.isMonoE) {
+        info.fatx = (*first)->first_totcrs * 1E-2;
+      }
+    }
+  }
+  if (!metadata.size()) {
+    chin.GetEntries();
+    chin.GetEntry(0);
+    info.beam_pid = nv->PartInfo(0)->fPID;
+
+    info.isMonoE = isMono(chin, nv);
+    if (info.isMonoE) {
+      chin.GetEntry(0);
+      info.fatx = nv->Totcrs * 1E-2;
+    }
+  }
+
+  if (info.isMonoE) {
+    std::cout << "[INFO]: Calculated FATX from Totcrs for assumed "
+                 "mono-energetic file: "
+              << info.fatx << " pb/Nucleon" << std::endl;
+    return info;
+  } else {
+    std::cout
+        << "[INFO]: Not mono-energetic, so cannot infer FATX from first event."
+        << std::endl;
+  }
+
+  info.flux_hist = GetHistFromFile(options.flux_file, options.flux_histname);
+
+  // if we have a flux file then we can build it
+  if (info.flux_hist && (options.while_converting || options.per_target)) {
+    info.flux_energy_to_MeV = options.flux_in_GeV ? 1E3 : 1;
+    info.while_converting = true;
+    std::cout << "[INFO]: FATX will be calculated from the converted events "
+                 "and written when the output is closed."
+              << std::endl;
+    // placeholder until the conversion pass is finished
+    info.fatx = std::numeric_limits<double>::quiet_NaN();
+    return info;
+  } else if (info.flux_hist) {
+    auto fatx_opt = GetFATXFromFluxHist(chin, nv, info.flux_hist,
+                                        options.flux_in_GeV, options.nthreads);
+    if (fatx_opt) {
+      info.flux_energy_to_MeV = options.flux_in_GeV ? 1E3 : 1;
+      info.fatx = fatx_opt.value();
+      std::cout << "[INFO]: Calculated FATX from input file file as: "
+                << info.fatx << " pb/Nucleon" << std::endl;
+      return info;
+    }
+  }
+
+  auto frpair = metadata.size() ? GetFluxRateHistPair(metadata)
+                                : GetFluxRateHistPairFromChain(chin);
+  if (frpair.second && options.per_target) {
+    // the rate histogram sums over every target, so each target's FATX has to
+    // come from its own events
+    info.flux_hist = std::move(frpair.second);
+    info.while_converting = true;
+    info.fatx = std::numeric_limits<double>::quiet_NaN();
+    std::cout << "[INFO]: FATX of each target will be calculated from the "
+                 "flux histogram in the input file and its converted events."
+              << std::endl;
+  } else if (frpair.second) {
+    info.fatx =
+        1E-2 * (frpair.first->Integral() / frpair.second->Integral());
+    info.flux_hist = std::move(frpair.second);
+    std::cout
+        << "[INFO]: Calculated FATX from histograms in input file as: 1E-2 * "
+        << frpair.first->Integral() << "/" << info.flux_hist->Integral()
+        << " = " << info.fatx << " pb/Nucleon" << std::endl;
+  } else {
+    info.fatx = 1;
+  }
+
+  return info;
+}
+
+} // namespace nvconv
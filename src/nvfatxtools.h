@@ -7,19 +7,95 @@
 
 #include <memory>
 #include <optional>
+#include <string>
 #include <utility>
+#include <vector>
 
 namespace nvconv {
 
+class MetadataCache;
+
+// The members of NeutVect that the FATX pre-pass needs to read.
+extern std::vector<std::string> const FATXMembers;
+
 bool isMono(TChain &chin, NeutVect *nv, Long64_t ntocheck = 1000ll);
 
 std::unique_ptr<TH1> GetHistFromFile(std::string const &flux_file,
                                      std::string const &flux_histname);
+
+// Accumulates the mean NEUT total cross section in each bin of a flux
+// histogram, from which the flux-averaged total cross section follows.
+// Accumulators filled from different parts of the input can be combined with
+// Add.
+class FATXAccumulator {
+public:
+  FATXAccumulator(std::unique_ptr<TH1> const &flux_hist, bool flux_in_GeV);
+
+  void Fill(double E_MeV, double totcrs) {
+    double E_flux_units = E_MeV * (flux_in_GeV ? 1E-3 : 1);
+    xsechisto->Fill(E_flux_units, totcrs);
+    entryhisto->Fill(E_flux_units);
+  }
+
+  void Add(FATXAccumulator const &other);
+
+  double GetFATX(std::unique_ptr<TH1> const &flux_hist) const;
+
+private:
+  bool flux_in_GeV;
+  std::unique_ptr<TH1> xsechisto;
+  std::unique_ptr<TH1> entryhisto;
+};
+
+// Reads only the FATXMembers of the events in the chain, with the files, or
+// clusters of entries within them, spread over nthreads threads. If nthreads
+// is 0, all hardware threads are used.
 std::optional<double> GetFATXFromFluxHist(TChain &chin, NeutVect *nv,
                                           std::unique_ptr<TH1> const &flux_hist,
-                                          bool flux_in_GeV);
+                                          bool flux_in_GeV, int nthreads = 0);
 
 std::pair<std::unique_ptr<TH1>, std::unique_ptr<TH1>>
 GetFluxRateHistPairFromChain(TChain &chin);
 
+// Where FindFATX looks for the flux-averaged total cross section of a chain.
+struct FATXOptions {
+  // A flux histogram to average the NEUT total cross section over, otherwise
+  // the flux and rate histograms in the input files are used.
+  std::string flux_file = "";
+  std::string flux_histname = "";
+  bool flux_in_GeV = true;
+  // With flux_file, leave the FATX to be accumulated from the events as they
+  // are converted, rather than reading the input in a pre-pass.
+  bool while_converting = false;
+  // The events on each target are written to separate outputs, so the FATX of
+  // each has to be accumulated from its own events, even against the flux
+  // histogram in the input files.
+  bool per_target = false;
+  // Threads for the pre-pass, 0 for all hardware threads
+  int nthreads = 0;
+  // If set, the mono-energy check, the beam and the histograms of each input
+  // file are taken from the cache rather than read from the file.
+  MetadataCache *metadata_cache = nullptr;
+};
+
+// The flux-averaged total cross section of a chain, and what BuildRunInfo
+// needs alongside it.
+struct FATXInfo {
+  // In pb/Nucleon, or NaN if it is to be accumulated from the events against
+  // flux_hist while they are converted.
+  double fatx = 1;
+  bool while_converting = false;
+  std::unique_ptr<TH1> flux_hist = nullptr;
+  bool isMonoE = false;
+  int beam_pid = 0;
+  double flux_energy_to_MeV = 1E3;
+};
+
+// Finds the FATX of the events in chin, read through nv, the address of its
+// vectorbranch. Mono-energetic inputs take it from the Totcrs of the first
+// event. Otherwise it is averaged over the options.flux_file histogram if one
+// is given, else over the flux histogram in the input files, or is 1 if there
+// is none.
+FATXInfo FindFATX(TChain &chin, NeutVect *nv, FATXOptions const &options);
+
 } // namespace nvconv
\ No newline at end of file
@@ -0,0 +1,382 @@
+#include "nvgzip.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace nvconv {
+
+// windowBits for raw deflate, as the BGZF gzip header and trailer are written
+// by hand, and for inflate to accept either gzip or zlib streams.
+static int const RawWindowBits = -15;
+static int const AutoWindowBits = 15 + 32;
+
+// A BGZF block is a gzip member with an extra field holding its compressed
+// size, and is never larger than 64 KiB.
+static size_t const BGZFMaxBlockSize = 1 << 16;
+static size_t const BGZFHeaderSize = 18;
+static size_t const BGZFTrailerSize = 8;
+
+static unsigned char const BGZFHeader[BGZFHeaderSize] = {
+    0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0};
+
+// The empty block that bgzip writes at the end of a file
+static unsigned char const BGZFEOFBlock[] = {
+    0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C',
+    2,    0,    0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static void PutLE(unsigned char *buf, uint64_t value, int nbytes) {
+  for (int i = 0; i < nbytes; ++i) {
+    buf[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+static uint64_t GetLE(unsigned char const *buf, int nbytes) {
+  uint64_t value = 0;
+  for (int i = 0; i < nbytes; ++i) {
+    value |= uint64_t(buf[i]) << (8 * i);
+  }
+  return value;
+}
+
+static void InitDeflate(z_stream &zs, int level) {
+  std::memset(&zs, 0, sizeof(zs));
+  if (deflateInit2(&zs, level, Z_DEFLATED, RawWindowBits, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to initialize zlib deflate.");
+  }
+}
+
+// Compresses n <= MaxBlockSize bytes of data into one complete BGZF block in
+// out. Data that does not compress into a block is stored instead.
+static bool CompressBGZFBlock(z_stream &zs, char const *data, size_t n,
+                              std::vector<char> &out) {
+  out.resize(BGZFMaxBlockSize);
+  auto obuf = reinterpret_cast<unsigned char *>(out.data());
+
+  deflateReset(&zs);
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+  zs.avail_in = n;
+  zs.next_out = obuf + BGZFHeaderSize;
+  zs.avail_out = BGZFMaxBlockSize - BGZFHeaderSize - BGZFTrailerSize;
+  int rtn = deflate(&zs, Z_FINISH);
+
+  size_t ndeflated = 0;
+  if (rtn == Z_STREAM_END) {
+    ndeflated = zs.total_out;
+  } else if (rtn == Z_OK) {
+    // a single final stored deflate block
+    unsigned char *stored = obuf + BGZFHeaderSize;
+    stored[0] = 1;
+    PutLE(stored + 1, n, 2);
+    PutLE(stored + 3, ~n & 0xffff, 2);
+    std::memcpy(stored + 5, data, n);
+    ndeflated = n + 5;
+  } else {
+    return false;
+  }
+
+  size_t block_size = BGZFHeaderSize + ndeflated + BGZFTrailerSize;
+  std::memcpy(obuf, BGZFHeader, BGZFHeaderSize);
+  PutLE(obuf + 16, block_size - 1, 2);
+
+  unsigned char *trailer = obuf + BGZFHeaderSize + ndeflated;
+  PutLE(trailer, crc32(0, reinterpret_cast<Bytef const *>(data), n), 4);
+  PutLE(trailer + 4, n, 4);
+
+  out.resize(block_size);
+  return true;
+}
+
+bool IsGzipFile(std::string const &filename) {
+  std::ifstream fin(filename, std::ios::binary);
+  unsigned char magic[2] = {0, 0};
+  fin.read(reinterpret_cast<char *>(magic), 2);
+  return fin && (magic[0] == 0x1f) && (magic[1] == 0x8b);
+}
+
+std::pair<uint64_t, uint64_t> BlockIndex::Find(uint64_t uncompressed) const {
+  auto it = std::upper_bound(
+      blocks.begin(), blocks.end(), uncompressed,
+      [](uint64_t u, std::pair<uint64_t, uint64_t> const &block) {
+        return u < block.second;
+      });
+  return (it == blocks.begin()) ? std::pair<uint64_t, uint64_t>{0, 0}
+                                : *(it - 1);
+}
+
+bool BlockIndex::Write(std::string const &filename) const {
+  std::ofstream fout(filename, std::ios::binary);
+  unsigned char buf[16];
+  PutLE(buf, blocks.size(), 8);
+  fout.write(reinterpret_cast<char *>(buf), 8);
+  for (auto const &block : blocks) {
+    PutLE(buf, block.first, 8);
+    PutLE(buf + 8, block.second, 8);
+    fout.write(reinterpret_cast<char *>(buf), 16);
+  }
+  return fout.good();
+}
+
+bool BlockIndex::Read(std::string const &filename) {
+  blocks.clear();
+  std::ifstream fin(filename, std::ios::binary);
+  unsigned char buf[16];
+  if (!fin.read(reinterpret_cast<char *>(buf), 8)) {
+    return false;
+  }
+  uint64_t nblocks = GetLE(buf, 8);
+  for (uint64_t i = 0; i < nblocks; ++i) {
+    if (!fin.read(reinterpret_cast<char *>(buf), 16)) {
+      blocks.clear();
+      return false;
+    }
+    blocks.emplace_back(GetLE(buf, 8), GetLE(buf + 8, 8));
+  }
+  return true;
+}
+
+GzipBlockOutputBuf::GzipBlockOutputBuf(std::streambuf *sink, int nthreads,
+                                       int level)
+    : sink(sink), level(level), finished(false), ok(true),
+      block(MaxBlockSize), compressed_written(0), uncompressed_written(0),
+      uncompressed_submitted(0),
+      jobs(2 * std::max(nthreads, 1)) {
+  InitDeflate(zs, level);
+  setp(block.data(), block.data() + block.size());
+
+  for (int t = 0; t < nthreads; ++t) {
+    workers.emplace_back([this]() {
+      z_stream wzs;
+      InitDeflate(wzs, this->level);
+      while (auto job = jobs.Pop()) {
+        auto &j = **job;
+        j.ok = CompressBGZFBlock(wzs, j.data.data(), j.data.size(),
+                                 j.compressed);
+        j.done.set_value();
+      }
+      deflateEnd(&wzs);
+    });
+  }
+}
+
+GzipBlockOutputBuf::~GzipBlockOutputBuf() {
+  jobs.Close();
+  for (auto &w : workers) {
+    w.join();
+  }
+  deflateEnd(&zs);
+}
+
+uint64_t GzipBlockOutputBuf::Tell() const {
+  return uncompressed_submitted + (pptr() - pbase());
+}
+
+// Writes a compressed block holding nbytes of the uncompressed stream
+bool GzipBlockOutputBuf::WriteCompressed(std::vector<char> const &cblock,
+                                         size_t nbytes) {
+  // the first block is at (0, 0) and is not listed
+  if (compressed_written) {
+    index.blocks.emplace_back(compressed_written, uncompressed_written);
+  }
+  std::streamsize n = cblock.size();
+  if (sink->sputn(cblock.data(), n) != n) {
+    ok = false;
+  }
+  compressed_written += n;
+  uncompressed_written += nbytes;
+  return ok;
+}
+
+bool GzipBlockOutputBuf::WriteNextBlock() {
+  auto &[job, done] = pending.front();
+  done.wait();
+  if (!job->ok) {
+    ok = false;
+  }
+  WriteCompressed(job->compressed, job->data.size());
+  pending.pop_front();
+  return ok;
+}
+
+bool GzipBlockOutputBuf::SubmitBlock() {
+  size_t nbytes = pptr() - pbase();
+  if (!nbytes) {
+    return ok;
+  }
+
+  if (workers.empty()) {
+    if (!CompressBGZFBlock(zs, pbase(), nbytes, compressed)) {
+      ok = false;
+    }
+    WriteCompressed(compressed, nbytes);
+  } else {
+    auto job = std::make_shared<Job>();
+    job->data.assign(pbase(), pptr());
+    pending.emplace_back(job, job->done.get_future());
+    jobs.Push(job);
+    // keep at most two blocks per worker in memory
+    while (pending.size() > 2 * workers.size()) {
+      WriteNextBlock();
+    }
+  }
+
+  uncompressed_submitted += nbytes;
+  setp(block.data(), block.data() + block.size());
+  return ok;
+}
+
+GzipBlockOutputBuf::int_type GzipBlockOutputBuf::overflow(int_type c) {
+  if (finished || !SubmitBlock()) {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize GzipBlockOutputBuf::xsputn(char const *s, std::streamsize n) {
+  std::streamsize written = 0;
+  while (!finished && (written < n)) {
+    std::streamsize space = epptr() - pptr();
+    if (!space) {
+      if (!SubmitBlock()) {
+        break;
+      }
+      continue;
+    }
+    std::streamsize chunk = std::min(space, n - written);
+    std::memcpy(pptr(), s + written, chunk);
+    pbump(int(chunk));
+    written += chunk;
+  }
+  return written;
+}
+
+int GzipBlockOutputBuf::sync() { return ok ? 0 : -1; }
+
+bool GzipBlockOutputBuf::Finish() {
+  if (finished) {
+    return ok;
+  }
+  SubmitBlock();
+  while (!pending.empty()) {
+    WriteNextBlock();
+  }
+  jobs.Close();
+  for (auto &w : workers) {
+    w.join();
+  }
+  workers.clear();
+
+  WriteCompressed(
+      std::vector<char>(std::begin(BGZFEOFBlock), std::end(BGZFEOFBlock)), 0);
+  if (sink->pubsync()) {
+    ok = false;
+  }
+  finished = true;
+  setp(nullptr, nullptr);
+  return ok;
+}
+
+GzipInputBuf::GzipInputBuf(std::streambuf *source, size_t buffer_size)
+    : source(source), in(buffer_size), out(buffer_size), ok(true),
+      out_offset(0) {
+  std::memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, AutoWindowBits) != Z_OK) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to initialize zlib inflate.");
+  }
+}
+
+GzipInputBuf::~GzipInputBuf() { inflateEnd(&zs); }
+
+GzipInputBuf::int_type GzipInputBuf::underflow() {
+  if (gptr() < egptr()) {
+    return traits_type::to_int_type(*gptr());
+  }
+  out_offset += egptr() - eback();
+  setg(out.data(), out.data(), out.data());
+
+  while (ok) {
+    if (!zs.avail_in) {
+      std::streamsize nread = source->sgetn(in.data(), in.size());
+      if (nread <= 0) {
+        return traits_type::eof();
+      }
+      zs.next_in = reinterpret_cast<Bytef *>(in.data());
+      zs.avail_in = nread;
+    }
+
+    zs.next_out = reinterpret_cast<Bytef *>(out.data());
+    zs.avail_out = out.size();
+    int rtn = inflate(&zs, Z_NO_FLUSH);
+    if (rtn == Z_STREAM_END) {
+      // the next gzip member, if any, starts straight after this one
+      inflateReset(&zs);
+    } else if ((rtn != Z_OK) && (rtn != Z_BUF_ERROR)) {
+      ok = false;
+    }
+
+    size_t nout = out.size() - zs.avail_out;
+    if (nout) {
+      setg(out.data(), out.data(), out.data() + nout);
+      return traits_type::to_int_type(*gptr());
+    }
+  }
+  return traits_type::eof();
+}
+
+GzipInputBuf::pos_type GzipInputBuf::seekoff(off_type off,
+                                             std::ios_base::seekdir dir,
+                                             std::ios_base::openmode which) {
+  uint64_t current = out_offset + (gptr() - eback());
+  if (dir == std::ios_base::cur) {
+    if (!off) {
+      return pos_type(off_type(current));
+    }
+    return seekpos(pos_type(off_type(current) + off), which);
+  } else if (dir == std::ios_base::beg) {
+    return seekpos(pos_type(off), which);
+  }
+  return pos_type(off_type(-1));
+}
+
+GzipInputBuf::pos_type GzipInputBuf::seekpos(pos_type pos,
+                                             std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in) || (off_type(pos) < 0)) {
+    return pos_type(off_type(-1));
+  }
+
+  uint64_t target = off_type(pos);
+  auto start = index.Find(target);
+  if (source->pubseekpos(start.first, std::ios_base::in) !=
+      pos_type(off_type(start.first))) {
+    return pos_type(off_type(-1));
+  }
+
+  inflateReset(&zs);
+  zs.avail_in = 0;
+  ok = true;
+  out_offset = start.second;
+  setg(out.data(), out.data(), out.data());
+
+  // decompress up to the target within the block
+  uint64_t skip = target - start.second;
+  while (skip) {
+    if ((gptr() == egptr()) &&
+        traits_type::eq_int_type(underflow(), traits_type::eof())) {
+      return pos_type(off_type(-1));
+    }
+    uint64_t n = std::min(skip, uint64_t(egptr() - gptr()));
+    gbump(int(n));
+    skip -= n;
+  }
+  return pos;
+}
+
+} // namespace nvconv
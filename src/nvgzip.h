@@ -0,0 +1,139 @@
+#pragma once
+
+#include "nvpipeline.h"
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace nvconv {
+
+// Returns true if filename starts with the gzip magic number.
+bool IsGzipFile(std::string const &filename);
+
+// The (compressed, uncompressed) offsets of the start of every block after the
+// first in a BGZF file, as stored in the .gzi files written by bgzip -i.
+struct BlockIndex {
+  std::vector<std::pair<uint64_t, uint64_t>> blocks;
+
+  // Returns the offsets of the start of the block holding the uncompressed
+  // offset.
+  std::pair<uint64_t, uint64_t> Find(uint64_t uncompressed) const;
+
+  bool Write(std::string const &filename) const;
+  // Returns false if filename does not exist or cannot be read.
+  bool Read(std::string const &filename);
+};
+
+// A stream buffer that writes to sink in the BGZF framing used by bgzip and
+// htslib: a series of independent gzip members, each holding at most
+// MaxBlockSize bytes of the uncompressed stream and recording its own
+// compressed size, followed by an empty end-of-file member. The file is still
+// a standard gzip file that gunzip and zlib read as one stream.
+//
+// With nthreads > 0, full blocks are compressed on that many worker threads
+// while the next block is filled, and are written to sink in order.
+//
+// Flushing the stream does not end the current block, so that the blocks stay
+// large enough to compress well; only Finish does.
+class GzipBlockOutputBuf : public std::streambuf {
+public:
+  // The largest uncompressed block that is guaranteed to compress to no more
+  // than 64 KiB, as in BGZF.
+  static size_t const MaxBlockSize = 65280;
+
+  GzipBlockOutputBuf(std::streambuf *sink, int nthreads = 0,
+                     int level = Z_DEFAULT_COMPRESSION);
+  ~GzipBlockOutputBuf();
+
+  // The number of uncompressed bytes written so far.
+  uint64_t Tell() const;
+  // The offsets of the blocks written so far. Complete once Finish returns.
+  BlockIndex const &Index() const { return index; }
+
+  // Compresses and writes any data still buffered and the end-of-file block,
+  // and stops the worker threads. Returns false if anything failed to be
+  // written.
+  bool Finish();
+
+protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(char const *s, std::streamsize n) override;
+  int sync() override;
+
+private:
+  struct Job {
+    std::vector<char> data;
+    std::vector<char> compressed;
+    bool ok;
+    std::promise<void> done;
+  };
+
+  bool SubmitBlock();
+  bool WriteNextBlock();
+  bool WriteCompressed(std::vector<char> const &cblock, size_t nbytes);
+
+  std::streambuf *sink;
+  int level;
+  bool finished;
+  bool ok;
+
+  // the block being filled
+  std::vector<char> block;
+  // used to compress on this thread when there are no workers
+  z_stream zs;
+  std::vector<char> compressed;
+
+  uint64_t compressed_written;
+  uint64_t uncompressed_written;
+  uint64_t uncompressed_submitted;
+  BlockIndex index;
+
+  std::vector<std::thread> workers;
+  BoundedQueue<std::shared_ptr<Job>> jobs;
+  // submitted blocks, in the order they are written
+  std::deque<std::pair<std::shared_ptr<Job>, std::future<void>>> pending;
+};
+
+// A stream buffer that decompresses a gzip stream read from source, including
+// streams of several concatenated gzip members.
+//
+// If the source is seekable, the stream can be positioned with seekg to any
+// uncompressed offset. Decompression restarts from the block found in index,
+// or from the start of the stream if there is no index.
+class GzipInputBuf : public std::streambuf {
+public:
+  GzipInputBuf(std::streambuf *source, size_t buffer_size = 1 << 16);
+  ~GzipInputBuf();
+
+  void SetIndex(BlockIndex idx) { index = std::move(idx); }
+
+  bool Failed() const { return !ok; }
+
+protected:
+  int_type underflow() override;
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+private:
+  std::streambuf *source;
+  std::vector<char> in;
+  std::vector<char> out;
+  z_stream zs;
+  bool ok;
+
+  BlockIndex index;
+  // the uncompressed offset of the start of the get area
+  uint64_t out_offset;
+};
+
+} // namespace nvconv
@@ -0,0 +1,109 @@
+#include "nvheadertools.h"
+
+#include "HepMC3/Attribute.h"
+#include "HepMC3/WriterAscii.h"
+
+#include <cstdio>
+#include <fstream>
+
+namespace nvconv {
+
+static std::string const FATXAttributeName =
+    "NuHepMC.FluxAveragedTotalCrossSection";
+static std::string const NEventsAttributeName = "NuHepMC.Exposure.NEvents";
+
+// wide enough for any double printed with %.16e
+static int const PatchableFieldWidth = 32;
+
+static std::string FormatPatchable(double val) {
+  char buf[PatchableFieldWidth + 1];
+  std::snprintf(buf, sizeof(buf), "%-*.16e", PatchableFieldWidth, val);
+  return buf;
+}
+
+static std::string FormatPatchable(long val) {
+  char buf[PatchableFieldWidth + 1];
+  std::snprintf(buf, sizeof(buf), "%-*ld", PatchableFieldWidth, val);
+  return buf;
+}
+
+// Always formats to PatchableFieldWidth characters, padded with trailing
+// spaces which DoubleAttribute::from_string ignores when the file is read.
+class PatchableDoubleAttribute : public HepMC3::DoubleAttribute {
+public:
+  PatchableDoubleAttribute(double val) : HepMC3::DoubleAttribute(val) {}
+
+  bool to_string(std::string &att) const override {
+    att = FormatPatchable(value());
+    return true;
+  }
+};
+
+// As PatchableDoubleAttribute, IntAttribute::from_string also ignores the
+// padding.
+class PatchableIntAttribute : public HepMC3::IntAttribute {
+public:
+  PatchableIntAttribute(int val) : HepMC3::IntAttribute(val) {}
+
+  bool to_string(std::string &att) const override {
+    att = FormatPatchable(long(value()));
+    return true;
+  }
+};
+
+// Overwrites the value of the patchable run info attribute name in the header
+// of filename with value, which must be PatchableFieldWidth characters.
+static bool PatchAttribute(std::string const &filename, std::string const &name,
+                           std::string const &value) {
+  std::fstream fs(filename, std::ios::in | std::ios::out | std::ios::binary);
+  if (!fs.is_open()) {
+    return false;
+  }
+
+  std::string const prefix = "A " + name + " ";
+
+  std::string line;
+  std::streamoff line_start = fs.tellg();
+  while (std::getline(fs, line)) {
+    if (!line.compare(0, 2, "E ")) { // run info is only before the first event
+      return false;
+    }
+    if (!line.compare(0, prefix.size(), prefix) &&
+        ((line.size() - prefix.size()) == PatchableFieldWidth)) {
+      fs.seekp(line_start + std::streamoff(prefix.size()));
+      fs << value;
+      return bool(fs);
+    }
+    line_start = fs.tellg();
+  }
+  return false;
+}
+
+void SetPatchableFluxAveragedTotalXSec(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                                       double fatx) {
+  gri->add_attribute(FATXAttributeName,
+                     std::make_shared<PatchableDoubleAttribute>(fatx));
+}
+
+bool PatchFluxAveragedTotalXSec(std::string const &filename, double fatx) {
+  return PatchAttribute(filename, FATXAttributeName, FormatPatchable(fatx));
+}
+
+void SetPatchableExposureNEvents(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                                 long nevents) {
+  gri->add_attribute(NEventsAttributeName,
+                     std::make_shared<PatchableIntAttribute>(int(nevents)));
+}
+
+bool PatchExposureNEvents(std::string const &filename, long nevents) {
+  return PatchAttribute(filename, NEventsAttributeName,
+                        FormatPatchable(nevents));
+}
+
+void WriteRunInfoSidecar(std::string const &filename,
+                         std::shared_ptr<HepMC3::GenRunInfo> gri) {
+  HepMC3::WriterAscii sidecar(filename, gri);
+  sidecar.close();
+}
+
+} // namespace nvconv
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "HepMC3/GenRunInfo.h"
+
+#include <memory>
+#include <string>
+
+namespace nvconv {
+
+// Sets the G.C.2 flux-averaged total cross section on gri as a fixed-width
+// field, so that it can be overwritten in place in a file that has already
+// been written, once the final value is known.
+void SetPatchableFluxAveragedTotalXSec(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                                       double fatx);
+
+// Overwrites the patchable G.C.2 value in the header of an uncompressed
+// HepMC3 ASCII file. Returns false if the file has no patchable G.C.2 field.
+bool PatchFluxAveragedTotalXSec(std::string const &filename, double fatx);
+
+// Sets the G.C.3 NuHepMC.Exposure.NEvents count on gri as a fixed-width field,
+// for files whose number of events is only known once they are written.
+void SetPatchableExposureNEvents(std::shared_ptr<HepMC3::GenRunInfo> gri,
+                                 long nevents);
+
+// Overwrites the patchable NuHepMC.Exposure.NEvents value in the header of an
+// uncompressed HepMC3 ASCII file. Returns false if the file has no patchable
+// NEvents field.
+bool PatchExposureNEvents(std::string const &filename, long nevents);
+
+// Writes a HepMC3 ASCII file containing only the run info, for output formats
+// whose header cannot be patched after the events have been written.
+void WriteRunInfoSidecar(std::string const &filename,
+                         std::shared_ptr<HepMC3::GenRunInfo> gri);
+
+} // namespace nvconv
@@ -0,0 +1,263 @@
+#include "nvindex.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace nvconv {
+
+// File layout, little-endian: the magic number, a uint32 version, a uint32
+// number of input file names, each as a uint32 length and the characters, a
+// uint64 number of events and then the fields of each EventIndexEntry in
+// order. The number of events is UnfinishedEventIndex until the writer closes
+// the file.
+static char const EventIndexMagic[4] = {'N', 'V', 'I', 'X'};
+static uint32_t const EventIndexVersion = 2;
+static uint64_t const UnfinishedEventIndex = ~uint64_t(0);
+
+static void WriteLE(std::ostream &os, uint64_t value, int nbytes) {
+  char buf[8];
+  for (int i = 0; i < nbytes; ++i) {
+    buf[i] = (value >> (8 * i)) & 0xff;
+  }
+  os.write(buf, nbytes);
+}
+
+template <typename T> static bool ReadLE(std::istream &is, T &value) {
+  unsigned char buf[sizeof(T)];
+  if (!is.read(reinterpret_cast<char *>(buf), sizeof(T))) {
+    return false;
+  }
+  uint64_t uvalue = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    uvalue |= uint64_t(buf[i]) << (8 * i);
+  }
+  value = T(uvalue);
+  return true;
+}
+
+uint32_t EventIndex::Checksum(char const *data, size_t n, uint32_t crc) {
+  // zlib takes the length as a uInt, so feed it in chunks that fit
+  while (n) {
+    uInt chunk = uInt(std::min(n, size_t(1) << 30));
+    crc = crc32(crc, reinterpret_cast<Bytef const *>(data), chunk);
+    data += chunk;
+    n -= chunk;
+  }
+  return crc;
+}
+
+std::optional<size_t> EventIndex::FindEvent(int64_t evtno) const {
+  if (entries.empty()) {
+    return std::nullopt;
+  }
+
+  int64_t guess = evtno - entries.front().evtno;
+  if ((guess >= 0) && (size_t(guess) < entries.size()) &&
+      (entries[guess].evtno == evtno)) {
+    return size_t(guess);
+  }
+
+  auto it = std::lower_bound(
+      entries.begin(), entries.end(), evtno,
+      [](EventIndexEntry const &e, int64_t n) { return e.evtno < n; });
+  if ((it == entries.end()) || (it->evtno != evtno)) {
+    return std::nullopt;
+  }
+  return size_t(it - entries.begin());
+}
+
+std::optional<size_t> EventIndex::FindEntry(std::string const &file_name,
+                                            int64_t fentry) const {
+  auto name_it = std::find(file_names.begin(), file_names.end(), file_name);
+  if (name_it == file_names.end()) {
+    return std::nullopt;
+  }
+  int32_t ifile = int32_t(name_it - file_names.begin());
+
+  // events are written in input order, so are sorted by (ifile, fentry)
+  auto it = std::lower_bound(entries.begin(), entries.end(),
+                             std::make_pair(ifile, fentry),
+                             [](EventIndexEntry const &e,
+                                std::pair<int32_t, int64_t> const &key) {
+                               return std::make_pair(e.ifile, e.fentry) < key;
+                             });
+  if ((it == entries.end()) || (it->ifile != ifile) || (it->fentry != fentry)) {
+    return std::nullopt;
+  }
+  return size_t(it - entries.begin());
+}
+
+std::vector<std::pair<size_t, size_t>>
+EventIndex::Partition(size_t nparts) const {
+  std::vector<std::pair<size_t, size_t>> parts;
+  for (size_t p = 0; p < nparts; ++p) {
+    parts.emplace_back((entries.size() * p) / nparts,
+                       (entries.size() * (p + 1)) / nparts);
+  }
+  return parts;
+}
+
+static size_t const EventIndexEntrySize = 8 + 4 + 4 + 8 + 4 + 8;
+
+static void WriteEntry(std::ostream &os, EventIndexEntry const &e) {
+  WriteLE(os, e.offset, 8);
+  WriteLE(os, e.length, 4);
+  WriteLE(os, e.checksum, 4);
+  WriteLE(os, e.evtno, 8);
+  WriteLE(os, e.ifile, 4);
+  WriteLE(os, e.fentry, 8);
+}
+
+static bool ReadEntry(std::istream &is, EventIndexEntry &e) {
+  return ReadLE(is, e.offset) && ReadLE(is, e.length) &&
+         ReadLE(is, e.checksum) && ReadLE(is, e.evtno) && ReadLE(is, e.ifile) &&
+         ReadLE(is, e.fentry);
+}
+
+// Everything before the number of events
+static void WriteHeader(std::ostream &os,
+                        std::vector<std::string> const &file_names) {
+  os.write(EventIndexMagic, sizeof(EventIndexMagic));
+  WriteLE(os, EventIndexVersion, 4);
+
+  WriteLE(os, file_names.size(), 4);
+  for (auto const &name : file_names) {
+    WriteLE(os, name.size(), 4);
+    os.write(name.data(), name.size());
+  }
+}
+
+static bool ReadHeader(std::istream &is, std::vector<std::string> &file_names) {
+  char magic[sizeof(EventIndexMagic)];
+  uint32_t version = 0, nfiles = 0;
+  if (!is.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, EventIndexMagic, sizeof(magic)) ||
+      !ReadLE(is, version) || (version != EventIndexVersion) ||
+      !ReadLE(is, nfiles)) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < nfiles; ++i) {
+    uint32_t len = 0;
+    if (!ReadLE(is, len)) {
+      return false;
+    }
+    std::string name(len, '\0');
+    if (!is.read(&name[0], len)) {
+      return false;
+    }
+    file_names.push_back(name);
+  }
+  return true;
+}
+
+bool EventIndex::Write(std::string const &filename) const {
+  EventIndexWriter writer;
+  if (!writer.Open(filename, file_names)) {
+    return false;
+  }
+  for (auto const &e : entries) {
+    writer.Add(e);
+  }
+  return writer.Close();
+}
+
+bool EventIndex::Read(std::string const &filename) {
+  file_names.clear();
+  entries.clear();
+  std::ifstream fin(filename, std::ios::binary);
+
+  uint64_t nevents = 0;
+  if (!ReadHeader(fin, file_names) || !ReadLE(fin, nevents) ||
+      (nevents == UnfinishedEventIndex)) {
+    return false;
+  }
+  entries.resize(nevents);
+  for (auto &e : entries) {
+    if (!ReadEntry(fin, e)) {
+      entries.clear();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool EventIndexWriter::Open(std::string const &filename,
+                            std::vector<std::string> const &file_names,
+                            size_t n) {
+  this->filename = filename;
+  nentries = 0;
+  if (!n) {
+    fout.open(filename, std::ios::binary | std::ios::trunc);
+    WriteHeader(fout, file_names);
+    nentries_pos = fout.tellp();
+    WriteLE(fout, UnfinishedEventIndex, 8);
+    return fout.good();
+  }
+
+  std::ifstream fin(filename, std::ios::binary);
+  std::vector<std::string> index_file_names;
+  if (!ReadHeader(fin, index_file_names) ||
+      (index_file_names != file_names)) {
+    return false;
+  }
+  nentries_pos = fin.tellg();
+  fin.close();
+
+  uintmax_t size = nentries_pos + 8 + n * EventIndexEntrySize;
+  std::error_code ec;
+  if (std::filesystem::file_size(filename, ec) < size) {
+    return false;
+  }
+  std::filesystem::resize_file(filename, size, ec);
+  if (ec) {
+    return false;
+  }
+  // in and out, so that the file is not truncated
+  fout.open(filename, std::ios::binary | std::ios::in | std::ios::out);
+  fout.seekp(0, std::ios::end);
+  nentries = n;
+  return fout.good();
+}
+
+void EventIndexWriter::Add(EventIndexEntry const &entry) {
+  WriteEntry(fout, entry);
+  nentries++;
+}
+
+bool EventIndexWriter::Flush() {
+  fout.flush();
+  return fout.good() && SyncFile(filename);
+}
+
+bool EventIndexWriter::Close() {
+  if (!fout.is_open()) {
+    return true;
+  }
+  fout.seekp(nentries_pos);
+  WriteLE(fout, nentries, 8);
+  fout.close();
+  return !fout.fail();
+}
+
+bool SyncFile(std::string const &filename, bool directory) {
+  int fd = ::open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool synced = !::fsync(fd);
+  ::close(fd);
+  if (synced && directory) {
+    auto dir = std::filesystem::path(filename).parent_path();
+    return SyncFile(dir.empty() ? "." : dir.string());
+  }
+  return synced;
+}
+
+} // namespace nvconv
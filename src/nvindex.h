@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nvconv {
+
+// Where one event is in an output file and which input entry it came from.
+struct EventIndexEntry {
+  // For compressed files, the offset is into the uncompressed stream
+  uint64_t offset = 0;
+  uint32_t length = 0;
+  // The CRC-32 of the length bytes of the event
+  uint32_t checksum = 0;
+
+  int64_t evtno = 0;
+  // Indexes EventIndex::FileNames, as the ifile.index event attribute
+  int32_t ifile = 0;
+  int64_t fentry = 0;
+};
+
+// An index of the events in an output file, in the order they were written,
+// so that readers can go straight to any event, split a file between workers
+// and check events without parsing the file.
+class EventIndex {
+public:
+  // The index file written next to output
+  static std::string FileName(std::string const &output) {
+    return output + ".idx";
+  }
+
+  // The CRC-32 of n bytes of data, continuing from crc
+  static uint32_t Checksum(char const *data, size_t n, uint32_t crc = 0);
+  static uint32_t Checksum(std::string const &data) {
+    return Checksum(data.data(), data.size());
+  }
+
+  // The input files, as in the ifile.name.<n> run info attributes
+  void SetFileNames(std::vector<std::string> names) {
+    file_names = std::move(names);
+  }
+  std::vector<std::string> const &FileNames() const { return file_names; }
+
+  void Add(EventIndexEntry const &entry) { entries.push_back(entry); }
+
+  size_t size() const { return entries.size(); }
+  EventIndexEntry const &operator[](size_t n) const { return entries[n]; }
+
+  // The position of the event with event number evtno. Constant time if the
+  // event numbers are consecutive, as they are in converter output.
+  std::optional<size_t> FindEvent(int64_t evtno) const;
+  // The position of the event read from entry fentry of the input file
+  // file_name.
+  std::optional<size_t> FindEntry(std::string const &file_name,
+                                  int64_t fentry) const;
+
+  // Splits the events into nparts consecutive [begin, end) ranges of
+  // positions, which differ in size by at most one.
+  std::vector<std::pair<size_t, size_t>> Partition(size_t nparts) const;
+
+  bool Write(std::string const &filename) const;
+  // Returns false if filename does not exist, is not an event index or was not
+  // closed by the EventIndexWriter writing it.
+  bool Read(std::string const &filename);
+
+private:
+  std::vector<std::string> file_names;
+  std::vector<EventIndexEntry> entries;
+};
+
+// Writes an event index file as the events are written, so that its entries
+// are not kept in memory. The event count in the header is only filled in by
+// Close, so EventIndex::Read rejects a file that is still being written or
+// whose writer died. Such a file can be reopened to carry on from a checkpoint.
+class EventIndexWriter {
+public:
+  // Starts filename for events read from the input files file_names. With
+  // n > 0, reopens the filename of an interrupted conversion instead, keeping
+  // its first n entries and discarding any after them. Returns false if
+  // filename cannot be written or, with n > 0, was written for other input
+  // files or has fewer than n entries.
+  bool Open(std::string const &filename,
+            std::vector<std::string> const &file_names, size_t n = 0);
+  bool IsOpen() const { return fout.is_open(); }
+
+  void Add(EventIndexEntry const &entry);
+  size_t size() const { return nentries; }
+
+  // Makes sure the entries added so far are in the file and on disk.
+  bool Flush();
+  // Writes the event count into the header and closes the file. Does nothing
+  // if the file is not open.
+  bool Close();
+
+private:
+  std::string filename;
+  std::ofstream fout;
+  // where the event count goes in the header
+  std::streamoff nentries_pos = 0;
+  size_t nentries = 0;
+};
+
+// Makes sure that what has been written to filename is on disk rather than
+// only in the OS's cache, so that it survives the machine going down, not
+// only the process. With directory, also syncs the directory that holds
+// filename, which makes a new or renamed file last too. Returns false if
+// either cannot be synced.
+bool SyncFile(std::string const &filename, bool directory = false);
+
+} // namespace nvconv
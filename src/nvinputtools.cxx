@@ -0,0 +1,229 @@
+#include "nvinputtools.h"
+
+#include "TBranch.h"
+#include "TEnv.h"
+#include "TFile.h"
+#include "TObjArray.h"
+#include "TTreeCache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <glob.h>
+
+namespace nvconv {
+
+// Appends the files that path stands for to files
+static void ExpandInputPath(std::string const &path,
+                            std::vector<std::string> &files) {
+  if (path.find("://") != std::string::npos) {
+    files.push_back(path);
+    return;
+  }
+
+  if (std::filesystem::is_directory(path)) {
+    std::vector<std::string> found;
+    for (auto const &entry : std::filesystem::directory_iterator(path)) {
+      if (entry.is_regular_file() && (entry.path().extension() == ".root")) {
+        found.push_back(entry.path().string());
+      }
+    }
+    if (!found.size()) {
+      throw std::runtime_error(
+          "neutvect-converter: [ERROR]: Found no .root files in input "
+          "directory: " +
+          path);
+    }
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+    return;
+  }
+
+  if (path.find_first_of("*?[") == std::string::npos) {
+    files.push_back(path);
+    return;
+  }
+
+  // glob sorts its matches
+  glob_t matches;
+  int rtn = ::glob(path.c_str(), 0, nullptr, &matches);
+  if (rtn == 0) {
+    for (size_t i = 0; i < matches.gl_pathc; ++i) {
+      files.push_back(matches.gl_pathv[i]);
+    }
+  }
+  globfree(&matches);
+  if (rtn != 0) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Found no input files matching: " + path);
+  }
+}
+
+std::vector<std::string>
+ExpandInputFiles(std::vector<std::string> const &inputs) {
+  std::vector<std::string> files;
+  for (auto const &input : inputs) {
+    if (!input.size() || (input.front() != '@')) {
+      ExpandInputPath(input, files);
+      continue;
+    }
+
+    std::ifstream list(input.substr(1));
+    if (!list) {
+      throw std::runtime_error(
+          "neutvect-converter: [ERROR]: Failed to read input file list: " +
+          input.substr(1));
+    }
+    std::string line;
+    while (std::getline(list, line)) {
+      auto first = line.find_first_not_of(" \t\r");
+      if ((first == std::string::npos) || (line[first] == '#')) {
+        continue;
+      }
+      auto last = line.find_last_not_of(" \t\r");
+      ExpandInputPath(line.substr(first, last - first + 1), files);
+    }
+  }
+  return files;
+}
+
+// Whether the sub-branch br holds one of members. Its name is the path to the
+// data member, whose last component, without any array dimensions, has to be
+// the member exactly, so that e.g. Mode does not pick up QEModel. NeutVect
+// keeps some members under an f prefix, as in fNpart, so that matches Npart
+// too.
+static bool IsMemberBranch(TBranch *br,
+                           std::vector<std::string> const &members) {
+  std::string name = br->GetName();
+  auto dot = name.find_last_of('.');
+  if (dot != std::string::npos) {
+    name = name.substr(dot + 1);
+  }
+  name = name.substr(0, name.find('['));
+  return std::any_of(members.begin(), members.end(), [&](std::string const &m) {
+    return (name == m) || (name == ("f" + m));
+  });
+}
+
+// Appends the sub-branches of br that hold one of members to subs, and, with
+// below, the sub-branches under those as well, such as the members of the
+// NeutParts in a split fPartInfo.
+static void CollectMemberBranches(TBranch *br,
+                                  std::vector<std::string> const &members,
+                                  bool below, std::vector<TBranch *> &subs,
+                                  bool in_member = false) {
+  auto children = br->GetListOfBranches();
+  for (int i = 0; i < children->GetEntries(); ++i) {
+    auto child = static_cast<TBranch *>(children->At(i));
+    if (in_member || IsMemberBranch(child, members)) {
+      subs.push_back(child);
+      if (below) {
+        CollectMemberBranches(child, members, below, subs, true);
+      }
+    } else {
+      CollectMemberBranches(child, members, below, subs, false);
+    }
+  }
+}
+
+bool ActivateOnlyMembers(TTree *tree, std::vector<std::string> const &members,
+                         std::string const &branch_name) {
+  TBranch *br = tree->GetBranch(branch_name.c_str());
+  if (!br || !br->GetListOfBranches()->GetEntries()) {
+    return false;
+  }
+
+  std::vector<TBranch *> subs;
+  CollectMemberBranches(br, members, true, subs);
+
+  tree->SetBranchStatus("*", false);
+  // activating a sub-branch also activates the branches above it
+  for (auto sub : subs) {
+    tree->SetBranchStatus(sub->GetName(), true);
+  }
+  return true;
+}
+
+Int_t MemberReader::Read(TTree *tree, Int_t tree_number, Long64_t tree_entry) {
+  if (tree_number != current_tree) {
+    current_tree = tree_number;
+    branches.clear();
+    TBranch *br = tree->GetBranch(branch_name.c_str());
+    // reading a branch also reads the sub-branches under it
+    if (br && br->GetListOfBranches()->GetEntries()) {
+      CollectMemberBranches(br, members, false, branches);
+    }
+  }
+
+  if (branches.empty()) {
+    return -1;
+  }
+  Int_t nbytes = 0;
+  for (auto br : branches) {
+    Int_t nb = br->GetEntry(tree_entry);
+    if (nb < 0) {
+      return -1;
+    }
+    nbytes += nb;
+  }
+  return nbytes;
+}
+
+Long64_t AlignToCluster(TTree *tree, Long64_t entry) {
+  Long64_t ents = tree->GetEntries();
+  if ((entry <= 0) || (entry >= ents)) {
+    return std::min(std::max(entry, 0ll), ents);
+  }
+  auto clusters = tree->GetClusterIterator(entry);
+  // the first call to Next gives the start of the cluster containing entry
+  if (clusters.Next() == entry) {
+    return entry;
+  }
+  return std::min(clusters.Next(), ents);
+}
+
+void TuneInput(TTree *tree, InputTuning const &tuning, Long64_t first_entry,
+               Long64_t last_entry, std::string const &branch_name) {
+  tree->SetAutoDelete(!tuning.reuse_objects);
+
+  if (tuning.prefetch) {
+    // read by the TTreeCache when it is created
+    gEnv->SetValue("TFile.AsyncPrefetching", 1);
+    tree->SetClusterPrefetch(true);
+  }
+
+  tree->SetCacheSize(tuning.cache_size);
+  if (!tuning.cache_size) {
+    return;
+  }
+  // the branches are known, so skip the learning phase, which would otherwise
+  // read the first entries outside of the cache
+  tree->AddBranchToCache((branch_name + "*").c_str(), true);
+  tree->StopCacheLearningPhase();
+  tree->SetCacheEntryRange(first_entry, last_entry);
+}
+
+void PrintInputStats(TTree *tree, std::ostream &os) {
+  os << "[INFO]: Read " << TFile::GetFileBytesRead() << " bytes from input in "
+     << TFile::GetFileReadCalls()
+     << " read calls, including the pre-pass and metadata scan." << std::endl;
+
+  auto file = tree->GetCurrentFile();
+  auto cache =
+      file ? dynamic_cast<TTreeCache *>(tree->GetReadCache(file)) : nullptr;
+  if (!cache) {
+    os << "[INFO]: No TTreeCache was used." << std::endl;
+    return;
+  }
+  os << "[INFO]: TTreeCache of " << cache->GetBufferSize()
+     << " bytes: " << cache->GetBytesRead() << " bytes in "
+     << cache->GetReadCalls() << " calls through the cache, "
+     << cache->GetNoCacheBytesRead() << " bytes in "
+     << cache->GetNoCacheReadCalls() << " calls missed it, efficiency "
+     << cache->GetEfficiency() << " (" << cache->GetEfficiencyRel()
+     << " relative) for the last input file." << std::endl;
+}
+
+} // namespace nvconv
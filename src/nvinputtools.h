@@ -0,0 +1,86 @@
+#pragma once
+
+#include "TTree.h"
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nvconv {
+
+// Expands the -i arguments of the converter into a list of input files. An
+// argument like @list.txt is replaced by the files named in list.txt, one per
+// line, skipping blank lines and those starting with #, a directory by the
+// .root files in it and a glob pattern by the files that match it, each in
+// sorted order. Anything else, including URLs, is passed through. Throws
+// std::runtime_error if a list cannot be read, or a directory or pattern
+// matches no files.
+std::vector<std::string>
+ExpandInputFiles(std::vector<std::string> const &inputs);
+
+// If the NeutVect branch of tree is split, deactivates every sub-branch that
+// does not hold one of members, or is not under one that does, so that only
+// those members are read from disk. A member m is the data member named m or
+// fm, so Npart names fNpart. Returns false, leaving tree untouched, if the
+// branch is not split and so has to be read in full.
+bool ActivateOnlyMembers(TTree *tree, std::vector<std::string> const &members,
+                         std::string const &branch_name = "vectorbranch");
+
+// The first entry at or after entry that starts a cluster of tree, so that
+// ranges of entries read by different tasks do not share baskets.
+Long64_t AlignToCluster(TTree *tree, Long64_t entry);
+
+// Reads only the sub-branches of a split NeutVect branch that hold one of
+// members, as for ActivateOnlyMembers, so that a decision can be made on an
+// entry before reading the rest of it.
+class MemberReader {
+public:
+  MemberReader(std::vector<std::string> members,
+               std::string branch_name = "vectorbranch")
+      : members(std::move(members)), branch_name(std::move(branch_name)) {}
+
+  // Reads the members of entry tree_entry of tree, the current tree of a chain
+  // after LoadTree, whose number in the chain is tree_number. Returns the
+  // number of bytes read, or -1 if the branch is not split and the whole entry
+  // has to be read instead.
+  Int_t Read(TTree *tree, Int_t tree_number, Long64_t tree_entry);
+
+private:
+  std::vector<std::string> members;
+  std::string branch_name;
+  // the sub-branches to read from the tree numbered current_tree. A chain
+  // deletes each tree when it moves on to the next file, so a new tree may be
+  // allocated where an old one was and its pointer cannot tell them apart.
+  Int_t current_tree = -1;
+  std::vector<TBranch *> branches;
+};
+
+// How the entries of the NeutVect branch are read by TuneInput.
+struct InputTuning {
+  // The TTreeCache size in bytes, 0 disables the cache
+  Long64_t cache_size = 64 << 20;
+  // Whether to fetch the baskets of the next cluster in the background while
+  // the current one is being processed
+  bool prefetch = false;
+  // Whether to read every entry into the same NeutVect, rather than letting
+  // ROOT delete it and build a new one for each entry, as it does by default
+  bool reuse_objects = false;
+};
+
+// Sets up tree, normally a TChain, to read the entries in [first_entry,
+// last_entry) of branch_name and its sub-branches through a TTreeCache
+// restricted to that range, which reads one cluster of baskets per request.
+// Call after the branch address is set and before any entry is read through
+// it, including by a FATX pre-pass, so that no entry is read untuned.
+void TuneInput(TTree *tree, InputTuning const &tuning, Long64_t first_entry,
+               Long64_t last_entry,
+               std::string const &branch_name = "vectorbranch");
+
+// Prints how many bytes and read calls went to every input file opened by the
+// process so far, which includes any pre-pass and metadata scan, and the hit
+// rate of the TTreeCache of the file tree is reading, which covers that file
+// only.
+void PrintInputStats(TTree *tree, std::ostream &os);
+
+} // namespace nvconv
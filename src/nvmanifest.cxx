@@ -0,0 +1,282 @@
+#include "nvmanifest.h"
+
+#include "TFile.h"
+#include "TNamed.h"
+#include "TParameter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace nvconv {
+
+namespace {
+
+int const ManifestVersion = 1;
+
+template <typename T>
+bool ReadParameter(TFile &fin, char const *name, T &value) {
+  auto param = fin.Get<TParameter<T>>(name);
+  if (!param) {
+    return false;
+  }
+  value = param->GetVal();
+  return true;
+}
+
+template <typename T>
+void WriteParameter(TFile &fout, char const *name, T const &value) {
+  TParameter<T> param(name, value);
+  fout.WriteTObject(&param);
+}
+
+std::unique_ptr<TH1> CloneHist(TH1 const *hist, char const *name) {
+  if (!hist) {
+    return nullptr;
+  }
+  std::unique_ptr<TH1> clone(static_cast<TH1 *>(hist->Clone(name)));
+  clone->SetDirectory(nullptr);
+  return clone;
+}
+
+} // namespace
+
+ConversionManifest::ConversionManifest(std::string filename, std::string output)
+    : filename(std::move(filename)), output(std::move(output)) {
+
+  // the lock file is left behind, as removing it could let another run lock a
+  // new file of the same name while this one still holds the old one
+  std::string lock_name = this->filename + ".lock";
+  lock.fd = ::open(lock_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (lock.fd < 0) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to open manifest lock: " +
+        lock_name);
+  }
+  if (::flock(lock.fd, LOCK_EX | LOCK_NB)) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Another incremental conversion holds " +
+        lock_name + ", wait for it to finish before converting into " +
+        this->output);
+  }
+
+  if (!std::filesystem::exists(this->filename)) {
+    return;
+  }
+
+  std::unique_ptr<TFile> fin(TFile::Open(this->filename.c_str(), "READ"));
+  if (!fin || !fin->IsOpen() || fin->IsZombie()) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to open manifest: " +
+        this->filename);
+  }
+
+  int version = 0;
+  int mono = 0;
+  auto output_name = fin->Get<TNamed>("output");
+  auto input_table = fin->Get<TNamed>("inputs");
+  if (!ReadParameter(*fin, "version", version) ||
+      (version != ManifestVersion) || !output_name || !input_table ||
+      !ReadParameter(*fin, "nparts", nparts) ||
+      !ReadParameter(*fin, "nevents", nevents) ||
+      !ReadParameter(*fin, "monoE", mono) ||
+      !ReadParameter(*fin, "mono_E", mono_E) ||
+      !ReadParameter(*fin, "mono_totcrs", mono_totcrs) ||
+      !ReadParameter(*fin, "beam_pid", beam_pid)) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: " + this->filename +
+        " is not a manifest written by this version of neutvect-converter.");
+  }
+  monoE = mono;
+
+  if (this->output != output_name->GetTitle()) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Manifest " +
+                             this->filename + " is for output " +
+                             output_name->GetTitle() + ", not " +
+                             this->output);
+  }
+
+  // one line per input: uuid, nentries, part and name, separated by tabs
+  std::istringstream table(input_table->GetTitle());
+  std::string line;
+  while (std::getline(table, line)) {
+    if (!line.size()) {
+      continue;
+    }
+    std::istringstream fields(line);
+    Input input;
+    if (!std::getline(fields, input.uuid, '\t') ||
+        !(fields >> input.nentries >> input.part) || !fields.ignore(1) ||
+        !std::getline(fields, input.name)) {
+      throw std::runtime_error(
+          "neutvect-converter: [ERROR]: Malformed input in manifest " +
+          this->filename + ": " + line);
+    }
+    inputs.push_back(std::move(input));
+  }
+
+  flux_hist = CloneHist(fin->Get<TH1>("fluxhisto"), "fluxhisto_c");
+  rate_hist = CloneHist(fin->Get<TH1>("ratehisto"), "ratehisto_c");
+  fin->Close();
+}
+
+ConversionManifest::LockFile::~LockFile() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+bool ConversionManifest::Contains(FileMetadata const &meta) const {
+  for (auto const &input : inputs) {
+    if (input.uuid != meta.uuid) {
+      continue;
+    }
+    if (input.nentries != meta.nentries) {
+      throw std::runtime_error(
+          "neutvect-converter: [ERROR]: " + input.name + " had " +
+          std::to_string(input.nentries) + " entries when it was converted " +
+          "into part " + std::to_string(input.part) + ", but now has " +
+          std::to_string(meta.nentries) + ".");
+    }
+    return true;
+  }
+  return false;
+}
+
+void ConversionManifest::AddPart(
+    std::vector<std::string> const &names,
+    std::vector<std::shared_ptr<FileMetadata const>> const &metadata) {
+
+  bool first_part = !nevents;
+
+  Long64_t part_nevents = 0;
+  for (auto const &meta : metadata) {
+    part_nevents += meta->nentries;
+  }
+
+  // the first entry of the part is in its first non-empty file
+  auto first = std::find_if(metadata.begin(), metadata.end(),
+                            [](auto const &meta) { return meta->nentries; });
+
+  bool new_monoE = monoE;
+  double new_mono_E = mono_E;
+  double new_mono_totcrs = mono_totcrs;
+  int new_beam_pid = beam_pid;
+  std::unique_ptr<TH1> new_flux_hist = CloneHist(flux_hist.get(), "fluxhisto_c");
+  std::unique_ptr<TH1> new_rate_hist = CloneHist(rate_hist.get(), "ratehisto_c");
+
+  if (first != metadata.end()) {
+    bool part_monoE = isMono(metadata);
+    if (first_part) {
+      new_monoE = part_monoE;
+      new_mono_E = (*first)->first_E;
+      new_mono_totcrs = (*first)->first_totcrs;
+      new_beam_pid = (*first)->beam_pid;
+    } else {
+      if ((*first)->beam_pid != beam_pid) {
+        throw std::runtime_error(
+            "neutvect-converter: [ERROR]: The new inputs have beam PDG code " +
+            std::to_string((*first)->beam_pid) + ", but those in " + filename +
+            " have " + std::to_string(beam_pid) + ".");
+      }
+      new_monoE =
+          monoE && part_monoE && (std::fabs(mono_E - (*first)->first_E) <= 1E-6);
+    }
+
+    // the histograms are only kept while every input has them
+    bool part_has_hists =
+        std::all_of(metadata.begin(), metadata.end(), [](auto const &meta) {
+          return meta->flux_hist && meta->rate_hist;
+        });
+    if (part_has_hists && (first_part || new_flux_hist)) {
+      auto frpair = GetFluxRateHistPair(metadata);
+      if (first_part) {
+        new_rate_hist = std::move(frpair.first);
+        new_flux_hist = std::move(frpair.second);
+      } else {
+        new_rate_hist->Add(frpair.first.get());
+        new_flux_hist->Add(frpair.second.get());
+      }
+    } else {
+      new_flux_hist = nullptr;
+      new_rate_hist = nullptr;
+    }
+
+    if (!new_monoE && !new_flux_hist) {
+      throw std::runtime_error(
+          "neutvect-converter: [ERROR]: Cannot combine the FATX of the new "
+          "inputs with that of those in " +
+          filename +
+          ", as they are neither all mono-energetic at the same energy nor "
+          "all have flux and rate histograms.");
+    }
+  }
+
+  for (size_t fi = 0; fi < names.size(); ++fi) {
+    inputs.push_back(Input{metadata[fi]->uuid, metadata[fi]->nentries, nparts,
+                           names[fi]});
+  }
+  nparts++;
+  nevents += part_nevents;
+  monoE = new_monoE;
+  mono_E = new_mono_E;
+  mono_totcrs = new_mono_totcrs;
+  beam_pid = new_beam_pid;
+  flux_hist = std::move(new_flux_hist);
+  rate_hist = std::move(new_rate_hist);
+}
+
+double ConversionManifest::FATX() const {
+  if (!nevents) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+  if (monoE) {
+    return mono_totcrs * 1E-2;
+  }
+  return 1E-2 * (rate_hist->Integral() / flux_hist->Integral());
+}
+
+bool ConversionManifest::Write() const {
+  std::string tmp = filename + ".tmp." + std::to_string(::getpid());
+  {
+    std::unique_ptr<TFile> fout(TFile::Open(tmp.c_str(), "RECREATE"));
+    if (!fout || !fout->IsOpen() || fout->IsZombie()) {
+      return false;
+    }
+    WriteParameter(*fout, "version", ManifestVersion);
+    WriteParameter(*fout, "nparts", nparts);
+    WriteParameter(*fout, "nevents", nevents);
+    WriteParameter(*fout, "monoE", int(monoE));
+    WriteParameter(*fout, "mono_E", mono_E);
+    WriteParameter(*fout, "mono_totcrs", mono_totcrs);
+    WriteParameter(*fout, "beam_pid", beam_pid);
+
+    TNamed output_name("output", output.c_str());
+    fout->WriteTObject(&output_name);
+
+    std::stringstream table;
+    for (auto const &input : inputs) {
+      table << input.uuid << "\t" << input.nentries << "\t" << input.part
+            << "\t" << input.name << "\n";
+    }
+    TNamed input_table("inputs", table.str().c_str());
+    fout->WriteTObject(&input_table);
+
+    if (flux_hist) {
+      fout->WriteTObject(flux_hist.get(), "fluxhisto");
+      fout->WriteTObject(rate_hist.get(), "ratehisto");
+    }
+    fout->Close();
+  }
+  return !std::rename(tmp.c_str(), filename.c_str());
+}
+
+} // namespace nvconv
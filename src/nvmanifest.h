@@ -0,0 +1,90 @@
+#pragma once
+
+#include "nvmetacache.h"
+
+#include "TH1.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nvconv {
+
+// The inputs converted so far by incremental runs into the parts of an output,
+// and the running sums needed for the FATX and exposure of all of them, so
+// that a run only has to read the inputs that are new. Stored as a ROOT file
+// holding the input table, the event count, the n-weighted sums of the input
+// flux and rate histograms and the beam energy of mono-energetic inputs.
+class ConversionManifest {
+public:
+  struct Input {
+    std::string uuid;
+    Long64_t nentries;
+    // the part it was converted into
+    int part;
+    std::string name;
+  };
+
+  // Takes an exclusive lock on filename.lock, held until the manifest is
+  // destroyed, then reads filename if it exists, otherwise starts an empty
+  // manifest. The lock keeps a concurrent incremental run from converting into
+  // the same part or overwriting the manifest this one writes. Throws
+  // std::runtime_error if the lock is held by another run, or if filename
+  // cannot be read or was written for a different output.
+  ConversionManifest(std::string filename, std::string output);
+
+  std::string const &Filename() const { return filename; }
+  std::vector<Input> const &Inputs() const { return inputs; }
+  // The number of parts converted so far, which is also the number of the next
+  Int_t NParts() const { return nparts; }
+  Long64_t NEvents() const { return nevents; }
+
+  // Whether the input with meta has already been converted. Throws
+  // std::runtime_error if it has, but had a different number of entries.
+  bool Contains(FileMetadata const &meta) const;
+
+  // Records that the inputs names, with metadata, were converted into the next
+  // part. Throws std::runtime_error if their FATX cannot be combined with that
+  // of the inputs converted before them.
+  void AddPart(std::vector<std::string> const &names,
+               std::vector<std::shared_ptr<FileMetadata const>> const &metadata);
+
+  // The FATX of every input converted so far, in pb/Nucleon, as a single run
+  // over all of them would calculate it from their histograms, or NaN if there
+  // are no inputs.
+  double FATX() const;
+  bool IsMonoE() const { return monoE; }
+  int BeamPID() const { return beam_pid; }
+  // The n-weighted sum of the input flux histograms, nullptr for mono-energetic
+  // inputs
+  std::unique_ptr<TH1> const &FluxHist() const { return flux_hist; }
+
+  // Writes the manifest to a temporary file that is renamed over filename.
+  // Returns false if it could not be written.
+  bool Write() const;
+
+private:
+  std::string filename;
+  std::string output;
+  // flock'ed for the lifetime of the manifest, and released by closing it
+  struct LockFile {
+    int fd = -1;
+    LockFile() = default;
+    LockFile(LockFile const &) = delete;
+    LockFile &operator=(LockFile const &) = delete;
+    ~LockFile();
+  } lock;
+
+  std::vector<Input> inputs;
+  Int_t nparts = 0;
+  Long64_t nevents = 0;
+
+  bool monoE = false;
+  double mono_E = 0;
+  double mono_totcrs = 0;
+  int beam_pid = 0;
+  std::unique_ptr<TH1> flux_hist = nullptr;
+  std::unique_ptr<TH1> rate_hist = nullptr;
+};
+
+} // namespace nvconv
@@ -0,0 +1,373 @@
+#include "nvmetacache.h"
+
+#include "nvfatxtools.h"
+#include "nvinputtools.h"
+
+#include "neutvect.h"
+
+#include "TChainElement.h"
+#include "TFile.h"
+#include "TParameter.h"
+#include "TROOT.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <unistd.h>
+
+namespace nvconv {
+
+namespace {
+
+// Bumped whenever what is stored changes, so that old entries are rescanned
+int const CacheVersion = 2;
+
+template <typename T>
+bool ReadParameter(TFile &fin, char const *name, T &value) {
+  auto param = fin.Get<TParameter<T>>(name);
+  if (!param) {
+    return false;
+  }
+  value = param->GetVal();
+  return true;
+}
+
+template <typename T>
+void WriteParameter(TFile &fout, char const *name, T const &value) {
+  TParameter<T> param(name, value);
+  fout.WriteTObject(&param);
+}
+
+std::unique_ptr<TH1> ReadHist(TFile &fin, char const *name) {
+  auto hist = fin.Get<TH1>(name);
+  if (!hist) {
+    return nullptr;
+  }
+  std::unique_ptr<TH1> clone(static_cast<TH1 *>(hist->Clone()));
+  clone->SetDirectory(nullptr);
+  return clone;
+}
+
+// Returns nullptr if cache_file does not exist or was written by a different
+// version of the cache.
+std::unique_ptr<FileMetadata> Load(std::string const &cache_file) {
+  if (!std::filesystem::exists(cache_file)) {
+    return nullptr;
+  }
+  std::unique_ptr<TFile> fin(TFile::Open(cache_file.c_str(), "READ"));
+  if (!fin || !fin->IsOpen() || fin->IsZombie()) {
+    return nullptr;
+  }
+
+  int version = 0;
+  Long64_t nmono = -1;
+  auto meta = std::make_unique<FileMetadata>();
+  if (!ReadParameter(*fin, "version", version) || (version != CacheVersion) ||
+      !ReadParameter(*fin, "size", meta->size) ||
+      !ReadParameter(*fin, "nentries", meta->nentries) ||
+      !ReadParameter(*fin, "first_E", meta->first_E) ||
+      !ReadParameter(*fin, "first_totcrs", meta->first_totcrs) ||
+      !ReadParameter(*fin, "nmono", nmono) ||
+      !ReadParameter(*fin, "beam_pid", meta->beam_pid) ||
+      !ReadParameter(*fin, "target_A", meta->target_A) ||
+      !ReadParameter(*fin, "target_Z", meta->target_Z) ||
+      !ReadParameter(*fin, "target_H", meta->target_H)) {
+    return nullptr;
+  }
+  meta->nmono = nmono;
+  meta->flux_hist = ReadHist(*fin, "fluxhisto");
+  meta->rate_hist = ReadHist(*fin, "ratehisto");
+  fin->Close();
+  return meta;
+}
+
+// Writes to a temporary file that is renamed into place, so that runs sharing
+// the cache never see a partly written entry.
+bool Store(std::string const &cache_file, FileMetadata const &meta) {
+  static std::atomic<long> nstored{0};
+  std::string tmp = cache_file + ".tmp." + std::to_string(::getpid()) + "." +
+                    std::to_string(nstored++);
+  {
+    std::unique_ptr<TFile> fout(TFile::Open(tmp.c_str(), "RECREATE"));
+    if (!fout || !fout->IsOpen() || fout->IsZombie()) {
+      return false;
+    }
+    WriteParameter(*fout, "version", CacheVersion);
+    WriteParameter(*fout, "size", meta.size);
+    WriteParameter(*fout, "nentries", meta.nentries);
+    WriteParameter(*fout, "first_E", meta.first_E);
+    WriteParameter(*fout, "first_totcrs", meta.first_totcrs);
+    WriteParameter(*fout, "nmono", Long64_t(meta.nmono));
+    WriteParameter(*fout, "beam_pid", meta.beam_pid);
+    WriteParameter(*fout, "target_A", meta.target_A);
+    WriteParameter(*fout, "target_Z", meta.target_Z);
+    WriteParameter(*fout, "target_H", meta.target_H);
+    if (meta.flux_hist) {
+      fout->WriteTObject(meta.flux_hist.get(), "fluxhisto");
+    }
+    if (meta.rate_hist) {
+      fout->WriteTObject(meta.rate_hist.get(), "ratehisto");
+    }
+    fout->Close();
+  }
+  return !std::rename(tmp.c_str(), cache_file.c_str());
+}
+
+// Reads the metadata of the open input file fin, apart from nmono, which is
+// only counted if isMono needs it
+std::unique_ptr<FileMetadata> Scan(TFile &fin, std::string const &fname) {
+  auto tree = fin.Get<TTree>("neuttree");
+  if (!tree) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to find tree: \"neuttree\" in "
+        "file: \"" +
+        fname + "\".");
+  }
+
+  auto meta = std::make_unique<FileMetadata>();
+  meta->nentries = tree->GetEntries();
+  meta->flux_hist = ReadHist(fin, "fluxhisto");
+  meta->rate_hist = ReadHist(fin, "ratehisto");
+
+  auto nv = std::make_unique<NeutVect>();
+  NeutVect *nv_addr = nv.get();
+  tree->SetBranchAddress("vectorbranch", &nv_addr);
+  std::vector<std::string> members = FATXMembers;
+  members.insert(members.end(), {"TargetA", "TargetZ", "TargetH"});
+  ActivateOnlyMembers(tree, members);
+
+  if (meta->nentries <= 1) {
+    meta->nmono = meta->nentries;
+  }
+  if (meta->nentries) {
+    tree->GetEntry(0);
+    meta->first_E = nv->PartInfo(0)->fP.E();
+    meta->first_totcrs = nv->Totcrs;
+    meta->beam_pid = nv->PartInfo(0)->fPID;
+    meta->target_A = nv->TargetA;
+    meta->target_Z = nv->TargetZ;
+    meta->target_H = nv->TargetH;
+  }
+  return meta;
+}
+
+// The nmono of meta, which is counted by reading its file the first time it
+// is needed, and then kept in its cache file
+Long64_t CountMono(FileMetadata const &meta) {
+  if (meta.nmono >= 0) {
+    return meta.nmono;
+  }
+
+  std::unique_ptr<TFile> fin(TFile::Open(meta.fname.c_str(), "READ"));
+  auto tree = (fin && fin->IsOpen() && !fin->IsZombie())
+                  ? fin->Get<TTree>("neuttree")
+                  : nullptr;
+  if (!tree) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to read the neuttree of input "
+        "file: " +
+        meta.fname);
+  }
+
+  auto nv = std::make_unique<NeutVect>();
+  NeutVect *nv_addr = nv.get();
+  tree->SetBranchAddress("vectorbranch", &nv_addr);
+  ActivateOnlyMembers(tree, FATXMembers);
+
+  Long64_t nmono = 0;
+  Long64_t ntocheck = std::min(meta.nentries, MetadataCache::NMonoChecked);
+  for (; nmono < ntocheck; ++nmono) {
+    tree->GetEntry(nmono);
+    if (std::fabs(meta.first_E - nv_addr->PartInfo(0)->fP.E()) > 1E-6) {
+      break;
+    }
+  }
+  fin->Close();
+
+  meta.nmono = nmono;
+  if (meta.cache_file.size() && !Store(meta.cache_file, meta)) {
+    std::cout << "[WARN]: Failed to write metadata of " << meta.fname
+              << " to " << meta.cache_file << std::endl;
+  }
+  return nmono;
+}
+
+} // namespace
+
+MetadataCache::MetadataCache(std::string dir) : dir(std::move(dir)) {
+  if (!this->dir.size()) {
+    return;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(this->dir, ec);
+  if (ec) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to create metadata cache "
+        "directory " +
+        this->dir + ": " + ec.message());
+  }
+}
+
+std::shared_ptr<FileMetadata const>
+MetadataCache::Get(std::string const &fname) {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto found = seen.find(fname);
+    if (found != seen.end()) {
+      return found->second;
+    }
+  }
+
+  std::unique_ptr<TFile> fin(TFile::Open(fname.c_str(), "READ"));
+  if (!fin || !fin->IsOpen() || fin->IsZombie()) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to open input file: " + fname);
+  }
+  std::string uuid = fin->GetUUID().AsString();
+  Long64_t size = fin->GetSize();
+  std::string cache_file = dir + "/" + uuid + ".root";
+
+  std::unique_ptr<FileMetadata> meta =
+      dir.size() ? Load(cache_file) : nullptr;
+  if (meta && (meta->size == size)) {
+    nhits++;
+  } else {
+    meta = Scan(*fin, fname);
+    meta->size = size;
+    nmisses++;
+    if (dir.size() && !Store(cache_file, *meta)) {
+      std::cout << "[WARN]: Failed to write metadata of " << fname << " to "
+                << cache_file << std::endl;
+    }
+  }
+  meta->uuid = uuid;
+  meta->fname = fname;
+  meta->cache_file = dir.size() ? cache_file : "";
+  fin->Close();
+
+  std::lock_guard<std::mutex> lock(mtx);
+  return seen.emplace(fname, std::move(meta)).first->second;
+}
+
+std::vector<std::shared_ptr<FileMetadata const>>
+MetadataCache::Get(std::vector<std::string> const &fnames, int nthreads) {
+  if (nthreads < 1) {
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  nthreads = std::min(nthreads, int(fnames.size()));
+
+  std::vector<std::shared_ptr<FileMetadata const>> metadata(fnames.size());
+  std::vector<std::exception_ptr> errors(fnames.size());
+  std::atomic<size_t> next{0};
+  auto scan = [&]() {
+    for (size_t fi = next++; fi < fnames.size(); fi = next++) {
+      try {
+        metadata[fi] = Get(fnames[fi]);
+      } catch (...) {
+        errors[fi] = std::current_exception();
+      }
+    }
+  };
+
+  if (nthreads > 1) {
+    ROOT::EnableThreadSafety();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < nthreads; ++t) {
+      threads.emplace_back(scan);
+    }
+    for (auto &t : threads) {
+      t.join();
+    }
+  } else {
+    scan();
+  }
+
+  // whatever the order the files were read in, the first error in chain order
+  // is reported
+  for (auto const &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return metadata;
+}
+
+std::vector<std::shared_ptr<FileMetadata const>>
+MetadataCache::Get(TChain &chin, int nthreads) {
+  std::vector<std::string> fnames;
+  auto files = chin.GetListOfFiles();
+  for (int fi = 0; fi < files->GetEntries(); ++fi) {
+    fnames.push_back(static_cast<TChainElement *>(files->At(fi))->GetTitle());
+  }
+  return Get(fnames, nthreads);
+}
+
+bool isMono(std::vector<std::shared_ptr<FileMetadata const>> const &metadata) {
+  Long64_t nchecked = 0;
+  double first_E = 0;
+  for (auto const &meta : metadata) {
+    Long64_t ntocheck =
+        std::min(meta->nentries, MetadataCache::NMonoChecked - nchecked);
+    if (ntocheck <= 0) {
+      continue;
+    }
+    if (!nchecked) {
+      first_E = meta->first_E;
+    } else if (std::fabs(first_E - meta->first_E) > 1E-6) {
+      return false;
+    }
+    if (CountMono(*meta) < ntocheck) {
+      return false;
+    }
+    nchecked += ntocheck;
+  }
+  return true;
+}
+
+std::pair<std::unique_ptr<TH1>, std::unique_ptr<TH1>> GetFluxRateHistPair(
+    std::vector<std::shared_ptr<FileMetadata const>> const &metadata) {
+
+  std::pair<std::unique_ptr<TH1>, std::unique_ptr<TH1>> fluxrate{nullptr,
+                                                                 nullptr};
+
+  for (auto const &meta : metadata) {
+    if (!meta->rate_hist || !meta->flux_hist) {
+      std::stringstream ss;
+      ss << "Failed to open flux(" << bool(meta->flux_hist) << ") and/or rate("
+         << bool(meta->rate_hist)
+         << ") histograms from file in chain with UUID: " << meta->uuid
+         << std::endl;
+      throw std::runtime_error(ss.str());
+    }
+
+    // weight the contribution to the average by the number of events in the
+    // file.
+    double nevents = meta->nentries;
+
+    if (!fluxrate.first) {
+      fluxrate.first = std::unique_ptr<TH1>(
+          static_cast<TH1 *>(meta->rate_hist->Clone("ratehisto_c")));
+      fluxrate.second = std::unique_ptr<TH1>(
+          static_cast<TH1 *>(meta->flux_hist->Clone("fluxhisto_c")));
+      fluxrate.first->Scale(nevents);
+      fluxrate.second->Scale(nevents);
+      fluxrate.first->SetDirectory(nullptr);
+      fluxrate.second->SetDirectory(nullptr);
+    } else {
+      fluxrate.first->Add(meta->rate_hist.get(), nevents);
+      fluxrate.second->Add(meta->flux_hist.get(), nevents);
+    }
+  }
+
+  return fluxrate;
+}
+
+} // namespace nvconv
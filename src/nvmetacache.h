@@ -0,0 +1,100 @@
+#pragma once
+
+#include "TChain.h"
+#include "TH1.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace nvconv {
+
+// What the converter needs to know about an input file before converting it,
+// found by reading its histograms and the first entry of its neuttree.
+struct FileMetadata {
+  // The TUUID of the file, and its size as a check that it was not rewritten
+  // in place
+  std::string uuid;
+  Long64_t size = 0;
+
+  Long64_t nentries = 0;
+  // The beam energy, in MeV, and total cross section of the first entry
+  double first_E = 0;
+  double first_totcrs = 0;
+  // How many of the first MetadataCache::NMonoChecked entries have the same
+  // beam energy as the first, or -1 if they have not been counted. They are
+  // only counted, by isMono, for the files that a mono-energetic check of a
+  // chain reaches, which are normally only the first.
+  mutable std::atomic<Long64_t> nmono{-1};
+  int beam_pid = 0;
+  int target_A = 0;
+  int target_Z = 0;
+  int target_H = 0;
+
+  // nullptr if the file has none
+  std::unique_ptr<TH1> flux_hist = nullptr;
+  std::unique_ptr<TH1> rate_hist = nullptr;
+
+  // The name the file was read with, and the cache file these are kept in,
+  // empty if they are not kept, so that nmono can be counted and kept later.
+  std::string fname;
+  std::string cache_file;
+};
+
+// Keeps the FileMetadata of input files in dir, one ROOT file per input named
+// after its TUUID, so that later runs over the same inputs, with any shard or
+// options, only have to open each input to read its UUID. Files that are not
+// in the cache, or whose size has changed, are read and added to it. With an
+// empty dir, nothing is kept between runs, but each file is still only read
+// once. Safe to share between threads.
+class MetadataCache {
+public:
+  // The number of leading entries checked for a mono-energetic beam, as isMono
+  // does over a chain.
+  static constexpr Long64_t NMonoChecked = 1000;
+
+  // dir is created if it does not exist.
+  explicit MetadataCache(std::string dir = "");
+
+  std::string const &Dir() const { return dir; }
+
+  // The metadata of fname, from the cache if it is there. Throws
+  // std::runtime_error if fname cannot be read.
+  std::shared_ptr<FileMetadata const> Get(std::string const &fname);
+  // The metadata of each of fnames, in the same order, reading the files that
+  // are not yet known on nthreads threads, or on all hardware threads if 0.
+  // Rethrows the error of the first of fnames that could not be read.
+  std::vector<std::shared_ptr<FileMetadata const>>
+  Get(std::vector<std::string> const &fnames, int nthreads = 0);
+  // The metadata of each file in chin, in chain order.
+  std::vector<std::shared_ptr<FileMetadata const>> Get(TChain &chin,
+                                                       int nthreads = 0);
+
+  long NHits() const { return nhits; }
+  long NMisses() const { return nmisses; }
+
+private:
+  std::string dir;
+  // metadata already looked up by this process, by file name
+  std::mutex mtx;
+  std::map<std::string, std::shared_ptr<FileMetadata const>> seen;
+
+  std::atomic<long> nhits{0};
+  std::atomic<long> nmisses{0};
+};
+
+// The same as isMono for the chain of files with these metadata. Counts the
+// nmono of the files it reaches that do not have it yet, and throws
+// std::runtime_error if one of those cannot be read.
+bool isMono(std::vector<std::shared_ptr<FileMetadata const>> const &metadata);
+
+// The same as GetFluxRateHistPairFromChain for the chain of files with these
+// metadata.
+std::pair<std::unique_ptr<TH1>, std::unique_ptr<TH1>> GetFluxRateHistPair(
+    std::vector<std::shared_ptr<FileMetadata const>> const &metadata);
+
+} // namespace nvconv
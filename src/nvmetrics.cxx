@@ -0,0 +1,306 @@
+#include "nvmetrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+
+namespace nvconv {
+
+char const *StageName(Stage stage) {
+  switch (stage) {
+  case Stage::PrePass: {
+    return "prepass";
+  }
+  case Stage::GetEntry: {
+    return "getentry";
+  }
+  case Stage::Convert: {
+    return "convert";
+  }
+  case Stage::Serialize: {
+    return "serialize";
+  }
+  case Stage::Write: {
+    return "write";
+  }
+  }
+  return "unknown";
+}
+
+double WallTime() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+double ThreadCPUTime() {
+  timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+    return 0;
+  }
+  return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static double ProcessCPUTime() {
+  timespec ts;
+  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts)) {
+    return 0;
+  }
+  return ts.tv_sec + ts.tv_nsec * 1E-9;
+}
+
+static uint64_t ToNs(double seconds) {
+  return (seconds > 0) ? uint64_t(seconds * 1E9) : 0;
+}
+
+std::array<double, 16> const ConversionMetrics::LatencyBuckets = {
+    1E-5,   2.5E-5, 5E-5, 1E-4, 2.5E-4, 5E-4, 1E-3, 2.5E-3,
+    5E-3,   1E-2,   2.5E-2, 5E-2, 0.1,  0.25, 1,    10};
+
+ConversionMetrics::ConversionMetrics(size_t nslowest)
+    : nslowest(nslowest), start(WallTime()) {}
+
+ConversionMetrics::~ConversionMetrics() { StopExporting(); }
+
+void ConversionMetrics::AddTime(Stage stage, double wall, double cpu) {
+  if (!enabled) {
+    return;
+  }
+  size_t s = size_t(stage);
+  wall_ns[s] += ToNs(wall);
+  cpu_ns[s] += ToNs(cpu);
+  ncalls[s]++;
+}
+
+void ConversionMetrics::EventDone(double latency, int64_t evtno, int32_t ifile,
+                                  int64_t fentry) {
+  if (!enabled) {
+    return;
+  }
+  nevents++;
+  latency_sum_ns += ToNs(latency);
+  size_t bucket = std::lower_bound(LatencyBuckets.begin(),
+                                   LatencyBuckets.end(), latency) -
+                  LatencyBuckets.begin();
+  latency_counts[bucket]++;
+
+  if (!nslowest || (latency <= slow_threshold.load())) {
+    return;
+  }
+
+  auto faster = [](SlowEvent const &a, SlowEvent const &b) {
+    return a.latency > b.latency;
+  };
+  std::lock_guard<std::mutex> lock(slow_mtx);
+  slowest.push_back({latency, evtno, ifile, fentry});
+  std::push_heap(slowest.begin(), slowest.end(), faster);
+  if (slowest.size() > nslowest) {
+    std::pop_heap(slowest.begin(), slowest.end(), faster);
+    slowest.pop_back();
+  }
+  if (slowest.size() == nslowest) {
+    slow_threshold = slowest.front().latency;
+  }
+}
+
+std::vector<ConversionMetrics::SlowEvent> ConversionMetrics::Slowest() const {
+  std::vector<SlowEvent> sorted;
+  {
+    std::lock_guard<std::mutex> lock(slow_mtx);
+    sorted = slowest;
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [](SlowEvent const &a, SlowEvent const &b) {
+              return a.latency > b.latency;
+            });
+  return sorted;
+}
+
+double ConversionMetrics::LatencyQuantile(double q) const {
+  uint64_t n = nevents;
+  if (!n) {
+    return 0;
+  }
+  double target = q * n;
+  uint64_t below = 0;
+  for (size_t b = 0; b < latency_counts.size(); ++b) {
+    uint64_t count = latency_counts[b];
+    if (count && ((below + count) >= target)) {
+      double lo = b ? LatencyBuckets[b - 1] : 0;
+      if (b == LatencyBuckets.size()) {
+        return lo;
+      }
+      return lo + (LatencyBuckets[b] - lo) * ((target - below) / count);
+    }
+    below += count;
+  }
+  return LatencyBuckets.back();
+}
+
+bool ConversionMetrics::WritePrometheus(std::string const &filename) const {
+  std::string tmp = filename + ".tmp";
+  {
+    std::ofstream fout(tmp);
+    fout << std::setprecision(9);
+
+    fout << "# HELP nvconv_stage_wall_seconds_total Wall time spent in each "
+            "conversion stage, summed over threads.\n"
+         << "# TYPE nvconv_stage_wall_seconds_total counter\n";
+    for (size_t s = 0; s < NStages; ++s) {
+      fout << "nvconv_stage_wall_seconds_total{stage=\""
+           << StageName(Stage(s)) << "\"} " << (wall_ns[s] * 1E-9) << "\n";
+    }
+    fout << "# HELP nvconv_stage_cpu_seconds_total CPU time spent in each "
+            "conversion stage, summed over threads.\n"
+         << "# TYPE nvconv_stage_cpu_seconds_total counter\n";
+    for (size_t s = 0; s < NStages; ++s) {
+      fout << "nvconv_stage_cpu_seconds_total{stage=\"" << StageName(Stage(s))
+           << "\"} " << (cpu_ns[s] * 1E-9) << "\n";
+    }
+    fout << "# HELP nvconv_events_total Events converted and written.\n"
+         << "# TYPE nvconv_events_total counter\n"
+         << "nvconv_events_total " << nevents << "\n"
+         << "# HELP nvconv_read_bytes_total Bytes unpacked from input "
+            "entries.\n"
+         << "# TYPE nvconv_read_bytes_total counter\n"
+         << "nvconv_read_bytes_total " << bytes_read << "\n"
+         << "# HELP nvconv_written_bytes_total Bytes of events written, "
+            "before compression.\n"
+         << "# TYPE nvconv_written_bytes_total counter\n"
+         << "nvconv_written_bytes_total " << bytes_written << "\n"
+         << "# HELP nvconv_uptime_seconds Wall time since the conversion "
+            "started.\n"
+         << "# TYPE nvconv_uptime_seconds gauge\n"
+         << "nvconv_uptime_seconds " << (WallTime() - start) << "\n";
+
+    fout << "# HELP nvconv_event_latency_seconds Time from reading an event "
+            "to writing it.\n"
+         << "# TYPE nvconv_event_latency_seconds histogram\n";
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < LatencyBuckets.size(); ++b) {
+      cumulative += latency_counts[b];
+      fout << "nvconv_event_latency_seconds_bucket{le=\"" << LatencyBuckets[b]
+           << "\"} " << cumulative << "\n";
+    }
+    cumulative += latency_counts.back();
+    fout << "nvconv_event_latency_seconds_bucket{le=\"+Inf\"} " << cumulative
+         << "\n"
+         << "nvconv_event_latency_seconds_sum " << (latency_sum_ns * 1E-9)
+         << "\n"
+         << "nvconv_event_latency_seconds_count " << cumulative << "\n";
+
+    if (!fout.good()) {
+      return false;
+    }
+  }
+  return !std::rename(tmp.c_str(), filename.c_str());
+}
+
+bool ConversionMetrics::WriteJSON(std::string const &filename) const {
+  std::ofstream fout(filename);
+  fout << std::setprecision(9);
+
+  double wall = WallTime() - start;
+  fout << "{\n  \"wall_seconds\": " << wall
+       << ",\n  \"cpu_seconds\": " << ProcessCPUTime()
+       << ",\n  \"events\": " << nevents
+       << ",\n  \"events_per_second\": " << (wall > 0 ? nevents / wall : 0)
+       << ",\n  \"bytes_read\": " << bytes_read
+       << ",\n  \"bytes_written\": " << bytes_written << ",\n  \"stages\": {\n";
+  for (size_t s = 0; s < NStages; ++s) {
+    fout << "    \"" << StageName(Stage(s))
+         << "\": {\"wall_seconds\": " << (wall_ns[s] * 1E-9)
+         << ", \"cpu_seconds\": " << (cpu_ns[s] * 1E-9)
+         << ", \"calls\": " << ncalls[s] << "}"
+         << (((s + 1) < NStages) ? "," : "") << "\n";
+  }
+  fout << "  },\n  \"latency_seconds\": {\"mean\": "
+       << (nevents ? (latency_sum_ns * 1E-9) / nevents : 0)
+       << ", \"p50\": " << LatencyQuantile(0.5)
+       << ", \"p90\": " << LatencyQuantile(0.9)
+       << ", \"p99\": " << LatencyQuantile(0.99) << ", \"buckets\": [";
+  for (size_t b = 0; b < latency_counts.size(); ++b) {
+    fout << (b ? ", " : "") << "{\"le\": ";
+    if (b < LatencyBuckets.size()) {
+      fout << LatencyBuckets[b];
+    } else {
+      fout << "\"+Inf\"";
+    }
+    fout << ", \"count\": " << latency_counts[b] << "}";
+  }
+  fout << "]},\n  \"slowest_events\": [\n";
+  auto slow = Slowest();
+  for (size_t i = 0; i < slow.size(); ++i) {
+    auto const &ev = slow[i];
+    std::string file = (size_t(ev.ifile) < file_names.size())
+                           ? file_names[ev.ifile]
+                           : std::to_string(ev.ifile);
+    fout << "    {\"latency_seconds\": " << ev.latency
+         << ", \"evtno\": " << ev.evtno << ", \"file\": \"" << file
+         << "\", \"entry\": " << ev.fentry << "}"
+         << (((i + 1) < slow.size()) ? "," : "") << "\n";
+  }
+  fout << "  ]\n}\n";
+  return fout.good();
+}
+
+void ConversionMetrics::PrintSummary(std::ostream &os) const {
+  double wall = WallTime() - start;
+  os << "[INFO]: Converted " << nevents << " events in " << wall << " s, "
+     << (wall > 0 ? nevents / wall : 0) << " events/s, " << ProcessCPUTime()
+     << " s CPU.\n";
+  for (size_t s = 0; s < NStages; ++s) {
+    if (!ncalls[s]) {
+      continue;
+    }
+    os << "\t" << std::setw(10) << std::left << StageName(Stage(s))
+       << std::right << ": " << (wall_ns[s] * 1E-9) << " s wall, "
+       << (cpu_ns[s] * 1E-9) << " s CPU\n";
+  }
+  os << "\tread " << bytes_read << " bytes, wrote " << bytes_written
+     << " bytes\n"
+     << "\tevent latency p50: " << LatencyQuantile(0.5)
+     << " s, p99: " << LatencyQuantile(0.99) << " s\n";
+  auto slow = Slowest();
+  if (slow.size()) {
+    os << "\tslowest events:\n";
+  }
+  for (auto const &ev : slow) {
+    os << "\t\t" << ev.latency << " s: event " << ev.evtno << ", "
+       << ((size_t(ev.ifile) < file_names.size()) ? file_names[ev.ifile]
+                                                  : std::to_string(ev.ifile))
+       << " entry " << ev.fentry << "\n";
+  }
+  os << std::flush;
+}
+
+void ConversionMetrics::StartExporting(std::string const &filename,
+                                       double interval) {
+  StopExporting();
+  export_file = filename;
+  exporting = true;
+  exporter = std::thread([this, interval]() {
+    std::unique_lock<std::mutex> lock(export_mtx);
+    while (exporting) {
+      WritePrometheus(export_file);
+      export_cv.wait_for(lock, std::chrono::duration<double>(interval),
+                         [&] { return !exporting; });
+    }
+    WritePrometheus(export_file);
+  });
+}
+
+void ConversionMetrics::StopExporting() {
+  {
+    std::lock_guard<std::mutex> lock(export_mtx);
+    exporting = false;
+  }
+  export_cv.notify_all();
+  if (exporter.joinable()) {
+    exporter.join();
+  }
+}
+
+} // namespace nvconv
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nvconv {
+
+// The stages of a conversion that are timed separately.
+enum class Stage {
+  // the pass over the input before converting, e.g. to calculate the FATX
+  PrePass,
+  // reading and unpacking input entries
+  GetEntry,
+  // building the HepMC3 event, or the flat tree values, from the NeutVect
+  Convert,
+  // formatting events to text
+  Serialize,
+  // writing events, and, for writers given HepMC3 events, serializing them
+  Write,
+};
+size_t const NStages = 5;
+char const *StageName(Stage stage);
+
+// The wall and CPU time of the calling thread, in seconds.
+double WallTime();
+double ThreadCPUTime();
+
+// Counts the wall and CPU time spent in each Stage, bytes read and written, the
+// distribution of per-event latencies and the slowest events of a conversion.
+// Safe to update from several threads: the counters are atomic and only events
+// slower than the current slowest few take a lock. While disabled, Timer reads
+// no clocks and nothing is counted, so that a conversion that does not report
+// its metrics does not pay for them.
+class ConversionMetrics {
+public:
+  // Upper edges of the latency histogram buckets, in seconds
+  static std::array<double, 16> const LatencyBuckets;
+
+  struct SlowEvent {
+    double latency;
+    int64_t evtno;
+    int32_t ifile;
+    int64_t fentry;
+  };
+
+  // Times a stage from construction to destruction on the calling thread.
+  class Timer {
+  public:
+    Timer(ConversionMetrics &metrics, Stage stage)
+        : metrics(metrics), stage(stage), enabled(metrics.Enabled()) {
+      if (enabled) {
+        wall = WallTime();
+        cpu = ThreadCPUTime();
+      }
+    }
+    ~Timer() {
+      if (enabled) {
+        metrics.AddTime(stage, WallTime() - wall, ThreadCPUTime() - cpu);
+      }
+    }
+
+  private:
+    ConversionMetrics &metrics;
+    Stage stage;
+    bool enabled;
+    double wall = 0, cpu = 0;
+  };
+
+  ConversionMetrics(size_t nslowest = 10);
+  ~ConversionMetrics();
+
+  void SetNSlowest(size_t n) { nslowest = n; }
+  // Enabled when made. Only change this while no other thread is updating.
+  void SetEnabled(bool on) { enabled = on; }
+  bool Enabled() const { return enabled; }
+  // Restarts the clock that throughput is measured from, for a conversion that
+  // starts long after the metrics were made, as in a forked daemon job.
+  void RestartClock() { start = WallTime(); }
+  // The names of the input files, to report the slowest events with
+  void SetFileNames(std::vector<std::string> names) {
+    file_names = std::move(names);
+  }
+
+  void AddTime(Stage stage, double wall, double cpu);
+  void AddBytesRead(uint64_t nbytes) {
+    if (enabled) {
+      bytes_read += nbytes;
+    }
+  }
+  void AddBytesWritten(uint64_t nbytes) {
+    if (enabled) {
+      bytes_written += nbytes;
+    }
+  }
+  // Counts a finished event, latency is the time from starting to read it to
+  // finishing writing it.
+  void EventDone(double latency, int64_t evtno, int32_t ifile, int64_t fentry);
+
+  uint64_t NEvents() const { return nevents; }
+  std::vector<SlowEvent> Slowest() const;
+
+  // Writes the metrics in the Prometheus text exposition format. The file is
+  // written next to filename and renamed over it, so that readers never see
+  // it half written.
+  bool WritePrometheus(std::string const &filename) const;
+  bool WriteJSON(std::string const &filename) const;
+  void PrintSummary(std::ostream &os) const;
+
+  // Rewrites the Prometheus file every interval seconds on a background thread
+  // until StopExporting, which writes it a final time.
+  void StartExporting(std::string const &filename, double interval = 1);
+  void StopExporting();
+
+private:
+  // the latency below which a fraction q of events finished, interpolated
+  // within the histogram bucket
+  double LatencyQuantile(double q) const;
+
+  bool enabled = true;
+  size_t nslowest;
+  std::vector<std::string> file_names;
+  double start;
+
+  std::array<std::atomic<uint64_t>, NStages> wall_ns{};
+  std::array<std::atomic<uint64_t>, NStages> cpu_ns{};
+  std::array<std::atomic<uint64_t>, NStages> ncalls{};
+  std::atomic<uint64_t> bytes_read{0};
+  std::atomic<uint64_t> bytes_written{0};
+
+  std::atomic<uint64_t> nevents{0};
+  std::atomic<uint64_t> latency_sum_ns{0};
+  // the last bucket counts the events slower than every edge
+  std::array<std::atomic<uint64_t>, LatencyBuckets.size() + 1> latency_counts{};
+
+  // a min-heap on latency, and its smallest latency once full
+  mutable std::mutex slow_mtx;
+  std::vector<SlowEvent> slowest;
+  std::atomic<double> slow_threshold{0};
+
+  std::thread exporter;
+  std::mutex export_mtx;
+  std::condition_variable export_cv;
+  bool exporting = false;
+  std::string export_file;
+};
+
+} // namespace nvconv
@@ -0,0 +1,288 @@
+#include "nvoutput.h"
+
+#include "nvgzip.h"
+
+#include "NuHepMC/make_writer.hxx"
+
+#include "HepMC3/ReaderAscii.h"
+#include "HepMC3/ReaderFactory.h"
+#include "HepMC3/WriterAscii.h"
+
+#ifdef NVCONV_PROTOBUF
+#include "HepMC3/ReaderProtobuf.h"
+#include "HepMC3/WriterProtobuf.h"
+#endif
+
+#include <iostream>
+#include <stdexcept>
+
+namespace nvconv {
+
+namespace {
+
+bool EndsWith(std::string const &str, std::string const &end) {
+  return (str.size() > end.size()) &&
+         !str.compare(str.size() - end.size(), end.size(), end);
+}
+
+[[noreturn]] void ThrowNoProtobuf() {
+  throw std::runtime_error("neutvect-converter: [ERROR]: nvconv was built "
+                           "without HepMC3 protobuf support.");
+}
+
+HepMC3::Writer *NewStreamWriter(std::ostream &stream,
+                                std::shared_ptr<HepMC3::GenRunInfo> gri,
+                                OutputFormat format) {
+  if (format == OutputFormat::Protobuf) {
+#ifdef NVCONV_PROTOBUF
+    return new HepMC3::WriterProtobuf(stream, gri);
+#else
+    ThrowNoProtobuf();
+#endif
+  }
+  return new HepMC3::WriterAscii(stream, gri);
+}
+
+} // namespace
+
+// Passes everything written through to sink, counting the bytes and keeping
+// the checksum of those since the last Reset, so that each event written by a
+// HepMC3 writer can be indexed.
+class ChecksumOutputBuf : public std::streambuf {
+public:
+  ChecksumOutputBuf(std::streambuf *sink)
+      : sink(sink), checksum(0), total(0) {}
+
+  void Reset() { checksum = 0; }
+  uint32_t Checksum() const { return checksum; }
+  uint64_t Total() const { return total; }
+
+protected:
+  int_type overflow(int_type c) override {
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+      return traits_type::not_eof(c);
+    }
+    char ch = traits_type::to_char_type(c);
+    return (xsputn(&ch, 1) == 1) ? c : traits_type::eof();
+  }
+
+  std::streamsize xsputn(char const *s, std::streamsize n) override {
+    checksum = EventIndex::Checksum(s, n, checksum);
+    total += n;
+    return sink->sputn(s, n);
+  }
+
+  int sync() override { return sink->pubsync(); }
+
+private:
+  std::streambuf *sink;
+  uint32_t checksum;
+  uint64_t total;
+};
+
+OutputFormat GuessOutputFormat(std::string const &filename) {
+  std::string name = filename;
+  if (IsCompressedOutput(name)) {
+    name.resize(name.size() - 3);
+  }
+
+  if (EndsWith(name, ".hepmc3") || EndsWith(name, ".hepmc")) {
+    return OutputFormat::Ascii;
+  } else if (EndsWith(name, ".pb")) {
+    return OutputFormat::Protobuf;
+  }
+  return OutputFormat::Other;
+}
+
+bool IsCompressedOutput(std::string const &filename) {
+  return EndsWith(filename, ".gz");
+}
+
+StreamFileWriter::StreamFileWriter(std::string const &filename,
+                                   std::shared_ptr<HepMC3::GenRunInfo> gri,
+                                   OutputFormat format, bool compress,
+                                   int compress_threads)
+    : filename(filename), fout(filename, std::ios::binary),
+      stream(fout.rdbuf()) {
+  if (compress) {
+    gzbuf =
+        std::make_unique<GzipBlockOutputBuf>(fout.rdbuf(), compress_threads);
+  }
+  checksum_buf = std::make_unique<ChecksumOutputBuf>(
+      gzbuf ? static_cast<std::streambuf *>(gzbuf.get()) : fout.rdbuf());
+  stream.rdbuf(checksum_buf.get());
+  set_run_info(gri);
+  writer =
+      std::unique_ptr<HepMC3::Writer>(NewStreamWriter(stream, gri, format));
+}
+
+StreamFileWriter::~StreamFileWriter() { close(); }
+
+void StreamFileWriter::write_event(HepMC3::GenEvent const &evt) {
+  last_event.offset = Tell();
+  checksum_buf->Reset();
+  writer->write_event(evt);
+  last_event.length = uint32_t(Tell() - last_event.offset);
+  last_event.checksum = checksum_buf->Checksum();
+  last_event.evtno = evt.event_number();
+}
+
+bool StreamFileWriter::failed() {
+  return !fout.is_open() || !stream.good() || writer->failed();
+}
+
+void StreamFileWriter::close() {
+  if (!writer) {
+    return;
+  }
+  writer->close();
+  writer = nullptr;
+  stream.flush();
+  if (gzbuf) {
+    gzbuf->Finish();
+    gzbuf->Index().Write(filename + ".gzi");
+  }
+  fout.close();
+}
+
+uint64_t StreamFileWriter::Tell() const { return checksum_buf->Total(); }
+
+std::unique_ptr<HepMC3::Writer>
+MakeWriter(std::string const &filename, std::shared_ptr<HepMC3::GenRunInfo> gri,
+           OutputFormat format, bool compress, int compress_threads) {
+
+  if (format != OutputFormat::Other) {
+    return std::make_unique<StreamFileWriter>(filename, gri, format, compress,
+                                              compress_threads);
+  }
+
+  if (compress) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Can only compress HepMC3 ASCII or "
+        "protobuf output, not " +
+        filename);
+  }
+  return std::unique_ptr<HepMC3::Writer>(
+      NuHepMC::Writer::make_writer(filename, gri));
+}
+
+EventFileReader::EventFileReader(std::string const &filename)
+    : filename(filename), format(OutputFormat::Other),
+      compressed(IsGzipFile(filename)), nread(0),
+      fin(filename, std::ios::binary) {
+
+  if (!fin.is_open()) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Failed to open " +
+                             filename);
+  }
+
+  if (compressed) {
+    auto gzin = std::make_unique<GzipInputBuf>(fin.rdbuf());
+    BlockIndex index;
+    if (index.Read(filename + ".gzi")) {
+      gzin->SetIndex(std::move(index));
+    }
+    gzbuf = std::move(gzin);
+    stream = std::make_unique<std::istream>(gzbuf.get());
+  } else {
+    stream = std::make_unique<std::istream>(fin.rdbuf());
+  }
+
+  // ASCII files start with HepMC::Version and protobuf files with hmpb
+  switch (stream->peek()) {
+  case 'H': {
+    format = OutputFormat::Ascii;
+    reader = std::make_shared<HepMC3::ReaderAscii>(*stream);
+    break;
+  }
+  case 'h': {
+    format = OutputFormat::Protobuf;
+#ifdef NVCONV_PROTOBUF
+    reader = std::make_shared<HepMC3::ReaderProtobuf>(*stream);
+#else
+    ThrowNoProtobuf();
+#endif
+    break;
+  }
+  default: {
+    if (!compressed) {
+      reader = HepMC3::deduce_reader(filename);
+    }
+  }
+  }
+
+  if (!reader) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: Failed to determine the format of " +
+        filename);
+  }
+}
+
+EventFileReader::~EventFileReader() { Close(); }
+
+bool EventFileReader::ReadEvent(HepMC3::GenEvent &evt) {
+  if (reader->read_event(evt) && !reader->failed()) {
+    nread++;
+    return true;
+  }
+  return false;
+}
+
+EventIndex const *EventFileReader::Index() {
+  if (!event_index) {
+    event_index = std::make_unique<EventIndex>();
+    if (!event_index->Read(EventIndex::FileName(filename))) {
+      std::cout << "[WARN]: Failed to read event index "
+                << EventIndex::FileName(filename) << std::endl;
+    }
+  }
+  return event_index->size() ? event_index.get() : nullptr;
+}
+
+bool EventFileReader::SeekToEvent(size_t n) {
+  // other formats are not read through stream
+  if ((format == OutputFormat::Other) || !Index() ||
+      (n >= event_index->size())) {
+    return false;
+  }
+
+  // read past the header so that the run info is complete
+  if (!nread) {
+    HepMC3::GenEvent evt;
+    ReadEvent(evt);
+  }
+
+  stream->clear();
+  stream->seekg((*event_index)[n].offset);
+  return stream->good();
+}
+
+bool EventFileReader::VerifyEvent(size_t n) {
+  if ((format == OutputFormat::Other) || !Index() ||
+      (n >= event_index->size())) {
+    return false;
+  }
+
+  auto const &entry = (*event_index)[n];
+  event_bytes.resize(entry.length);
+  stream->clear();
+  return stream->seekg(entry.offset) &&
+         stream->read(&event_bytes[0], entry.length) &&
+         (EventIndex::Checksum(event_bytes) == entry.checksum);
+}
+
+bool EventFileReader::Failed() const { return reader->failed(); }
+
+std::shared_ptr<HepMC3::GenRunInfo> EventFileReader::RunInfo() const {
+  return reader->run_info();
+}
+
+void EventFileReader::Close() {
+  if (!fin.is_open()) {
+    return;
+  }
+  reader->close();
+  fin.close();
+}
+
+} // namespace nvconv
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "HepMC3/GenEvent.h"
+#include "HepMC3/GenRunInfo.h"
+#include "HepMC3/Reader.h"
+#include "HepMC3/Writer.h"
+
+#include "nvindex.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+namespace nvconv {
+
+class GzipBlockOutputBuf;
+class ChecksumOutputBuf;
+
+enum class OutputFormat {
+  Ascii,
+  // HepMC3's length-delimited protobuf messages
+  Protobuf,
+  // anything else is left to NuHepMC::Writer::make_writer
+  Other
+};
+
+// The format implied by the extension of filename, ignoring a trailing .gz:
+// .hepmc3 and .hepmc are Ascii, .pb is Protobuf.
+OutputFormat GuessOutputFormat(std::string const &filename);
+// Returns true if filename ends in .gz
+bool IsCompressedOutput(std::string const &filename);
+
+// Writes Ascii or Protobuf events through a file stream that it owns, so that
+// the offset of each event in the file is known. If compress is set, the file
+// is written as BGZF blocks compressed on compress_threads threads, see
+// GzipBlockOutputBuf, and the block index is written to filename.gzi on close.
+class StreamFileWriter : public HepMC3::Writer {
+public:
+  StreamFileWriter(std::string const &filename,
+                   std::shared_ptr<HepMC3::GenRunInfo> gri, OutputFormat format,
+                   bool compress = false, int compress_threads = 0);
+  ~StreamFileWriter();
+
+  void write_event(HepMC3::GenEvent const &evt) override;
+  bool failed() override;
+  void close() override;
+
+  // The offset at which the next event will be written, in the uncompressed
+  // stream if compressing.
+  uint64_t Tell() const;
+  // The offset, length and checksum of the last event written. The ASCII
+  // writer buffers its output, so these are only exact for Protobuf; use an
+  // AsciiFileWriter to index ASCII output.
+  EventIndexEntry LastEvent() const { return last_event; }
+
+private:
+  std::string filename;
+  std::ofstream fout;
+  std::unique_ptr<GzipBlockOutputBuf> gzbuf;
+  std::unique_ptr<ChecksumOutputBuf> checksum_buf;
+  std::ostream stream;
+  EventIndexEntry last_event;
+  std::unique_ptr<HepMC3::Writer> writer;
+};
+
+// Opens a writer for format, a StreamFileWriter for Ascii and Protobuf. Throws
+// if format cannot be written by this build or cannot be compressed.
+std::unique_ptr<HepMC3::Writer>
+MakeWriter(std::string const &filename, std::shared_ptr<HepMC3::GenRunInfo> gri,
+           OutputFormat format, bool compress, int compress_threads = 0);
+
+// Reads any file written by MakeWriter, working out the format and
+// compression from the contents of the file. A filename.gzi block index is
+// used, if there is one, to seek in compressed files.
+class EventFileReader {
+public:
+  EventFileReader(std::string const &filename);
+  ~EventFileReader();
+
+  // Returns false at the end of the file or if reading failed.
+  bool ReadEvent(HepMC3::GenEvent &evt);
+  // The filename.idx event index, or nullptr if there is none
+  EventIndex const *Index();
+  // Positions the reader so that the next call to ReadEvent reads the nth
+  // event in the file. Needs the event index. Returns false if there is no
+  // index or it has no nth event.
+  bool SeekToEvent(size_t n);
+  // Reads the bytes of the nth event, as recorded in the event index, and
+  // checks them against its checksum, without parsing them. Only the blocks
+  // holding the event are decompressed. The next ReadEvent must be preceded
+  // by a SeekToEvent.
+  bool VerifyEvent(size_t n);
+  bool Failed() const;
+  std::shared_ptr<HepMC3::GenRunInfo> RunInfo() const;
+  OutputFormat Format() const { return format; }
+  bool Compressed() const { return compressed; }
+
+  void Close();
+
+private:
+  std::string filename;
+  OutputFormat format;
+  bool compressed;
+  // the number of events read, the run info is only complete once one has
+  long nread;
+  std::unique_ptr<EventIndex> event_index;
+  std::string event_bytes;
+
+  std::ifstream fin;
+  std::unique_ptr<std::streambuf> gzbuf;
+  std::unique_ptr<std::istream> stream;
+  std::shared_ptr<HepMC3::Reader> reader;
+};
+
+} // namespace nvconv
@@ -0,0 +1,191 @@
+#include "nvparticles.h"
+
+#include "nvconv.h"
+
+#include "NuHepMC/Constants.hxx"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+
+namespace nvconv {
+
+namespace {
+
+// the NEUT particle statuses that can be converted
+int const MinNEUTStatus = -3;
+int const MaxNEUTStatus = 9;
+
+// The status of a particle in an event that is not diffractive
+constexpr int StatusFromNEUT(int fStatus, bool alive, bool neutrino,
+                             bool first) {
+  switch (fStatus) {
+  case -1: {
+    return first ? NuHepMC::ParticleStatus::IncomingBeam
+                 : NuHepMC::ParticleStatus::StruckNucleon;
+  }
+  case 0:
+  case 2: {
+    // NC FS neutrinos are not alive
+    return (alive || neutrino) ? NuHepMC::ParticleStatus::UndecayedPhysical
+                               : 0;
+  }
+  case 1: {
+    return alive ? 0 : NuHepMC::ParticleStatus::DecayedPhysical;
+  }
+  case 3:
+  case 4:
+  case 7:
+  case 8:
+  case 9:
+  case -3: { // absorbed pion
+    return alive ? 0 : NuHepMC::ParticleStatus::NEUT::UnderwentFSI;
+  }
+  case 5: {
+    return alive ? 0 : NuHepMC::ParticleStatus::NEUT::PauliBlocked;
+  }
+  case 6: {
+    return alive ? 0 : NuHepMC::ParticleStatus::NEUT::SecondaryInteraction;
+  }
+  default: {
+    return 0;
+  }
+  }
+}
+
+constexpr ParticleRole RoleFromStatus(int status) {
+  switch (status) {
+  case NuHepMC::ParticleStatus::IncomingBeam: {
+    return ParticleRole::Beam;
+  }
+  case NuHepMC::ParticleStatus::StruckNucleon: {
+    return ParticleRole::StruckNucleon;
+  }
+  case NuHepMC::ParticleStatus::UndecayedPhysical: {
+    return ParticleRole::FinalState;
+  }
+  case NuHepMC::ParticleStatus::DecayedPhysical:
+  case NuHepMC::ParticleStatus::NEUT::PauliBlocked:
+  case NuHepMC::ParticleStatus::NEUT::SecondaryInteraction:
+  case NuHepMC::ParticleStatus::NEUT::UnderwentFSI: {
+    return ParticleRole::Intermediate;
+  }
+  default: {
+    return ParticleRole::None;
+  }
+  }
+}
+
+constexpr size_t StatusIndex(int fStatus, bool alive, bool neutrino,
+                             bool first) {
+  return ((size_t(fStatus - MinNEUTStatus) * 2 + alive) * 2 + neutrino) * 2 +
+         first;
+}
+
+struct StatusEntry {
+  int status;
+  ParticleRole role;
+};
+
+constexpr std::array<StatusEntry, (MaxNEUTStatus - MinNEUTStatus + 1) * 8>
+BuildStatusTable() {
+  std::array<StatusEntry, (MaxNEUTStatus - MinNEUTStatus + 1) * 8> table{};
+  for (int fStatus = MinNEUTStatus; fStatus <= MaxNEUTStatus; ++fStatus) {
+    for (int flags = 0; flags < 8; ++flags) {
+      bool alive = flags & 4, neutrino = flags & 2, first = flags & 1;
+      int status = StatusFromNEUT(fStatus, alive, neutrino, first);
+      table[StatusIndex(fStatus, alive, neutrino, first)] =
+          StatusEntry{status, RoleFromStatus(status)};
+    }
+  }
+  return table;
+}
+
+// By NEUT status, alive flag, whether the particle is a neutrino and whether
+// it is the first in the event
+constexpr auto StatusTable = BuildStatusTable();
+
+// Diffractive events are converted as beam, struck nucleon and then final
+// state particles, whatever their NEUT status
+bool IsDiffractive(int neutmode) {
+  return (std::abs(neutmode) == 15) || (std::abs(neutmode) == 35);
+}
+
+constexpr StatusEntry DiffractiveStatus(int p_it) {
+  return (p_it == 0) ? StatusEntry{NuHepMC::ParticleStatus::IncomingBeam,
+                                   ParticleRole::Beam}
+         : (p_it == 1)
+             ? StatusEntry{NuHepMC::ParticleStatus::StruckNucleon,
+                           ParticleRole::StruckNucleon}
+             : StatusEntry{NuHepMC::ParticleStatus::UndecayedPhysical,
+                           ParticleRole::FinalState};
+}
+
+bool IsNeutrino(int pid) {
+  int abs_pid = std::abs(pid);
+  return (abs_pid == 12) || (abs_pid == 14) || (abs_pid == 16);
+}
+
+StatusEntry LookUpStatus(int fStatus, bool alive, int pid, int p_it,
+                         bool diffractive) {
+  if (diffractive) {
+    return DiffractiveStatus(p_it);
+  }
+  if ((fStatus < MinNEUTStatus) || (fStatus > MaxNEUTStatus)) {
+    return StatusEntry{0, ParticleRole::None};
+  }
+  return StatusTable[StatusIndex(fStatus, alive, IsNeutrino(pid), !p_it)];
+}
+
+} // namespace
+
+int NuHepMCParticleStatus(int fStatus, bool alive, int pid, int p_it,
+                          int neutmode) {
+  return LookUpStatus(fStatus, alive, pid, p_it, IsDiffractive(neutmode))
+      .status;
+}
+
+void NeutParticles::Fill(NeutVect *nv) {
+  npart = nv->Npart();
+  nprimary = nv->Nprimary();
+
+  px.resize(npart);
+  py.resize(npart);
+  pz.resize(npart);
+  e.resize(npart);
+  m.resize(npart);
+  pid.resize(npart);
+  status.resize(npart);
+  role.resize(npart);
+
+  bool diffractive = IsDiffractive(nv->Mode);
+  for (int p_it = 0; p_it < npart; ++p_it) {
+    NeutPart *pinfo = nv->PartInfo(p_it);
+    px[p_it] = pinfo->fP.X();
+    py[p_it] = pinfo->fP.Y();
+    pz[p_it] = pinfo->fP.Z();
+    m[p_it] = pinfo->fMass;
+    pid[p_it] = pinfo->fPID;
+    auto entry = LookUpStatus(pinfo->fStatus, pinfo->fIsAlive, pinfo->fPID,
+                              p_it, diffractive);
+    status[p_it] = entry.status;
+    role[p_it] = entry.role;
+  }
+
+  // The same arithmetic, in the same order, as TLorentzVector::SetXYZM
+  // followed by E() and M(), so that the converted events do not change.
+  double const *x = px.data(), *y = py.data(), *z = pz.data();
+  double *E = e.data(), *M = m.data();
+  for (int p_it = 0; p_it < npart; ++p_it) {
+    double p2 = x[p_it] * x[p_it] + y[p_it] * y[p_it] + z[p_it] * z[p_it];
+    double mass = M[p_it];
+    double E2 = (mass >= 0) ? (p2 + mass * mass)
+                            : std::max((p2 - mass * mass), 0.);
+    E[p_it] = std::sqrt(E2);
+    double mm = E[p_it] * E[p_it] - p2;
+    M[p_it] = (mm < 0) ? -std::sqrt(-mm) : std::sqrt(mm);
+  }
+}
+
+} // namespace nvconv
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "neutvect.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace nvconv {
+
+// What the conversion does with a NEUT particle, decided by its NuHepMC status
+enum class ParticleRole : uint8_t {
+  // the NEUT status cannot be converted
+  None,
+  // into the primary vertex
+  Beam,
+  // out of the nucleon separation vertex, if bound, and into the primary vertex
+  StruckNucleon,
+  // out of the FSI vertex, if bound, with a copy out of the primary vertex for
+  // primary particles
+  FinalState,
+  // out of the primary vertex and into the FSI vertex
+  Intermediate,
+};
+
+// The particles of a NeutVect event unpacked into contiguous arrays, with the
+// four-momentum and mass that the converted event holds, their NuHepMC status
+// and ParticleRole. The energies and masses are computed in one branch-free
+// loop over the arrays, which the compiler can vectorize, and the statuses are
+// looked up in a table built at compile time, rather than each particle going
+// through a TLorentzVector and a switch. ToGenEvent, AsciiEventEmitter and
+// FlatEvent read the particles from here, so that the NeutPart objects are
+// walked once. The arrays keep their storage between events.
+struct NeutParticles {
+  int npart = 0;
+  int nprimary = 0;
+
+  std::vector<double> px, py, pz, e, m;
+  std::vector<int> pid;
+  // 0 if the NEUT status cannot be converted
+  std::vector<int> status;
+  std::vector<ParticleRole> role;
+
+  void Fill(NeutVect *nv);
+};
+
+// The NuHepMC status of a particle with NEUT status fStatus, pid and alive flag,
+// that is the p_it'th of an event with the given NEUT mode, or 0 if it cannot
+// be converted.
+int NuHepMCParticleStatus(int fStatus, bool alive, int pid, int p_it,
+                          int neutmode);
+
+} // namespace nvconv
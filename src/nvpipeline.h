@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace nvconv {
+
+// A fixed-capacity FIFO shared between threads. Push blocks while the queue is
+// full and Pop blocks while it is empty. After Close, Push refuses new items
+// and Pop drains whatever is left before returning an empty optional.
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+  bool Push(T item) {
+    std::unique_lock<std::mutex> lock(mtx);
+    not_full.wait(lock, [&] { return closed || (items.size() < capacity); });
+    if (closed) {
+      return false;
+    }
+    items.push_back(std::move(item));
+    not_empty.notify_one();
+    return true;
+  }
+
+  std::optional<T> Pop() {
+    std::unique_lock<std::mutex> lock(mtx);
+    not_empty.wait(lock, [&] { return closed || !items.empty(); });
+    if (items.empty()) {
+      return std::optional<T>();
+    }
+    std::optional<T> item(std::move(items.front()));
+    items.pop_front();
+    not_full.notify_one();
+    return item;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = true;
+    not_full.notify_all();
+    not_empty.notify_all();
+  }
+
+private:
+  size_t capacity;
+  bool closed = false;
+  std::deque<T> items;
+  std::mutex mtx;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+};
+
+// Caps the number of items that have entered a pipeline but not yet left it.
+// Acquire blocks while the cap is reached and returns false once the limiter
+// has been closed.
+class InFlightLimiter {
+public:
+  explicit InFlightLimiter(size_t limit) : limit(limit) {}
+
+  bool Acquire() {
+    std::unique_lock<std::mutex> lock(mtx);
+    released.wait(lock, [&] { return closed || (in_flight < limit); });
+    if (closed) {
+      return false;
+    }
+    in_flight++;
+    return true;
+  }
+
+  void Release() {
+    std::lock_guard<std::mutex> lock(mtx);
+    in_flight--;
+    released.notify_one();
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = true;
+    released.notify_all();
+  }
+
+private:
+  size_t limit;
+  size_t in_flight = 0;
+  bool closed = false;
+  std::mutex mtx;
+  std::condition_variable released;
+};
+
+} // namespace nvconv
@@ -0,0 +1,449 @@
+#include "nvselect.h"
+
+#include "nvconv.h"
+
+#include "NuHepMC/Constants.hxx"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace nvconv {
+
+struct EventSelection::Node {
+  enum class Type {
+    Number,
+    Mode,
+    Totcrs,
+    TargetA,
+    TargetZ,
+    TargetH,
+    Ibound,
+    Npart,
+    Nprimary,
+    Enu,
+    BeamPDG,
+    NFinalState,
+    Abs,
+    Not,
+    Negate,
+    In,
+    Or,
+    And,
+    Equal,
+    NotEqual,
+    Less,
+    LessEqual,
+    Greater,
+    GreaterEqual,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+  };
+
+  Type type;
+  double value = 0;
+  std::vector<std::unique_ptr<Node>> args;
+  // the PDG codes of NFinalState or the values of In
+  std::vector<double> list;
+
+  Node(Type type) : type(type) {}
+
+  double Evaluate(NeutVect *nv) const;
+};
+
+namespace {
+
+using Node = EventSelection::Node;
+using Type = EventSelection::Node::Type;
+
+struct Variable {
+  char const *name;
+  Type type;
+  std::vector<std::string> members;
+};
+
+std::vector<Variable> const Variables = {
+    {"Mode", Type::Mode, {"Mode"}},
+    {"Totcrs", Type::Totcrs, {"Totcrs"}},
+    {"TargetA", Type::TargetA, {"TargetA"}},
+    {"TargetZ", Type::TargetZ, {"TargetZ"}},
+    {"TargetH", Type::TargetH, {"TargetH"}},
+    {"Ibound", Type::Ibound, {"Ibound"}},
+    {"Npart", Type::Npart, {"Npart"}},
+    {"Nprimary", Type::Nprimary, {"Nprimary"}},
+    {"Enu", Type::Enu, {"PartInfo", "Npart"}},
+    {"BeamPDG", Type::BeamPDG, {"PartInfo", "Npart"}},
+};
+
+// A recursive descent parser for the grammar in nvselect.h
+class Parser {
+public:
+  Parser(std::string const &text, std::vector<std::string> &members)
+      : text(text), pos(0), members(members) {}
+
+  std::unique_ptr<Node> Parse() {
+    auto node = ParseOr();
+    SkipSpace();
+    if (pos != text.size()) {
+      Fail("unexpected '" + text.substr(pos, 1) + "'");
+    }
+    return node;
+  }
+
+private:
+  [[noreturn]] void Fail(std::string const &msg) const {
+    throw std::runtime_error("neutvect-converter: [ERROR]: Invalid selection: " +
+                             msg + " at position " + std::to_string(pos) +
+                             " in:\n\t" + text + "\n\t" +
+                             std::string(pos, ' ') + "^");
+  }
+
+  void SkipSpace() {
+    while ((pos < text.size()) && std::isspace((unsigned char)text[pos])) {
+      pos++;
+    }
+  }
+
+  bool Accept(std::string const &token) {
+    SkipSpace();
+    if (!text.compare(pos, token.size(), token)) {
+      pos += token.size();
+      return true;
+    }
+    return false;
+  }
+
+  void Expect(std::string const &token) {
+    if (!Accept(token)) {
+      Fail("expected '" + token + "'");
+    }
+  }
+
+  void AddMembers(std::vector<std::string> const &needed) {
+    for (auto const &m : needed) {
+      if (std::find(members.begin(), members.end(), m) == members.end()) {
+        members.push_back(m);
+      }
+    }
+  }
+
+  static std::unique_ptr<Node> Binary(Type type, std::unique_ptr<Node> lhs,
+                                      std::unique_ptr<Node> rhs) {
+    auto node = std::make_unique<Node>(type);
+    node->args.push_back(std::move(lhs));
+    node->args.push_back(std::move(rhs));
+    return node;
+  }
+
+  std::unique_ptr<Node> ParseOr() {
+    auto node = ParseAnd();
+    while (Accept("||")) {
+      node = Binary(Type::Or, std::move(node), ParseAnd());
+    }
+    return node;
+  }
+
+  std::unique_ptr<Node> ParseAnd() {
+    auto node = ParseNot();
+    while (Accept("&&")) {
+      node = Binary(Type::And, std::move(node), ParseNot());
+    }
+    return node;
+  }
+
+  std::unique_ptr<Node> ParseNot() {
+    SkipSpace();
+    if (!text.compare(pos, 1, "!") && text.compare(pos, 2, "!=")) {
+      pos++;
+      auto node = std::make_unique<Node>(Type::Not);
+      node->args.push_back(ParseNot());
+      return node;
+    }
+    return ParseComparison();
+  }
+
+  std::unique_ptr<Node> ParseComparison() {
+    auto node = ParseSum();
+    // longest operators first
+    static std::vector<std::pair<char const *, Type>> const comparisons = {
+        {"==", Type::Equal},     {"!=", Type::NotEqual},
+        {"<=", Type::LessEqual}, {">=", Type::GreaterEqual},
+        {"<", Type::Less},       {">", Type::Greater},
+    };
+    for (auto const &op : comparisons) {
+      if (Accept(op.first)) {
+        return Binary(op.second, std::move(node), ParseSum());
+      }
+    }
+    SkipSpace();
+    if (!text.compare(pos, 2, "in") &&
+        !IsIdentifierChar(pos + 2 < text.size() ? text[pos + 2] : ' ')) {
+      pos += 2;
+      auto in = std::make_unique<Node>(Type::In);
+      in->args.push_back(std::move(node));
+      in->list = ParseNumberList(false);
+      return in;
+    }
+    return node;
+  }
+
+  std::unique_ptr<Node> ParseSum() {
+    auto node = ParseProduct();
+    while (true) {
+      if (Accept("+")) {
+        node = Binary(Type::Add, std::move(node), ParseProduct());
+      } else if (Accept("-")) {
+        node = Binary(Type::Subtract, std::move(node), ParseProduct());
+      } else {
+        return node;
+      }
+    }
+  }
+
+  std::unique_ptr<Node> ParseProduct() {
+    auto node = ParseUnary();
+    while (true) {
+      if (Accept("*")) {
+        node = Binary(Type::Multiply, std::move(node), ParseUnary());
+      } else if (Accept("/")) {
+        node = Binary(Type::Divide, std::move(node), ParseUnary());
+      } else {
+        return node;
+      }
+    }
+  }
+
+  std::unique_ptr<Node> ParseUnary() {
+    if (Accept("-")) {
+      auto node = std::make_unique<Node>(Type::Negate);
+      node->args.push_back(ParseUnary());
+      return node;
+    }
+    return ParsePrimary();
+  }
+
+  static bool IsIdentifierChar(char c) {
+    return std::isalnum((unsigned char)c) || (c == '_');
+  }
+
+  double ParseNumber() {
+    SkipSpace();
+    char const *begin = text.c_str() + pos;
+    char *end = nullptr;
+    double value = std::strtod(begin, &end);
+    if (end == begin) {
+      Fail("expected a number");
+    }
+    pos += end - begin;
+    return value;
+  }
+
+  // (a, b, ...), which may be empty if allow_empty
+  std::vector<double> ParseNumberList(bool allow_empty) {
+    Expect("(");
+    std::vector<double> values;
+    if (allow_empty && Accept(")")) {
+      return values;
+    }
+    do {
+      bool negative = Accept("-");
+      values.push_back(negative ? -ParseNumber() : ParseNumber());
+    } while (Accept(","));
+    Expect(")");
+    return values;
+  }
+
+  std::unique_ptr<Node> ParsePrimary() {
+    SkipSpace();
+    if (Accept("(")) {
+      auto node = ParseOr();
+      Expect(")");
+      return node;
+    }
+    if ((pos < text.size()) &&
+        (std::isdigit((unsigned char)text[pos]) || (text[pos] == '.'))) {
+      auto node = std::make_unique<Node>(Type::Number);
+      node->value = ParseNumber();
+      return node;
+    }
+
+    size_t begin = pos;
+    while ((pos < text.size()) && IsIdentifierChar(text[pos])) {
+      pos++;
+    }
+    std::string name = text.substr(begin, pos - begin);
+    if (!name.size()) {
+      Fail("expected a value");
+    }
+
+    if (name == "abs") {
+      auto node = std::make_unique<Node>(Type::Abs);
+      Expect("(");
+      node->args.push_back(ParseOr());
+      Expect(")");
+      return node;
+    }
+    if (name == "nfs") {
+      auto node = std::make_unique<Node>(Type::NFinalState);
+      node->list = ParseNumberList(true);
+      // the statuses depend on whether the mode is diffractive
+      AddMembers({"PartInfo", "Npart", "Mode"});
+      return node;
+    }
+    for (auto const &var : Variables) {
+      if (name == var.name) {
+        AddMembers(var.members);
+        return std::make_unique<Node>(var.type);
+      }
+    }
+    pos = begin;
+    Fail("unknown value '" + name + "'");
+  }
+
+  std::string const &text;
+  size_t pos;
+  std::vector<std::string> &members;
+};
+
+} // namespace
+
+double EventSelection::Node::Evaluate(NeutVect *nv) const {
+  switch (type) {
+  case Type::Number: {
+    return value;
+  }
+  case Type::Mode: {
+    return nv->Mode;
+  }
+  case Type::Totcrs: {
+    return nv->Totcrs;
+  }
+  case Type::TargetA: {
+    return nv->TargetA;
+  }
+  case Type::TargetZ: {
+    return nv->TargetZ;
+  }
+  case Type::TargetH: {
+    return nv->TargetH;
+  }
+  case Type::Ibound: {
+    return nv->Ibound;
+  }
+  case Type::Npart: {
+    return nv->Npart();
+  }
+  case Type::Nprimary: {
+    return nv->Nprimary();
+  }
+  case Type::Enu: {
+    return nv->Npart() ? nv->PartInfo(0)->fP.E() : 0;
+  }
+  case Type::BeamPDG: {
+    return nv->Npart() ? nv->PartInfo(0)->fPID : 0;
+  }
+  case Type::NFinalState: {
+    int n = 0;
+    for (int i = 0; i < nv->Npart(); ++i) {
+      if (GetNuHepMCParticleStatus(nv, i) !=
+          NuHepMC::ParticleStatus::UndecayedPhysical) {
+        continue;
+      }
+      double pid = nv->PartInfo(i)->fPID;
+      if (list.empty() || (std::find(list.begin(), list.end(), pid) !=
+                           list.end())) {
+        n++;
+      }
+    }
+    return n;
+  }
+  case Type::Abs: {
+    return std::fabs(args[0]->Evaluate(nv));
+  }
+  case Type::Not: {
+    return !args[0]->Evaluate(nv);
+  }
+  case Type::Negate: {
+    return -args[0]->Evaluate(nv);
+  }
+  case Type::In: {
+    double x = args[0]->Evaluate(nv);
+    return std::find(list.begin(), list.end(), x) != list.end();
+  }
+  case Type::Or: {
+    return args[0]->Evaluate(nv) || args[1]->Evaluate(nv);
+  }
+  case Type::And: {
+    return args[0]->Evaluate(nv) && args[1]->Evaluate(nv);
+  }
+  default: {
+    break;
+  }
+  }
+
+  double lhs = args[0]->Evaluate(nv);
+  double rhs = args[1]->Evaluate(nv);
+  switch (type) {
+  case Type::Equal: {
+    return lhs == rhs;
+  }
+  case Type::NotEqual: {
+    return lhs != rhs;
+  }
+  case Type::Less: {
+    return lhs < rhs;
+  }
+  case Type::LessEqual: {
+    return lhs <= rhs;
+  }
+  case Type::Greater: {
+    return lhs > rhs;
+  }
+  case Type::GreaterEqual: {
+    return lhs >= rhs;
+  }
+  case Type::Add: {
+    return lhs + rhs;
+  }
+  case Type::Subtract: {
+    return lhs - rhs;
+  }
+  case Type::Multiply: {
+    return lhs * rhs;
+  }
+  case Type::Divide: {
+    return lhs / rhs;
+  }
+  default: {
+    return 0;
+  }
+  }
+}
+
+EventSelection::EventSelection(std::string const &expression)
+    : expression(expression) {
+  root = Parser(this->expression, members).Parse();
+}
+
+EventSelection::~EventSelection() = default;
+
+bool EventSelection::Select(NeutVect *nv) {
+  nseen++;
+  bool selected = root->Evaluate(nv);
+  if (selected) {
+    nselected++;
+  }
+  return selected;
+}
+
+void EventSelection::PrintSummary(std::ostream &os) const {
+  os << "[INFO]: Selected " << nselected << " of " << nseen << " events ("
+     << (nseen ? (100.0 * nselected / nseen) : 0.0)
+     << "%) with: " << expression << std::endl;
+}
+
+} // namespace nvconv
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "neutvect.h"
+
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace nvconv {
+
+// A filter on the raw NeutVect values of an event, evaluated before it is
+// converted, parsed from an expression like
+//
+//   abs(Mode) < 30 && nfs(211, -211, 111) == 0 && Enu > 200
+//
+// Values:
+//   Mode, Totcrs, TargetA, TargetZ, TargetH, Ibound, Npart, Nprimary
+//                  the NeutVect members of the same name
+//   Enu, BeamPDG   the energy, in MeV, and PDG code of the beam particle
+//   nfs(pdg, ...)  the number of final state particles, those that ToGenEvent
+//                  gives NuHepMC status 1, with any of the PDG codes, or of any
+//                  code if none are given
+//   abs(x)
+// Operators, loosest binding first: || && ! (== != < <= > >=) (+ -) (* /)
+// unary -, and x in (a, b, ...), which is true if x equals any of the values.
+//
+// Safe to share between threads.
+class EventSelection {
+public:
+  // Throws std::runtime_error pointing at the first syntax error.
+  EventSelection(std::string const &expression);
+  ~EventSelection();
+
+  std::string const &Expression() const { return expression; }
+
+  // The NeutVect members that Select reads, as accepted by
+  // ActivateOnlyMembers, so that only those need to be read to decide.
+  std::vector<std::string> const &Members() const { return members; }
+
+  // Whether nv passes, counting the result.
+  bool Select(NeutVect *nv);
+
+  void PrintSummary(std::ostream &os) const;
+
+  struct Node;
+
+private:
+  std::string expression;
+  std::unique_ptr<Node> root;
+  std::vector<std::string> members;
+
+  std::atomic<long> nseen{0};
+  std::atomic<long> nselected{0};
+};
+
+} // namespace nvconv
@@ -0,0 +1,269 @@
+#include "nvsource.h"
+
+#include "nvheadertools.h"
+
+#include "NuHepMC/AttributeUtils.hxx"
+
+#include "TChainElement.h"
+#include "TFile.h"
+#include "TROOT.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace nvconv {
+
+std::pair<Long64_t, Long64_t> ShardRange(Long64_t nentries, Long64_t shard,
+                                         Long64_t nshards) {
+  return {(nentries * shard) / nshards, (nentries * (shard + 1)) / nshards};
+}
+
+std::vector<std::string> ChainFileNames(TChain &chin) {
+  std::vector<std::string> names;
+  auto files = chin.GetListOfFiles();
+  for (int fi = 0; fi < files->GetEntries(); ++fi) {
+    names.push_back(static_cast<TChainElement *>(files->At(fi))->GetTitle());
+  }
+  return names;
+}
+
+EventSource::EventSource(EventSourceOptions opts) : options(std::move(opts)) {
+
+  if (!options.files.size()) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: EventSource given no input files.");
+  }
+  if ((options.nshards < 1) || (options.shard < 0) ||
+      (options.shard >= options.nshards)) {
+    throw std::runtime_error("neutvect-converter: [ERROR]: EventSource shard " +
+                             std::to_string(options.shard) + "/" +
+                             std::to_string(options.nshards) +
+                             " is invalid, expected 0 <= k < N.");
+  }
+
+  // as in neutvect-converter, the inputs are scanned on a thread pool and then
+  // added to the chain without opening them again
+  options.files = ExpandInputFiles(options.files);
+  if (!options.fatx.metadata_cache) {
+    own_metadata_cache = std::make_unique<MetadataCache>();
+    options.fatx.metadata_cache = own_metadata_cache.get();
+  }
+  auto metadata = options.fatx.metadata_cache->Get(options.files);
+
+  chin = std::make_unique<TChain>("neuttree");
+  for (size_t fi = 0; fi < options.files.size(); ++fi) {
+    auto const &ftr = options.files[fi];
+    if (!chin->Add(ftr.c_str(), metadata[fi]->nentries)) {
+      throw std::runtime_error(
+          "neutvect-converter: [ERROR]: Failed to find tree: \"neuttree\" in "
+          "file: \"" +
+          ftr + "\".");
+    }
+  }
+
+  Long64_t ents = chin->GetEntries();
+  // as in neutvect-converter, read an entry before the flux files are opened
+  chin->GetEntry(0);
+  chin->SetBranchAddress("vectorbranch", &nv);
+
+  auto shard_range = ShardRange(ents, options.shard, options.nshards);
+  first_entry = shard_range.first + std::max(options.skip, Long64_t(0));
+  last_entry = first_entry +
+               std::min(options.nmax, shard_range.second - first_entry);
+  if (first_entry >= last_entry) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: EventSource has no entries to read, "
+        "after skipping " +
+        std::to_string(options.skip) + " of the " +
+        std::to_string(shard_range.second - shard_range.first) +
+        " in the shard.");
+  }
+  next = first_entry;
+
+  TuneInput(chin.get(), options.tuning, first_entry, last_entry);
+
+  auto first_file = std::unique_ptr<TFile>(
+      TFile::Open(options.files.front().c_str(), "READ"));
+  FATXOptions fatx_options = options.fatx;
+  fatx_options.while_converting = false;
+  fatx_options.per_target = false;
+  fatx_info = FindFATX(*chin, nv, fatx_options);
+  first_file->Close();
+  first_file = nullptr;
+
+  // as for a single output file, the run info describes the first entry of
+  // the chain, so that every shard builds the same one
+  chin->GetEntry(0);
+  target_A = nv->TargetA;
+  target_H = nv->TargetH;
+
+  gri = BuildRunInfo(NEvents(), fatx_info.fatx, fatx_info.flux_hist,
+                     fatx_info.isMonoE, fatx_info.beam_pid,
+                     fatx_info.flux_energy_to_MeV);
+  passthrough = NEUTPassthrough(options.passthrough);
+  passthrough.AddToRunInfo(nv, gri);
+  AddInputFileNames(gri, ChainFileNames(*chin));
+
+  validator = std::make_unique<EventValidator>(options.validation,
+                                               options.validate_every);
+
+  if (options.nthreads > 0) {
+    StartPipeline();
+  }
+}
+
+EventSource::~EventSource() { StopPipeline(); }
+
+bool EventSource::ReadEntry(Long64_t i, Long64_t &fentry) {
+  fentry = chin->LoadTree(i);
+  if (fentry < 0) {
+    return false;
+  }
+  chin->GetEntry(i);
+  if ((nv->TargetA != target_A) || (nv->TargetH != target_H)) {
+    throw std::runtime_error(
+        "neutvect-converter: [ERROR]: EventSource cannot convert multi-target "
+        "event vectors, entry " +
+        std::to_string(i) + " is on a different target from the first.");
+  }
+  return true;
+}
+
+std::shared_ptr<HepMC3::GenEvent>
+EventSource::Convert(NeutVect *ev, Long64_t i, int ifile,
+                     Long64_t fentry) const {
+  auto evt = std::make_shared<HepMC3::GenEvent>();
+  ToGenEvent(ev, gri, *evt, passthrough, validator.get());
+  DecorateEvent(*evt, i, ifile, fentry);
+  return evt;
+}
+
+std::shared_ptr<HepMC3::GenEvent> EventSource::Next() {
+  if (next >= last_entry) {
+    return nullptr;
+  }
+
+  if (options.nthreads <= 0) {
+    Long64_t fentry;
+    if (!ReadEntry(next, fentry)) {
+      next = last_entry;
+      return nullptr;
+    }
+    return Convert(nv, next++, chin->GetTreeNumber(), fentry);
+  }
+
+  std::unique_lock<std::mutex> lock(mtx);
+  converted_cv.wait(lock, [&] {
+    return error || converted.count(next) || !nworkers_running;
+  });
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  auto found = converted.find(next);
+  if (found == converted.end()) {
+    // the reader stopped short of last_entry
+    next = last_entry;
+    return nullptr;
+  }
+  auto evt = std::move(found->second);
+  converted.erase(found);
+  lock.unlock();
+
+  limiter->Release();
+  next++;
+  return evt;
+}
+
+size_t
+EventSource::NextBatch(std::vector<std::shared_ptr<HepMC3::GenEvent>> &batch,
+                       size_t n) {
+  size_t nadded = 0;
+  for (; nadded < n; ++nadded) {
+    auto evt = Next();
+    if (!evt) {
+      break;
+    }
+    batch.push_back(std::move(evt));
+  }
+  return nadded;
+}
+
+void EventSource::StartPipeline() {
+
+  ROOT::EnableThreadSafety();
+
+  size_t events_in_flight =
+      std::max(size_t(1), options.read_ahead * size_t(options.nthreads));
+  limiter = std::make_unique<InFlightLimiter>(events_in_flight);
+  to_convert = std::make_unique<BoundedQueue<Job>>(events_in_flight);
+  nworkers_running = options.nthreads;
+
+  for (int t = 0; t < options.nthreads; ++t) {
+    workers.emplace_back([this]() {
+      try {
+        while (auto job = to_convert->Pop()) {
+          auto evt = Convert(job->nv.get(), job->i, job->ifile, job->fentry);
+          std::lock_guard<std::mutex> lock(mtx);
+          converted.emplace(job->i, std::move(evt));
+          converted_cv.notify_all();
+        }
+      } catch (...) {
+        AbortPipeline();
+      }
+      std::lock_guard<std::mutex> lock(mtx);
+      nworkers_running--;
+      converted_cv.notify_all();
+    });
+  }
+
+  reader = std::thread([this]() {
+    try {
+      for (Long64_t i = first_entry; i < last_entry; ++i) {
+        if (!limiter->Acquire()) {
+          break;
+        }
+        Long64_t fentry;
+        if (!ReadEntry(i, fentry)) {
+          break;
+        }
+        std::unique_ptr<NeutVect> nv_copy(static_cast<NeutVect *>(nv->Clone()));
+        if (!to_convert->Push(
+                Job{i, std::move(nv_copy), chin->GetTreeNumber(), fentry})) {
+          break;
+        }
+      }
+    } catch (...) {
+      AbortPipeline();
+    }
+    to_convert->Close();
+  });
+}
+
+void EventSource::AbortPipeline() {
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!error) {
+      error = std::current_exception();
+    }
+    converted_cv.notify_all();
+  }
+  limiter->Close();
+  to_convert->Close();
+}
+
+void EventSource::StopPipeline() {
+  if (!limiter) {
+    return;
+  }
+  limiter->Close();
+  to_convert->Close();
+  if (reader.joinable()) {
+    reader.join();
+  }
+  for (auto &w : workers) {
+    w.join();
+  }
+  workers.clear();
+}
+
+} // namespace nvconv
@@ -0,0 +1,200 @@
+#pragma once
+
+#include "nvconv.h"
+#include "nvfatxtools.h"
+#include "nvinputtools.h"
+#include "nvmetacache.h"
+#include "nvpipeline.h"
+#include "nvvalidation.h"
+
+#include "neutvect.h"
+
+#include "HepMC3/GenEvent.h"
+#include "HepMC3/GenRunInfo.h"
+
+#include "TChain.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace nvconv {
+
+// The [begin, end) chain entries of the shard'th of nshards equal slices of
+// nentries entries.
+std::pair<Long64_t, Long64_t> ShardRange(Long64_t nentries, Long64_t shard,
+                                         Long64_t nshards);
+
+// The names of the files in chin, in chain order, as written to the run info by
+// AddInputFileNames.
+std::vector<std::string> ChainFileNames(TChain &chin);
+
+struct EventSourceOptions {
+  // NEUT vector files, each holding a neuttree, read in order as one chain.
+  // Directories, glob patterns and @lists are expanded by ExpandInputFiles.
+  std::vector<std::string> files;
+
+  // Only the entries of the shard'th of nshards equal slices of the chain are
+  // read, starting skip entries into it and reading at most nmax of them.
+  Long64_t shard = 0;
+  Long64_t nshards = 1;
+  Long64_t skip = 0;
+  Long64_t nmax = std::numeric_limits<Long64_t>::max();
+
+  // while_converting and per_target are ignored, the FATX is always known
+  // before the first event is handed out.
+  FATXOptions fatx;
+  PassthroughLevel passthrough = PassthroughLevel::Full;
+  ValidationLevel validation = ValidationLevel::None;
+  long validate_every = 100;
+  InputTuning tuning;
+
+  // With 0, each event is read and converted on the calling thread by Next.
+  // Otherwise, entries are read ahead on a background thread and converted on
+  // nthreads workers, with at most read_ahead events per worker held between
+  // being read and being handed out.
+  int nthreads = 0;
+  size_t read_ahead = 64;
+};
+
+// Converts NEUT vector files to NuHepMC events in memory, for programs that
+// link libnvconv rather than reading back the converted files. The run info and
+// events are the same as those neutvect-converter writes, including the event
+// numbers and the ifile attributes, and events are handed out in chain order
+// whatever the number of threads. The run info is built from the first entry of
+// the chain, and an event on a different target is an error, as for a single
+// output file.
+//
+//   nvconv::EventSourceOptions opts;
+//   opts.files = {"neutvect.root"};
+//   opts.nthreads = 4;
+//   nvconv::EventSource source(opts);
+//   for (auto const &evt : source) { ... }
+//
+// Not safe to share between threads, though it uses its own threads.
+class EventSource {
+public:
+  // Opens the chain and finds its FATX. Throws std::runtime_error if the input
+  // cannot be read or the entry range is empty.
+  explicit EventSource(EventSourceOptions options);
+  ~EventSource();
+
+  EventSource(EventSource const &) = delete;
+  EventSource &operator=(EventSource const &) = delete;
+
+  std::shared_ptr<HepMC3::GenRunInfo> RunInfo() const { return gri; }
+  // In pb/Nucleon
+  double FATX() const { return fatx_info.fatx; }
+
+  // The [FirstEntry, LastEntry) range of chain entries handed out
+  Long64_t FirstEntry() const { return first_entry; }
+  Long64_t LastEntry() const { return last_entry; }
+  Long64_t NEvents() const { return last_entry - first_entry; }
+
+  // The next converted event, or nullptr once every entry has been handed out.
+  // Rethrows any error met while reading or converting ahead.
+  std::shared_ptr<HepMC3::GenEvent> Next();
+
+  // Appends up to n events to batch, returning how many were appended, fewer
+  // than n only at the end of the input.
+  size_t NextBatch(std::vector<std::shared_ptr<HepMC3::GenEvent>> &batch,
+                   size_t n);
+
+  EventValidator const &Validator() const { return *validator; }
+
+  // A single-pass input iterator over the events that are left, begin() takes
+  // the next event.
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::shared_ptr<HepMC3::GenEvent>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const *;
+    using reference = value_type const &;
+
+    iterator() = default;
+    explicit iterator(EventSource *source) : source(source) { ++*this; }
+
+    reference operator*() const { return evt; }
+    pointer operator->() const { return &evt; }
+    iterator &operator++() {
+      evt = source->Next();
+      if (!evt) {
+        source = nullptr;
+      }
+      return *this;
+    }
+
+    bool operator==(iterator const &other) const {
+      return source == other.source;
+    }
+    bool operator!=(iterator const &other) const { return !(*this == other); }
+
+  private:
+    EventSource *source = nullptr;
+    value_type evt;
+  };
+
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(); }
+
+private:
+  struct Job {
+    Long64_t i;
+    std::unique_ptr<NeutVect> nv;
+    int ifile;
+    Long64_t fentry;
+  };
+
+  // Reads entry i into nv, returning false if it is past the end of the chain.
+  // Throws if it is on a different target from the run info.
+  bool ReadEntry(Long64_t i, Long64_t &fentry);
+  std::shared_ptr<HepMC3::GenEvent> Convert(NeutVect *ev, Long64_t i,
+                                            int ifile, Long64_t fentry) const;
+
+  void StartPipeline();
+  void StopPipeline();
+  // Records the current exception and stops the pipeline threads
+  void AbortPipeline();
+
+  EventSourceOptions options;
+
+  // used if options.fatx.metadata_cache is not set
+  std::unique_ptr<MetadataCache> own_metadata_cache;
+  std::unique_ptr<TChain> chin;
+  NeutVect *nv = nullptr;
+  Long64_t first_entry = 0;
+  Long64_t last_entry = 0;
+  // the next entry to hand out
+  Long64_t next = 0;
+
+  FATXInfo fatx_info;
+  std::shared_ptr<HepMC3::GenRunInfo> gri;
+  NEUTPassthrough passthrough;
+  std::unique_ptr<EventValidator> validator;
+  int target_A = 0;
+  int target_H = 0;
+
+  // read-ahead pipeline, only used with options.nthreads > 0
+  std::unique_ptr<InFlightLimiter> limiter;
+  std::unique_ptr<BoundedQueue<Job>> to_convert;
+  std::thread reader;
+  std::vector<std::thread> workers;
+
+  std::mutex mtx;
+  std::condition_variable converted_cv;
+  std::map<Long64_t, std::shared_ptr<HepMC3::GenEvent>> converted;
+  int nworkers_running = 0;
+  std::exception_ptr error = nullptr;
+};
+
+} // namespace nvconv
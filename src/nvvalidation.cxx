@@ -0,0 +1,108 @@
+#include "nvvalidation.h"
+
+#include "NuHepMC/EventUtils.hxx"
+
+#include "HepMC3/Print.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace nvconv {
+
+bool EventValidator::ShouldValidate() {
+  switch (level) {
+  case ValidationLevel::None: {
+    return false;
+  }
+  case ValidationLevel::Sampled: {
+    return !(nseen++ % sample_every);
+  }
+  default: {
+    nseen++;
+    return true;
+  }
+  }
+}
+
+bool EventValidator::Record(ParticleCounts const &counts) {
+  nvalidated++;
+  if (counts.Valid()) {
+    return true;
+  }
+  nfailed++;
+  if (!counts.beam) {
+    no_beam++;
+  }
+  if (!counts.target) {
+    no_target++;
+  }
+  if (!counts.final_state) {
+    no_final_state++;
+  }
+  return false;
+}
+
+bool EventValidator::ShouldReport() { return nreported++ < max_reported; }
+
+void EventValidator::PrintSummary(std::ostream &os) const {
+  if (level == ValidationLevel::None) {
+    os << "[INFO]: Event validation was disabled." << std::endl;
+    return;
+  }
+
+  os << "[INFO]: Validated " << nvalidated << " of " << nseen << " events";
+  if (!nfailed) {
+    os << ", all passed." << std::endl;
+    return;
+  }
+  os << ", " << nfailed << " failed:\n"
+     << "\t" << no_beam << " with no beam particle\n"
+     << "\t" << no_target << " with no target particle\n"
+     << "\t" << no_final_state << " with no final state particles\n";
+  if (nreported > max_reported) {
+    os << "\tonly the first " << max_reported << " failures were printed.\n";
+  }
+  os << std::flush;
+}
+
+ParticleCounts CountParticles(HepMC3::GenEvent const &evt) {
+  ParticleCounts counts;
+  counts.beam = bool(NuHepMC::Event::GetBeamParticle(evt));
+  counts.target = bool(NuHepMC::Event::GetTargetParticle(evt));
+  counts.final_state =
+      NuHepMC::Event::GetParticles_All(
+          evt, NuHepMC::ParticleStatus::UndecayedPhysical)
+          .size();
+  return counts;
+}
+
+void ReportInvalidEvent(HepMC3::GenEvent const &evt, NeutVect *nv,
+                        ParticleCounts const &counts) {
+  HepMC3::Print::listing(evt);
+  std::stringstream ss;
+
+  int npart = nv->Npart();
+  int nprimary = nv->Nprimary();
+  for (int p_it = 0; p_it < npart; ++p_it) {
+    auto pinfo = nv->PartInfo(p_it);
+    ss << "p[" << p_it << "]- pid: " << pinfo->fPID
+       << ", prim: " << (p_it < nprimary) << ", status: " << pinfo->fStatus
+       << ", alive: " << pinfo->fIsAlive << "\n";
+  }
+
+  std::cout << ss.str() << std::endl;
+  nv->Dump();
+#ifdef NEUTCONV_DEBUG
+  if (!counts.beam) {
+    throw std::runtime_error("neutvect event contained no beam particle");
+  }
+  if (!counts.target) {
+    throw std::runtime_error("neutvect event contained no target particle");
+  }
+  throw std::runtime_error(
+      "neutvect event contained no final state particles");
+#endif
+}
+
+} // namespace nvconv
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "neutvect.h"
+
+#include "HepMC3/GenEvent.h"
+
+#include <atomic>
+#include <ostream>
+
+namespace nvconv {
+
+enum class ValidationLevel { None, Sampled, Full };
+
+// The particles in a converted event that validation looks for.
+struct ParticleCounts {
+  int beam = 0;
+  int target = 0;
+  int final_state = 0;
+
+  bool Valid() const { return beam && target && final_state; }
+};
+
+// Decides which converted events are checked for a beam particle, a target
+// particle and at least one final state particle, and keeps count of the
+// failures. With ValidationLevel::Full, every event is checked against the
+// particle counts made while it was built. With ValidationLevel::Sampled, one
+// in every sample_every events is checked by walking the built event with the
+// NuHepMC event utilities instead, as an independent check of the conversion.
+// Safe to share between threads.
+class EventValidator {
+public:
+  EventValidator(ValidationLevel level = ValidationLevel::Full,
+                 long sample_every = 100, long max_reported = 10)
+      : level(level), sample_every(sample_every), max_reported(max_reported) {}
+
+  ValidationLevel Level() const { return level; }
+
+  // Whether the next converted event is to be checked.
+  bool ShouldValidate();
+  // Counts the result of checking an event, returns false if it failed.
+  bool Record(ParticleCounts const &counts);
+  // Whether a failed event should be printed, only the first max_reported are.
+  bool ShouldReport();
+
+  void PrintSummary(std::ostream &os) const;
+
+private:
+  ValidationLevel level;
+  long sample_every;
+  long max_reported;
+
+  std::atomic<long> nseen{0};
+  std::atomic<long> nvalidated{0};
+  std::atomic<long> nfailed{0};
+  std::atomic<long> nreported{0};
+  std::atomic<long> no_beam{0};
+  std::atomic<long> no_target{0};
+  std::atomic<long> no_final_state{0};
+};
+
+// Counts the beam, target and final state particles in evt by walking it.
+ParticleCounts CountParticles(HepMC3::GenEvent const &evt);
+
+// Prints evt and the NEUT particles that it was converted from. In debug
+// builds, also throws to stop the conversion.
+void ReportInvalidEvent(HepMC3::GenEvent const &evt, NeutVect *nv,
+                        ParticleCounts const &counts);
+
+} // namespace nvconv
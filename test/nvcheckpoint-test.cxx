@@ -0,0 +1,210 @@
+#include "nvasciitools.h"
+#include "nvcheckpoint.h"
+
+#include "nvtest.h"
+
+#include "HepMC3/GenRunInfo.h"
+
+#include "TH1D.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+// Tests that checkpoints read back as they were written, that writing one
+// replaces the last, and that an output resumed from a checkpoint ends up the
+// same as one written without stopping.
+
+nvconv::Checkpoint MakeCheckpoint() {
+  nvconv::Checkpoint checkpoint;
+  checkpoint.output = "neut out.hepmc3";
+  checkpoint.inputs = {"neut_0.root", "neut 1.root"};
+  checkpoint.first_entry = 100;
+  checkpoint.last_entry = 5000;
+  checkpoint.flux = "flux.root,numu_flux";
+  checkpoint.next_entry = 2100;
+  checkpoint.last_evtno = 2098;
+  checkpoint.last_fname = "neut 1.root";
+  checkpoint.last_fentry = 98;
+  checkpoint.nevents = 1900;
+  checkpoint.nexposure = 2000;
+  checkpoint.nbytes = 123456789;
+  checkpoint.offset = 123457000;
+  return checkpoint;
+}
+
+void TestRoundTrip() {
+  std::string filename = nvtest::TempPath("nvcheckpoint-test.ckpt");
+
+  nvconv::FATXInfo info;
+  // not exactly representable in a short decimal
+  info.fatx = 1.0 / 3.0;
+  info.isMonoE = false;
+  info.beam_pid = 14;
+  info.flux_energy_to_MeV = 1;
+  double const edges[] = {0, 250, 600, 1000.5};
+  info.flux_hist = std::make_unique<TH1D>("nvcheckpoint_test_flux", "", 3,
+                                          edges);
+  info.flux_hist->SetDirectory(nullptr);
+  info.flux_hist->SetBinContent(1, 0.1);
+  info.flux_hist->SetBinContent(2, 2.0 / 7.0);
+  info.flux_hist->SetBinContent(3, 5E-9);
+  info.flux_hist->GetYaxis()->SetTitle("/cm^2/50MeV/1e21 POT");
+
+  nvconv::Checkpoint written = MakeCheckpoint();
+  written.SetFATXInfo(info);
+  NVTEST_CHECK(written.Write(filename));
+  NVTEST_CHECK(!std::filesystem::exists(filename + ".tmp"));
+
+  nvconv::Checkpoint read;
+  NVTEST_CHECK(read.Read(filename));
+  NVTEST_CHECK(read.output == written.output);
+  NVTEST_CHECK(read.inputs == written.inputs);
+  NVTEST_CHECK(read.first_entry == written.first_entry);
+  NVTEST_CHECK(read.last_entry == written.last_entry);
+  NVTEST_CHECK(read.flux == written.flux);
+  NVTEST_CHECK(read.next_entry == written.next_entry);
+  NVTEST_CHECK(read.last_evtno == written.last_evtno);
+  NVTEST_CHECK(read.last_fname == written.last_fname);
+  NVTEST_CHECK(read.last_fentry == written.last_fentry);
+  NVTEST_CHECK(read.nevents == written.nevents);
+  NVTEST_CHECK(read.nexposure == written.nexposure);
+  NVTEST_CHECK(read.nbytes == written.nbytes);
+  NVTEST_CHECK(read.offset == written.offset);
+
+  // the FATX and flux must be exactly those found before converting
+  nvconv::FATXInfo read_info = read.GetFATXInfo();
+  NVTEST_CHECK(read_info.fatx == info.fatx);
+  NVTEST_CHECK(read_info.isMonoE == info.isMonoE);
+  NVTEST_CHECK(read_info.beam_pid == info.beam_pid);
+  NVTEST_CHECK(read_info.flux_energy_to_MeV == info.flux_energy_to_MeV);
+  NVTEST_CHECK(read_info.flux_hist);
+  if (read_info.flux_hist) {
+    TAxis const *axis = read_info.flux_hist->GetXaxis();
+    NVTEST_CHECK(axis->GetNbins() == 3);
+    for (int i = 0; (i < 3) && (i < axis->GetNbins()); ++i) {
+      NVTEST_CHECK(axis->GetBinLowEdge(i + 1) == edges[i]);
+      NVTEST_CHECK(axis->GetBinUpEdge(i + 1) == edges[i + 1]);
+      NVTEST_CHECK(read_info.flux_hist->GetBinContent(i + 1) ==
+                   info.flux_hist->GetBinContent(i + 1));
+    }
+    NVTEST_CHECK(std::string(read_info.flux_hist->GetYaxis()->GetTitle()) ==
+                 info.flux_hist->GetYaxis()->GetTitle());
+  }
+
+  // a later checkpoint replaces it, and one without a flux has no histogram
+  nvconv::Checkpoint later = MakeCheckpoint();
+  later.next_entry = 3100;
+  later.flux = "";
+  NVTEST_CHECK(later.Write(filename));
+  NVTEST_CHECK(read.Read(filename));
+  NVTEST_CHECK(read.next_entry == 3100);
+  NVTEST_CHECK(read.flux.empty());
+  NVTEST_CHECK(!read.GetFATXInfo().flux_hist);
+
+  NVTEST_CHECK(!read.Read(nvtest::TempPath("nvcheckpoint-test-missing.ckpt")));
+  {
+    std::ofstream garbage(filename);
+    garbage << "not a checkpoint\n";
+  }
+  NVTEST_CHECK(!read.Read(filename));
+  {
+    std::ofstream old(filename);
+    old << "version 1\noutput neut.hepmc3\n";
+  }
+  NVTEST_CHECK(!read.Read(filename));
+
+  std::remove(filename.c_str());
+}
+
+std::string EventText(int i) {
+  return "E " + std::to_string(i) + " 0 " + std::to_string(i % 7) + "\n";
+}
+
+std::string ReadFile(std::string const &filename) {
+  std::ifstream fin(filename, std::ios::binary);
+  std::stringstream ss;
+  ss << fin.rdbuf();
+  return ss.str();
+}
+
+// Writes an output that dies after writing more events than its last
+// checkpoint recorded, resumes it from that checkpoint as --resume does, and
+// compares it with the same output written in one go.
+void TestResume() {
+  auto gri = std::make_shared<HepMC3::GenRunInfo>();
+  gri->tools().push_back({"nvcheckpoint-test", "1", ""});
+
+  std::string expected_file = nvtest::TempPath("nvcheckpoint-test-all.hepmc3");
+  {
+    nvconv::AsciiFileWriter writer(expected_file, gri);
+    for (int i = 0; i < 20; ++i) {
+      writer.WriteEventText(EventText(i));
+    }
+    writer.Close();
+  }
+
+  std::string filename = nvtest::TempPath("nvcheckpoint-test.hepmc3");
+  std::string checkpoint_file = filename + ".ckpt";
+  {
+    nvconv::AsciiFileWriter writer(filename, gri);
+    nvconv::Checkpoint checkpoint = MakeCheckpoint();
+    NVTEST_CHECK(writer.Flush());
+    checkpoint.next_entry = 0;
+    checkpoint.nevents = 0;
+    checkpoint.offset = writer.Tell();
+    NVTEST_CHECK(checkpoint.Write(checkpoint_file));
+    for (int i = 0; i < 15; ++i) {
+      writer.WriteEventText(EventText(i));
+      if (i == 11) {
+        NVTEST_CHECK(writer.Flush());
+        checkpoint.next_entry = i + 1;
+        checkpoint.nevents = i + 1;
+        checkpoint.offset = writer.Tell();
+        NVTEST_CHECK(checkpoint.Write(checkpoint_file));
+      }
+    }
+    // half an event, as if the conversion was killed while writing
+    std::string partial = EventText(15);
+    writer.WriteEventText(partial.substr(0, partial.size() / 2));
+    writer.Flush();
+    // not closed, so that no footer is written
+    std::filesystem::copy_file(
+        filename, filename + ".killed",
+        std::filesystem::copy_options::overwrite_existing);
+  }
+  std::filesystem::rename(filename + ".killed", filename);
+
+  nvconv::Checkpoint checkpoint;
+  NVTEST_CHECK(checkpoint.Read(checkpoint_file));
+  NVTEST_CHECK(checkpoint.next_entry == 12);
+  NVTEST_CHECK(checkpoint.nevents == 12);
+  {
+    nvconv::AsciiFileWriter writer(filename, checkpoint.offset);
+    NVTEST_CHECK(!writer.Failed());
+    NVTEST_CHECK(writer.Tell() == checkpoint.offset);
+    for (int i = int(checkpoint.next_entry); i < 20; ++i) {
+      writer.WriteEventText(EventText(i));
+    }
+    writer.Close();
+  }
+  NVTEST_CHECK(ReadFile(filename) == ReadFile(expected_file));
+
+  // an output shorter than its checkpoint cannot be resumed
+  NVTEST_CHECK_THROWS(
+      nvconv::AsciiFileWriter(filename, ReadFile(filename).size() + 1),
+      "Cannot resume");
+
+  std::remove(expected_file.c_str());
+  std::remove(filename.c_str());
+  std::remove(checkpoint_file.c_str());
+}
+
+int main() {
+  TestRoundTrip();
+  TestResume();
+  return nvtest::Result();
+}
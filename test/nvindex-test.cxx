@@ -0,0 +1,190 @@
+#include "nvgzip.h"
+#include "nvindex.h"
+
+#include "nvtest.h"
+
+#include <cstdio>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Tests that .idx event indexes and .gzi block indexes read back as they were
+// written, including an event index reopened to resume from a checkpoint, and
+// that together they find every event in a block compressed file.
+
+std::vector<std::string> const FileNames = {"neut_0.root", "neut 1.root"};
+
+nvconv::EventIndexEntry MakeEntry(int64_t i) {
+  nvconv::EventIndexEntry entry;
+  entry.offset = 1000 + 300 * i;
+  entry.length = 250 + i;
+  entry.checksum = 0xdeadbeef ^ uint32_t(i);
+  entry.evtno = 5 + i;
+  entry.ifile = (i < 6) ? 0 : 1;
+  entry.fentry = (i < 6) ? i : (i - 6);
+  return entry;
+}
+
+bool SameEntry(nvconv::EventIndexEntry const &a,
+               nvconv::EventIndexEntry const &b) {
+  return (a.offset == b.offset) && (a.length == b.length) &&
+         (a.checksum == b.checksum) && (a.evtno == b.evtno) &&
+         (a.ifile == b.ifile) && (a.fentry == b.fentry);
+}
+
+void TestEventIndex() {
+  std::string filename = nvtest::TempPath("nvindex-test.idx");
+
+  nvconv::EventIndexWriter writer;
+  NVTEST_CHECK(writer.Open(filename, FileNames));
+  for (int64_t i = 0; i < 10; ++i) {
+    writer.Add(MakeEntry(i));
+  }
+  NVTEST_CHECK(writer.Flush());
+
+  // the event count is only written on Close
+  nvconv::EventIndex index;
+  NVTEST_CHECK(!index.Read(filename));
+
+  NVTEST_CHECK(writer.Close());
+  NVTEST_CHECK(index.Read(filename));
+  NVTEST_CHECK(index.FileNames() == FileNames);
+  NVTEST_CHECK(index.size() == 10);
+  for (int64_t i = 0; (i < 10) && (size_t(i) < index.size()); ++i) {
+    NVTEST_CHECK(SameEntry(index[i], MakeEntry(i)));
+  }
+
+  NVTEST_CHECK(index.FindEvent(5) == size_t(0));
+  NVTEST_CHECK(index.FindEvent(14) == size_t(9));
+  NVTEST_CHECK(!index.FindEvent(15));
+  NVTEST_CHECK(index.FindEntry("neut 1.root", 2) == size_t(8));
+  NVTEST_CHECK(!index.FindEntry("neut 1.root", 4));
+
+  auto parts = index.Partition(3);
+  NVTEST_CHECK(parts.size() == 3);
+  if (parts.size() == 3) {
+    NVTEST_CHECK(parts[0].first == 0);
+    NVTEST_CHECK(parts[0].second == parts[1].first);
+    NVTEST_CHECK(parts[1].second == parts[2].first);
+    NVTEST_CHECK(parts[2].second == 10);
+  }
+
+  // written in one go, as the shard merge does
+  std::string copy = nvtest::TempPath("nvindex-test-copy.idx");
+  NVTEST_CHECK(index.Write(copy));
+  nvconv::EventIndex copied;
+  NVTEST_CHECK(copied.Read(copy));
+  NVTEST_CHECK(copied.FileNames() == FileNames);
+  NVTEST_CHECK(copied.size() == index.size());
+
+  NVTEST_CHECK(!copied.Read(nvtest::TempPath("nvindex-test-missing.idx")));
+  {
+    std::ofstream garbage(copy, std::ios::binary);
+    garbage << "not an event index";
+  }
+  NVTEST_CHECK(!copied.Read(copy));
+
+  std::remove(filename.c_str());
+  std::remove(copy.c_str());
+}
+
+// As --resume reopens the index of a conversion that died after writing more
+// entries than its last checkpoint recorded.
+void TestResumedEventIndex() {
+  std::string filename = nvtest::TempPath("nvindex-test-resume.idx");
+  {
+    nvconv::EventIndexWriter writer;
+    NVTEST_CHECK(writer.Open(filename, FileNames));
+    for (int64_t i = 0; i < 7; ++i) {
+      writer.Add(MakeEntry(i));
+    }
+    NVTEST_CHECK(writer.Flush());
+    // not closed, as if the conversion was killed
+  }
+
+  nvconv::EventIndexWriter resumed;
+  NVTEST_CHECK(!resumed.Open(filename, {"other.root"}, 4));
+  NVTEST_CHECK(!resumed.Open(filename, FileNames, 8));
+  NVTEST_CHECK(resumed.Open(filename, FileNames, 4));
+  NVTEST_CHECK(resumed.size() == 4);
+  for (int64_t i = 4; i < 10; ++i) {
+    resumed.Add(MakeEntry(i));
+  }
+  NVTEST_CHECK(resumed.Close());
+
+  nvconv::EventIndex index;
+  NVTEST_CHECK(index.Read(filename));
+  NVTEST_CHECK(index.size() == 10);
+  for (int64_t i = 0; (i < 10) && (size_t(i) < index.size()); ++i) {
+    NVTEST_CHECK(SameEntry(index[i], MakeEntry(i)));
+  }
+
+  std::remove(filename.c_str());
+}
+
+// Writes events through a GzipBlockOutputBuf, indexing them as the converter
+// does, and reads each one back by seeking to it through the block index.
+void TestBlockIndex(int nthreads) {
+  std::string filename = nvtest::TempPath("nvindex-test.hepmc3.gz");
+  std::string gzi = filename + ".gzi";
+
+  std::vector<std::string> events;
+  nvconv::EventIndex index;
+  {
+    std::filebuf sink;
+    sink.open(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    nvconv::GzipBlockOutputBuf gzbuf(&sink, nthreads);
+    std::ostream os(&gzbuf);
+    for (int i = 0; i < 3000; ++i) {
+      std::string text = "E " + std::to_string(i) + " " +
+                         std::string(100 + (i * 37) % 200, 'a' + (i % 26)) +
+                         "\n";
+      index.Add({gzbuf.Tell(), uint32_t(text.size()),
+                 nvconv::EventIndex::Checksum(text), i, 0, i});
+      os << text;
+      events.push_back(text);
+    }
+    os.flush();
+    NVTEST_CHECK(gzbuf.Finish());
+    NVTEST_CHECK(gzbuf.Index().blocks.size() > 1);
+    NVTEST_CHECK(gzbuf.Index().Write(gzi));
+  }
+
+  nvconv::BlockIndex blocks;
+  NVTEST_CHECK(blocks.Read(gzi));
+  NVTEST_CHECK(blocks.blocks.size() > 1);
+  NVTEST_CHECK(!nvconv::BlockIndex().Read(
+      nvtest::TempPath("nvindex-test-missing.gzi")));
+
+  std::filebuf source;
+  source.open(filename, std::ios::in | std::ios::binary);
+  nvconv::GzipInputBuf gzbuf(&source);
+  gzbuf.SetIndex(blocks);
+  std::istream is(&gzbuf);
+
+  int nbad = 0;
+  // backwards, so that every read seeks
+  for (size_t n = index.size(); n-- > 0;) {
+    std::string text(index[n].length, '\0');
+    is.seekg(index[n].offset);
+    is.read(&text[0], text.size());
+    nbad += (!is || (text != events[n]) ||
+             (nvconv::EventIndex::Checksum(text) != index[n].checksum));
+    is.clear();
+  }
+  NVTEST_CHECK(!nbad);
+  NVTEST_CHECK(!gzbuf.Failed());
+
+  std::remove(filename.c_str());
+  std::remove(gzi.c_str());
+}
+
+int main() {
+  TestEventIndex();
+  TestResumedEventIndex();
+  TestBlockIndex(0);
+  TestBlockIndex(2);
+  return nvtest::Result();
+}
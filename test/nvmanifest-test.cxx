@@ -0,0 +1,158 @@
+#include "nvmanifest.h"
+#include "nvmetacache.h"
+
+#include "nvtest.h"
+
+#include "TH1D.h"
+
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Tests that a manifest built up over incremental parts combines their FATX as
+// a single run over all of their inputs would, refuses inputs it cannot
+// combine, and reads back as it was written.
+
+using MetadataList = std::vector<std::shared_ptr<nvconv::FileMetadata const>>;
+
+std::unique_ptr<TH1> MakeHist(std::string const &name, double scale) {
+  auto hist = std::make_unique<TH1D>(name.c_str(), "", 4, 0, 4000);
+  hist->SetDirectory(nullptr);
+  for (int i = 1; i <= 4; ++i) {
+    hist->SetBinContent(i, scale * i);
+  }
+  return hist;
+}
+
+// The metadata of an input whose first nmono entries share the beam energy E,
+// with flux and rate histograms if flux_scale is nonzero
+std::shared_ptr<nvconv::FileMetadata const>
+MakeMeta(std::string const &uuid, Long64_t nentries, double E,
+         double flux_scale = 0, double rate_scale = 0, int beam_pid = 14) {
+  auto meta = std::make_shared<nvconv::FileMetadata>();
+  meta->uuid = uuid;
+  meta->nentries = nentries;
+  meta->first_E = E;
+  meta->first_totcrs = E * 1E-3;
+  meta->nmono = flux_scale ? 1 : nentries;
+  meta->beam_pid = beam_pid;
+  if (flux_scale) {
+    meta->flux_hist = MakeHist("flux_" + uuid, flux_scale);
+    meta->rate_hist = MakeHist("rate_" + uuid, rate_scale);
+  }
+  return meta;
+}
+
+bool Near(double a, double b) {
+  return std::fabs(a - b) <= 1E-12 * std::fabs(b);
+}
+
+void TestMonoParts() {
+  std::string filename = nvtest::TempPath("nvmanifest-test-mono.root");
+  {
+    nvconv::ConversionManifest manifest(filename, "neut.hepmc3");
+    NVTEST_CHECK(manifest.NParts() == 0);
+    NVTEST_CHECK(std::isnan(manifest.FATX()));
+
+    MetadataList part0 = {MakeMeta("a", 100, 600), MakeMeta("b", 50, 600)};
+    manifest.AddPart({"a.root", "b.root"}, part0);
+    MetadataList part1 = {MakeMeta("c", 0, 0), MakeMeta("d", 20, 600)};
+    manifest.AddPart({"c.root", "d.root"}, part1);
+
+    NVTEST_CHECK(manifest.NParts() == 2);
+    NVTEST_CHECK(manifest.NEvents() == 170);
+    NVTEST_CHECK(manifest.IsMonoE());
+    NVTEST_CHECK(!manifest.FluxHist());
+    NVTEST_CHECK(manifest.BeamPID() == 14);
+    NVTEST_CHECK(Near(manifest.FATX(), 0.6 * 1E-2));
+    NVTEST_CHECK(manifest.Inputs().size() == 4);
+    if (manifest.Inputs().size() == 4) {
+      NVTEST_CHECK(manifest.Inputs()[1].part == 0);
+      NVTEST_CHECK(manifest.Inputs()[3].part == 1);
+      NVTEST_CHECK(manifest.Inputs()[3].name == "d.root");
+    }
+
+    NVTEST_CHECK(manifest.Contains(*part0[1]));
+    NVTEST_CHECK(!manifest.Contains(*MakeMeta("e", 100, 600)));
+    NVTEST_CHECK_THROWS(manifest.Contains(*MakeMeta("a", 99, 600)),
+                        "had 100 entries");
+
+    // another run cannot take the manifest while this one holds it
+    NVTEST_CHECK_THROWS(nvconv::ConversionManifest(filename, "neut.hepmc3"),
+                        "Another incremental conversion holds");
+
+    // neither mono-energetic at the same energy nor with histograms
+    NVTEST_CHECK_THROWS(
+        manifest.AddPart({"f.root"}, {MakeMeta("f", 10, 800)}),
+        "Cannot combine the FATX");
+    NVTEST_CHECK_THROWS(
+        manifest.AddPart({"g.root"}, {MakeMeta("g", 10, 600, 0, 0, -14)}),
+        "beam PDG code -14");
+    // a refused part is not recorded
+    NVTEST_CHECK(manifest.NParts() == 2);
+    NVTEST_CHECK(manifest.IsMonoE());
+
+    NVTEST_CHECK(manifest.Write());
+  }
+
+  nvconv::ConversionManifest read(filename, "neut.hepmc3");
+  NVTEST_CHECK(read.NParts() == 2);
+  NVTEST_CHECK(read.NEvents() == 170);
+  NVTEST_CHECK(read.IsMonoE());
+  NVTEST_CHECK(Near(read.FATX(), 0.6 * 1E-2));
+  NVTEST_CHECK(read.Inputs().size() == 4);
+  NVTEST_CHECK(read.Contains(*MakeMeta("d", 20, 600)));
+
+  std::remove(filename.c_str());
+}
+
+// The FATX of inputs with flux and rate histograms is their n-weighted average,
+// however the inputs are split into parts.
+void TestFluxParts() {
+  std::string filename = nvtest::TempPath("nvmanifest-test-flux.root");
+  MetadataList all = {MakeMeta("a", 100, 500, 1, 3),
+                      MakeMeta("b", 300, 700, 2, 1),
+                      MakeMeta("c", 40, 900, 0.5, 8)};
+  auto frpair = nvconv::GetFluxRateHistPair(all);
+  double expected =
+      1E-2 * (frpair.first->Integral() / frpair.second->Integral());
+
+  {
+    nvconv::ConversionManifest manifest(filename, "neut.hepmc3");
+    manifest.AddPart({"a.root"}, {all[0]});
+    NVTEST_CHECK(manifest.FluxHist());
+    NVTEST_CHECK(Near(manifest.FATX(), 1E-2 * 3));
+    manifest.AddPart({"b.root", "c.root"}, {all[1], all[2]});
+
+    NVTEST_CHECK(!manifest.IsMonoE());
+    NVTEST_CHECK(manifest.FluxHist());
+    NVTEST_CHECK(Near(manifest.FATX(), expected));
+    NVTEST_CHECK(manifest.Write());
+  }
+
+  {
+    nvconv::ConversionManifest read(filename, "neut.hepmc3");
+    NVTEST_CHECK(read.FluxHist());
+    NVTEST_CHECK(Near(read.FATX(), expected));
+
+    // without histograms, the parts so far cannot be combined with this one
+    NVTEST_CHECK_THROWS(
+        read.AddPart({"d.root"}, {MakeMeta("d", 10, 600)}),
+        "Cannot combine the FATX");
+    NVTEST_CHECK(read.NParts() == 2);
+    NVTEST_CHECK(Near(read.FATX(), expected));
+  }
+
+  NVTEST_CHECK_THROWS(nvconv::ConversionManifest(filename, "other.hepmc3"),
+                      "is for output neut.hepmc3");
+
+  std::remove(filename.c_str());
+}
+
+int main() {
+  TestMonoParts();
+  TestFluxParts();
+  return nvtest::Result();
+}
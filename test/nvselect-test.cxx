@@ -0,0 +1,152 @@
+#include "nvinputtools.h"
+#include "nvselect.h"
+
+#include "nvsynth.h"
+
+#include "nvtest.h"
+
+#include "TChain.h"
+#include "TFile.h"
+#include "TTree.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Tests that selections parse, evaluate and fail as documented in nvselect.h,
+// and that the members they name are enough to decide on an entry of which
+// only those members were read.
+
+bool HasMember(nvconv::EventSelection const &sel, std::string const &member) {
+  auto const &members = sel.Members();
+  return std::find(members.begin(), members.end(), member) != members.end();
+}
+
+void TestMembers() {
+  nvconv::EventSelection sel("abs(Mode) < 30 && Enu > 200");
+  NVTEST_CHECK(HasMember(sel, "Mode"));
+  NVTEST_CHECK(HasMember(sel, "PartInfo"));
+  NVTEST_CHECK(HasMember(sel, "Npart"));
+  NVTEST_CHECK(!HasMember(sel, "Totcrs"));
+
+  // the final state statuses depend on whether the mode is diffractive
+  nvconv::EventSelection nfs("nfs(211) == 0");
+  NVTEST_CHECK(HasMember(nfs, "Mode"));
+  NVTEST_CHECK(HasMember(nfs, "PartInfo"));
+  NVTEST_CHECK(HasMember(nfs, "Npart"));
+}
+
+void TestEvaluate() {
+  nvbench::NeutVectSynthesizer synth;
+  NeutVect nv;
+  synth.Generate(&nv);
+  nv.Mode = 11;
+  nv.TargetA = 12;
+
+  auto selects = [&](std::string const &expression) {
+    return nvconv::EventSelection(expression).Select(&nv);
+  };
+  NVTEST_CHECK(selects("Mode == 11"));
+  NVTEST_CHECK(!selects("Mode != 11"));
+  NVTEST_CHECK(selects("-Mode == -11"));
+  NVTEST_CHECK(selects("abs(-Mode) in (1, 11, 21)"));
+  NVTEST_CHECK(!selects("Mode in (1, 21)"));
+  NVTEST_CHECK(selects("1 + 2 * 3 == 7"));
+  NVTEST_CHECK(selects("(1 + 2) * 3 == 9"));
+  NVTEST_CHECK(selects("8 / 2 - 1 == 3"));
+  NVTEST_CHECK(selects("!(Mode < 10) && TargetA >= 12"));
+  NVTEST_CHECK(selects("Mode == 1 || TargetA == 12"));
+  NVTEST_CHECK(!selects("Mode == 1 || TargetA == 1 && Mode == 11"));
+  NVTEST_CHECK(selects("nfs() >= nfs(211, -211)"));
+  NVTEST_CHECK(
+      selects("BeamPDG == " + std::to_string(nv.PartInfo(0)->fPID)));
+}
+
+void TestErrors() {
+  NVTEST_CHECK_THROWS(nvconv::EventSelection("Mode =="),
+                      "expected a value at position 7");
+  NVTEST_CHECK_THROWS(nvconv::EventSelection("Mode == 1)"),
+                      "unexpected ')' at position 9");
+  NVTEST_CHECK_THROWS(nvconv::EventSelection("Enu > 200 && foo"),
+                      "unknown value 'foo' at position 13");
+  NVTEST_CHECK_THROWS(nvconv::EventSelection("nfs(211"),
+                      "expected ')' at position 7");
+  NVTEST_CHECK_THROWS(nvconv::EventSelection("Mode in ()"),
+                      "expected a number at position 9");
+  NVTEST_CHECK_THROWS(nvconv::EventSelection("abs(Mode"),
+                      "expected ')' at position 8");
+  // the message points at the error
+  NVTEST_CHECK_THROWS(nvconv::EventSelection("Mode == 1)"),
+                      "Mode == 1)\n\t         ^");
+}
+
+// Evaluates each selection on entries read in full and on the same entries
+// with only its members read by a MemberReader, leaving the rest of the
+// NeutVect as it was for an earlier entry, as the converter does.
+void TestPartialRead() {
+  std::string filename = nvtest::TempPath("nvselect-test.root");
+  {
+    nvbench::NeutVectSynthesizer synth;
+    TFile fout(filename.c_str(), "RECREATE");
+    // owned by fout
+    auto tree = new TTree("neuttree", "nvselect-test events");
+    tree->SetDirectory(&fout);
+    auto nv = std::make_unique<NeutVect>();
+    NeutVect *nv_ptr = nv.get();
+    tree->Branch("vectorbranch", &nv_ptr);
+    for (int i = 0; i < 200; ++i) {
+      synth.Generate(nv_ptr);
+      // the final state of a diffractive event is found differently, so a
+      // stale Mode changes nfs
+      if (i % 2) {
+        nv_ptr->Mode = 15;
+      }
+      tree->Fill();
+    }
+    tree->Write();
+    fout.Close();
+  }
+
+  for (std::string expression :
+       {"nfs() > 2", "nfs(211, -211, 111) == 0", "nfs(2212) == 1",
+        "Enu > 1000 && BeamPDG == 14", "abs(Mode) == 15 && nfs(13) == 1"}) {
+    TChain chin("neuttree");
+    chin.Add(filename.c_str());
+    NeutVect *nv = nullptr;
+    chin.SetBranchAddress("vectorbranch", &nv);
+
+    nvconv::EventSelection full(expression);
+    std::vector<bool> expected;
+    for (Long64_t i = 0; i < chin.GetEntries(); ++i) {
+      chin.GetEntry(i);
+      expected.push_back(full.Select(nv));
+    }
+
+    nvconv::EventSelection partial(expression);
+    nvconv::MemberReader reader(partial.Members());
+    int nmismatched = 0;
+    for (Long64_t i = 0; i < chin.GetEntries(); ++i) {
+      Long64_t fentry = chin.LoadTree(i);
+      NVTEST_CHECK(reader.Read(chin.GetTree(), chin.GetTreeNumber(), fentry) >
+                   0);
+      nmismatched += (partial.Select(nv) != expected[i]);
+    }
+    NVTEST_CHECK(!nmismatched);
+    if (nmismatched) {
+      std::cout << "\t" << nmismatched << " entries decided differently by "
+                << expression << std::endl;
+    }
+  }
+
+  std::remove(filename.c_str());
+}
+
+int main() {
+  TestMembers();
+  TestEvaluate();
+  TestErrors();
+  TestPartialRead();
+  return nvtest::Result();
+}
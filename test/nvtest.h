@@ -0,0 +1,60 @@
+#pragma once
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+// The unit tests are plain executables run by ctest. A failed check is
+// reported and counted rather than aborting, and main returns
+// nvtest::Result(), so that every failure in a test is seen in one run.
+namespace nvtest {
+
+inline int &NFailures() {
+  static int nfailures = 0;
+  return nfailures;
+}
+
+inline void Check(bool passed, char const *what, char const *file, int line) {
+  if (!passed) {
+    std::cout << "[ERROR]: " << file << ":" << line << ": " << what
+              << std::endl;
+    NFailures()++;
+  }
+}
+
+inline int Result() {
+  if (NFailures()) {
+    std::cout << "[ERROR]: " << NFailures() << " checks failed." << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+// A path in the temporary directory unique to this process, so that tests run
+// in parallel do not share files.
+inline std::string TempPath(std::string const &name) {
+  return (std::filesystem::temp_directory_path() /
+          ("nvconv-test-" + std::to_string(::getpid()) + "-" + name))
+      .string();
+}
+
+} // namespace nvtest
+
+#define NVTEST_CHECK(expr) nvtest::Check(bool(expr), #expr, __FILE__, __LINE__)
+
+// Checks that stmt throws a std::exception whose what() contains msg.
+#define NVTEST_CHECK_THROWS(stmt, msg)                                         \
+  do {                                                                         \
+    std::string what;                                                          \
+    try {                                                                      \
+      stmt;                                                                    \
+    } catch (std::exception const &ex) {                                       \
+      what = ex.what();                                                        \
+    }                                                                          \
+    nvtest::Check(what.find(msg) != std::string::npos,                         \
+                  #stmt " throws \"" msg "\"", __FILE__, __LINE__);            \
+    if (what.size() && (what.find(msg) == std::string::npos)) {                \
+      std::cout << "\tthrew: " << what << std::endl;                           \
+    }                                                                          \
+  } while (false)